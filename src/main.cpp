@@ -1,13 +1,29 @@
 #include <QApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDebug>
 #include <QMessageBox>
 
+#include "model/database.h"
+#include "model/image_cache.h"
 #include "view/main_window.h"
 
 int main( int argc, char *argv[] )
 {
     QApplication a(argc, argv);
 
-    if( argc != 2 )
+    QCommandLineParser parser;
+    parser.addPositionalArgument( "database", "Path to the database file." );
+    QCommandLineOption concurrentOption( "concurrent",
+                                         "Share the database file with other instances: WAL journal, "
+                                         "busy timeout and periodic checkpoints." );
+    QCommandLineOption busyTimeoutOption( "busy-timeout", "How long a statement waits for a locked database.", "ms" );
+    QCommandLineOption mmapSizeOption( "mmap-size", "How much of the file is memory mapped.", "bytes" );
+    QCommandLineOption cacheSizeOption( "cache-size", "Page cache size of each connection.", "KiB" );
+    QCommandLineOption imageCacheSizeOption( "image-cache-size", "Memory kept for decoded photos.", "MiB" );
+    parser.addOptions( { concurrentOption, busyTimeoutOption, mmapSizeOption, cacheSizeOption, imageCacheSizeOption } );
+
+    if( !parser.parse( a.arguments() ) || parser.positionalArguments().size() != 1 )
     {
         QMessageBox::critical( nullptr,
                                "Arguments error",
@@ -17,7 +33,26 @@ int main( int argc, char *argv[] )
         return 0;
     }
 
-    PatientsDBManager::MainWindow w( argv[1] );
+    auto options = parser.isSet( concurrentOption ) ? PatientsDBManager::ConnectionOptions::concurrent()
+                                                    : PatientsDBManager::ConnectionOptions();
+    if( parser.isSet( busyTimeoutOption ) )
+        options.busyTimeoutMs = parser.value( busyTimeoutOption ).toInt();
+    if( parser.isSet( mmapSizeOption ) )
+        options.mmapSize = parser.value( mmapSizeOption ).toLongLong();
+    if( parser.isSet( cacheSizeOption ) )
+        options.cacheSizeKiB = parser.value( cacheSizeOption ).toInt();
+    PatientsDBManager::Database::setConnectionOptions( options );
+
+    if( parser.isSet( imageCacheSizeOption ) )
+        PatientsDBManager::ImageCache::setBudget( parser.value( imageCacheSizeOption ).toLongLong() * 1024 * 1024 );
+
+    PatientsDBManager::MainWindow w( parser.positionalArguments().first() );
     w.show();
-    return a.exec();
+    const int result = a.exec();
+
+    const auto statistics = PatientsDBManager::ImageCache::statistics();
+    qDebug() << QString( "Image cache: %1 hits, %2 misses, %3 evictions" ).arg( statistics.hits )
+                                                                           .arg( statistics.misses )
+                                                                           .arg( statistics.evictions );
+    return result;
 }
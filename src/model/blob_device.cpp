@@ -0,0 +1,96 @@
+#include "blob_device.h"
+
+#include <QDebug>
+
+#include <sqlite3.h>
+
+namespace PatientsDBManager
+{
+    BlobDevice::BlobDevice( sqlite3* handle,
+                            const QString& table,
+                            const QString& column,
+                            int64_t rowId,
+                            QObject* parent ) noexcept
+        : QIODevice( parent )
+        , m_handle( handle )
+        , m_table( table.toUtf8() )
+        , m_column( column.toUtf8() )
+        , m_rowId( rowId )
+    {}
+
+    BlobDevice::~BlobDevice()
+    {
+        close();
+    }
+
+    bool BlobDevice::open( OpenMode mode )
+    {
+        if( !m_handle || ( mode & ( QIODevice::Append | QIODevice::Truncate ) ) )
+            return false;
+
+        const int writable = ( mode & QIODevice::WriteOnly ) ? 1 : 0;
+        if( sqlite3_blob_open( m_handle, "main", m_table.constData(), m_column.constData(),
+                               m_rowId, writable, &m_blob ) != SQLITE_OK )
+        {
+            qDebug() << "BlobDevice::open: " << sqlite3_errmsg( m_handle );
+            sqlite3_blob_close( m_blob );
+            m_blob = nullptr;
+            return false;
+        }
+
+        m_size = sqlite3_blob_bytes( m_blob );
+
+        // QIODevice's own read buffer would only duplicate what the reader copies out
+        return QIODevice::open( mode | QIODevice::Unbuffered );
+    }
+
+    void BlobDevice::close()
+    {
+        if( m_blob )
+        {
+            sqlite3_blob_close( m_blob );
+            m_blob = nullptr;
+        }
+        m_size = 0;
+
+        if( isOpen() )
+            QIODevice::close();
+    }
+
+    qint64 BlobDevice::readData( char* data, qint64 maxSize )
+    {
+        if( !m_blob )
+            return -1;
+
+        const auto length = qMin( maxSize, m_size - pos() );
+        if( length <= 0 )
+            return 0;
+
+        if( sqlite3_blob_read( m_blob, data, static_cast<int>( length ), static_cast<int>( pos() ) ) != SQLITE_OK )
+        {
+            setErrorString( sqlite3_errmsg( m_handle ) );
+            return -1;
+        }
+        return length;
+    }
+
+    qint64 BlobDevice::writeData( const char* data, qint64 maxSize )
+    {
+        if( !m_blob )
+            return -1;
+
+        // the BLOB does not grow, writing past its end is an error
+        if( maxSize > m_size - pos() )
+        {
+            setErrorString( "Write past the end of the BLOB" );
+            return -1;
+        }
+
+        if( sqlite3_blob_write( m_blob, data, static_cast<int>( maxSize ), static_cast<int>( pos() ) ) != SQLITE_OK )
+        {
+            setErrorString( sqlite3_errmsg( m_handle ) );
+            return -1;
+        }
+        return maxSize;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef BLOBDEVICE_H
+#define BLOBDEVICE_H
+
+#include <QByteArray>
+#include <QIODevice>
+
+struct sqlite3;
+struct sqlite3_blob;
+
+namespace PatientsDBManager
+{
+    // Random-access view of a single BLOB cell, backed by SQLite incremental BLOB
+    // I/O. Nothing is buffered beyond what the reader asks for. Writing can not
+    // change the size of the BLOB, so a cell to be written is created with
+    // zeroblob( size ) first. The device must be used from the thread that owns
+    // the connection.
+    class BlobDevice : public QIODevice
+    {
+        Q_OBJECT
+    public:
+        BlobDevice( sqlite3* handle,
+                    const QString& table,
+                    const QString& column,
+                    int64_t rowId,
+                    QObject* parent = nullptr ) noexcept;
+        ~BlobDevice() override;
+
+        bool open( OpenMode mode ) override;
+        void close() override;
+
+        bool isSequential() const override { return false; }
+        qint64 size() const override { return m_size; }
+
+    protected:
+        qint64 readData( char* data, qint64 maxSize ) override;
+        qint64 writeData( const char* data, qint64 maxSize ) override;
+
+    private:
+        sqlite3*      m_handle{ nullptr };
+        sqlite3_blob* m_blob{ nullptr };
+        QByteArray    m_table;
+        QByteArray    m_column;
+        int64_t       m_rowId{ 0 };
+        qint64        m_size{ 0 };
+
+        BlobDevice( const BlobDevice& ) = delete;
+        BlobDevice& operator=( const BlobDevice& ) = delete;
+    };
+}
+
+#endif // BLOBDEVICE_H
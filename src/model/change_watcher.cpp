@@ -0,0 +1,237 @@
+#include "change_watcher.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QSqlError>
+#include <QStringList>
+
+#include "model/database.h"
+
+namespace PatientsDBManager
+{
+    namespace
+    {
+        const QString OWN_CHANGES_TABLE_NAME = "OwnChanges";
+
+        // First and last operation on a row between two polls
+        struct RowOperations
+        {
+            QChar first;
+            QChar last;
+        };
+
+        RowChanges CoalesceChanges( const QHash<qint64, RowOperations>& operations )
+        {
+            RowChanges changes;
+            for( auto row = operations.constBegin(); row != operations.constEnd(); ++row )
+            {
+                const auto& operation = row.value();
+                if( operation.first == 'I' && operation.last == 'D' )
+                    continue;
+                else if( operation.first == 'I' )
+                    changes.inserted.append( row.key() );
+                else if( operation.last == 'D' )
+                    changes.deleted.append( row.key() );
+                else
+                    changes.updated.append( row.key() );
+            }
+            return changes;
+        }
+    }
+
+    ChangeWatcher::ChangeWatcher( Database& db, QObject* parent ) noexcept
+        : QObject( parent )
+        , m_db( db.getConnection() )
+        , m_dataVersionQuery( m_db )
+        , m_changesQuery( m_db )
+    {
+        m_pollTimer.setInterval( POLL_INTERVAL_MS );
+        connect( &m_pollTimer, &QTimer::timeout, this, &ChangeWatcher::poll );
+    }
+
+    bool ChangeWatcher::start() noexcept
+    {
+        // The temporary trigger fires for inserts into the log made through this connection only
+        const QStringList statements{
+            "CREATE TEMP TABLE IF NOT EXISTS " + OWN_CHANGES_TABLE_NAME + " ( Id INTEGER PRIMARY KEY );",
+
+            "CREATE TEMP TRIGGER IF NOT EXISTS " + CHANGE_LOG_TABLE_NAME + "_Own AFTER INSERT ON main." + CHANGE_LOG_TABLE_NAME + " "
+            "BEGIN "
+                "INSERT OR IGNORE INTO " + OWN_CHANGES_TABLE_NAME + " ( Id ) VALUES ( NEW.Id ); "
+            "END;" };
+
+        QSqlQuery query( m_db );
+        for( const auto& statement : statements )
+        {
+            if( !query.exec( statement ) )
+            {
+                qDebug() << "ChangeWatcher::start: " + query.lastError().text();
+                return false;
+            }
+        }
+
+        prune();
+
+        query.setForwardOnly( true );
+        if( !query.exec( "SELECT max(Id) FROM " + CHANGE_LOG_TABLE_NAME + ";" ) || !query.next() )
+        {
+            qDebug() << "ChangeWatcher::start: " + query.lastError().text();
+            return false;
+        }
+        m_lastChangeId = query.value( 0 ).toLongLong();
+        query.finish();
+
+        m_dataVersionQuery.setForwardOnly( true );
+        m_changesQuery.setForwardOnly( true );
+        if( !m_dataVersionQuery.prepare( "PRAGMA data_version;" ) ||
+            !m_changesQuery.prepare( "SELECT Id, TableName, RowId, Operation FROM " + CHANGE_LOG_TABLE_NAME + " "
+                                     "WHERE Id > ? AND Id NOT IN ( SELECT Id FROM temp." + OWN_CHANGES_TABLE_NAME + " ) "
+                                     "ORDER BY Id;" ) )
+        {
+            qDebug() << "ChangeWatcher::start: " + m_dataVersionQuery.lastError().text() + m_changesQuery.lastError().text();
+            return false;
+        }
+
+        const auto version = dataVersion();
+        if( !version )
+            return false;
+
+        m_dataVersion = *version;
+        m_pollTimer.start();
+        return true;
+    }
+
+    void ChangeWatcher::stop() noexcept
+    {
+        m_pollTimer.stop();
+    }
+
+    void ChangeWatcher::poll() noexcept
+    {
+        // data_version only moves when another connection commits
+        const auto version = dataVersion();
+        if( !version )
+            return;
+
+        // Only this connection committed since the last poll, so every entry after the
+        // last read one is its own. They are skipped right away, which keeps the
+        // temporary table short while no other process writes.
+        if( *version == m_dataVersion )
+        {
+            QSqlQuery query( m_db );
+            query.setForwardOnly( true );
+            if( query.exec( "SELECT max(Id) FROM temp." + OWN_CHANGES_TABLE_NAME + ";" ) && query.next() &&
+                !query.value( 0 ).isNull() )
+            {
+                m_lastChangeId = qMax( m_lastChangeId, query.value( 0 ).toLongLong() );
+                query.finish();
+                pruneOwnChanges();
+            }
+            return;
+        }
+        m_dataVersion = *version;
+
+        QSqlQuery query( m_db );
+        query.setForwardOnly( true );
+        if( !query.exec( "SELECT min(Id) FROM " + CHANGE_LOG_TABLE_NAME + ";" ) || !query.next() )
+        {
+            qDebug() << "ChangeWatcher::poll: " + query.lastError().text();
+            return;
+        }
+        const auto firstId = query.value( 0 );
+        query.finish();
+
+        // Log ids only grow, a gap before the oldest entry means unread entries were pruned
+        if( !firstId.isNull() && firstId.toLongLong() > m_lastChangeId + 1 )
+        {
+            if( query.exec( "SELECT max(Id) FROM " + CHANGE_LOG_TABLE_NAME + ";" ) && query.next() )
+                m_lastChangeId = query.value( 0 ).toLongLong();
+            query.finish();
+
+            query.exec( "DELETE FROM temp." + OWN_CHANGES_TABLE_NAME + ";" );
+            emit resyncRequired();
+            return;
+        }
+
+        QHash<qint64, RowOperations> patients;
+        QHash<qint64, RowOperations> photos;
+
+        m_changesQuery.bindValue( 0, m_lastChangeId );
+        if( !m_changesQuery.exec() )
+        {
+            qDebug() << "ChangeWatcher::poll: " + m_changesQuery.lastError().text();
+            return;
+        }
+
+        while( m_changesQuery.next() )
+        {
+            m_lastChangeId = m_changesQuery.value( 0 ).toLongLong();
+
+            const auto tableName = m_changesQuery.value( 1 ).toString();
+            if( tableName != PATIENTS_TABLE_NAME && tableName != PHOTOS_SET_TABLE_NAME )
+                continue;
+
+            auto& operations = tableName == PATIENTS_TABLE_NAME ? patients : photos;
+
+            const auto rowId = m_changesQuery.value( 2 ).toLongLong();
+            const auto operation = m_changesQuery.value( 3 ).toString().at( 0 );
+
+            auto row = operations.find( rowId );
+            if( row == operations.end() )
+                operations.insert( rowId, RowOperations{ operation, operation } );
+            else
+                row->last = operation;
+        }
+        m_changesQuery.finish();
+
+        pruneOwnChanges();
+
+        if( !firstId.isNull() && m_lastChangeId - firstId.toLongLong() > 2 * CHANGE_LOG_LIMIT )
+            prune();
+
+        const auto patientChanges = CoalesceChanges( patients );
+        if( !patientChanges.isEmpty() )
+            emit patientsChanged( patientChanges );
+
+        const auto photoChanges = CoalesceChanges( photos );
+        if( !photoChanges.isEmpty() )
+            emit photosChanged( photoChanges );
+    }
+
+    std::optional<qint64> ChangeWatcher::dataVersion() noexcept
+    {
+        if( !m_dataVersionQuery.exec() || !m_dataVersionQuery.next() )
+        {
+            qDebug() << "ChangeWatcher::dataVersion: " + m_dataVersionQuery.lastError().text();
+            return std::nullopt;
+        }
+
+        const auto version = m_dataVersionQuery.value( 0 ).toLongLong();
+        m_dataVersionQuery.finish();
+        return version;
+    }
+
+    void ChangeWatcher::pruneOwnChanges() noexcept
+    {
+        QSqlQuery query( m_db );
+        query.prepare( "DELETE FROM temp." + OWN_CHANGES_TABLE_NAME + " WHERE Id <= ?;" );
+        query.addBindValue( m_lastChangeId );
+        if( !query.exec() )
+            qDebug() << "ChangeWatcher::pruneOwnChanges: " + query.lastError().text();
+    }
+
+    bool ChangeWatcher::prune() noexcept
+    {
+        // Every process keeps the newest entries, one that falls further behind resyncs
+        QSqlQuery query( m_db );
+        query.prepare( "DELETE FROM " + CHANGE_LOG_TABLE_NAME + " "
+                       "WHERE Id <= ( SELECT max(Id) FROM " + CHANGE_LOG_TABLE_NAME + " ) - ?;" );
+        query.addBindValue( CHANGE_LOG_LIMIT );
+        if( !query.exec() )
+        {
+            qDebug() << "ChangeWatcher::prune: " + query.lastError().text();
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef CHANGEWATCHER_H
+#define CHANGEWATCHER_H
+
+#include <optional>
+
+#include <QObject>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTimer>
+
+#include "model/data_types.h"
+
+namespace PatientsDBManager
+{
+    class Database;
+
+    // Watches the database file for commits of other connections and processes.
+    // PRAGMA data_version is polled, which only reads the cached file header; when
+    // it moves, the ChangeLog entries written since the last poll are read and
+    // reported per table. Entries written through this connection are skipped:
+    // a temporary trigger records their ids.
+    class ChangeWatcher : public QObject
+    {
+        Q_OBJECT
+    public:
+        static constexpr int POLL_INTERVAL_MS = 1000;
+        static constexpr int CHANGE_LOG_LIMIT = 10000;
+
+        explicit ChangeWatcher( Database& db, QObject* parent = nullptr ) noexcept;
+
+        bool start() noexcept;
+        void stop() noexcept;
+
+    public slots:
+        void poll() noexcept;
+
+    signals:
+        void patientsChanged( const RowChanges& changes );
+        void photosChanged( const RowChanges& changes );
+        // entries were pruned before they were read, so every model has to be selected again
+        void resyncRequired();
+
+    private:
+        QSqlDatabase m_db;
+        QTimer       m_pollTimer;
+
+        QSqlQuery m_dataVersionQuery;
+        QSqlQuery m_changesQuery;
+
+        qint64 m_dataVersion{ 0 };
+        qint64 m_lastChangeId{ 0 };
+
+        std::optional<qint64> dataVersion() noexcept;
+        bool prune() noexcept;
+        // Drops the recorded ids of own entries up to the last read one
+        void pruneOwnChanges() noexcept;
+    };
+}
+
+#endif // CHANGEWATCHER_H
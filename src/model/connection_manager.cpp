@@ -0,0 +1,122 @@
+#include "connection_manager.h"
+
+#include <memory>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutexLocker>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QThread>
+
+#include "model/database.h"
+#include "model/statement_cache.h"
+
+namespace PatientsDBManager
+{
+    namespace
+    {
+        enum class ERole : char { READER, WRITER };
+
+        // One file may be passed with different relative paths
+        QString fileKey( const QString& fileName )
+        {
+            return QFileInfo( fileName ).absoluteFilePath();
+        }
+
+        QStringList& threadConnections()
+        {
+            thread_local QStringList connectionNames;
+            return connectionNames;
+        }
+
+        void releaseOnFinish()
+        {
+            thread_local bool connected = false;
+            if( connected )
+                return;
+
+            // The main thread has no finished() and its connections live until the process exits
+            auto thread = QThread::currentThread();
+            if( QCoreApplication::instance() && thread == QCoreApplication::instance()->thread() )
+                return;
+
+            // finished() is emitted on the thread itself, before its thread local data is destroyed
+            QObject::connect( thread, &QThread::finished, thread, []{ ConnectionManager::releaseThread(); },
+                              Qt::DirectConnection );
+            connected = true;
+        }
+
+        QSqlDatabase connection( const QString& fileName, ERole role )
+        {
+            const auto connectionName = QString( "%1_%2_%3" )
+                                        .arg( role == ERole::READER ? "Reader" : "Writer" )
+                                        .arg( qHash( fileKey( fileName ) ), 0, 16 )
+                                        .arg( reinterpret_cast<quintptr>( QThread::currentThreadId() ), 0, 16 );
+
+            auto& connectionNames = threadConnections();
+            if( connectionNames.contains( connectionName ) )
+            {
+                {
+                    auto db = QSqlDatabase::database( connectionName, false );
+                    if( db.isOpen() )
+                        return db;
+                }
+
+                // the file could not be opened the last time
+                StatementCache::release( connectionName );
+                QSqlDatabase::removeDatabase( connectionName );
+            }
+            else
+            {
+                connectionNames.append( connectionName );
+                releaseOnFinish();
+            }
+
+            auto db = Database::openConnection( fileName, connectionName );
+            if( db.isOpen() && role == ERole::READER )
+            {
+                QSqlQuery query( db );
+                if( !query.exec( "PRAGMA query_only = ON;" ) )
+                    qDebug() << "ConnectionManager::reader: " + query.lastError().text();
+            }
+            return db;
+        }
+    }
+
+    QSqlDatabase ConnectionManager::reader( const QString& fileName ) noexcept
+    {
+        return connection( fileName, ERole::READER );
+    }
+
+    QSqlDatabase ConnectionManager::writer( const QString& fileName ) noexcept
+    {
+        return connection( fileName, ERole::WRITER );
+    }
+
+    QMutex* ConnectionManager::writeMutex( const QString& fileName ) noexcept
+    {
+        static QMutex mutex;
+        static QHash<QString, std::shared_ptr<QMutex>> writeMutexes;
+
+        QMutexLocker locker( &mutex );
+        auto& writeMutex = writeMutexes[fileKey( fileName )];
+        if( !writeMutex )
+            writeMutex = std::make_shared<QMutex>();
+        return writeMutex.get();
+    }
+
+    void ConnectionManager::releaseThread() noexcept
+    {
+        auto& connectionNames = threadConnections();
+        for( const auto& connectionName : connectionNames )
+        {
+            StatementCache::release( connectionName );
+            QSqlDatabase::removeDatabase( connectionName );
+        }
+        connectionNames.clear();
+    }
+}
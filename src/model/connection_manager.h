@@ -0,0 +1,37 @@
+#ifndef CONNECTIONMANAGER_H
+#define CONNECTIONMANAGER_H
+
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QString>
+
+namespace PatientsDBManager
+{
+    // Connections of the background threads. Qt allows a connection to be used only
+    // by the thread that opened it, so every thread gets named connections of its
+    // own: opened on first use with the pragmas of Database::openConnection() and
+    // closed when the QThread finishes, which also recycles the connections of
+    // pool threads that expire.
+    //
+    // Readers are query_only. Writes go through the writer connection of the
+    // thread and are serialized by the write mutex of the file: one write
+    // transaction of the process at a time, so writers queue on the mutex
+    // instead of failing with "database is locked" and readers keep running
+    // next to them in WAL mode.
+    class ConnectionManager
+    {
+    public:
+        // An invalid or closed connection is returned when the file can not be opened
+        static QSqlDatabase reader( const QString& fileName ) noexcept;
+        static QSqlDatabase writer( const QString& fileName ) noexcept;
+
+        // Held from BEGIN to COMMIT by every write transaction on the file, also by
+        // the ones of the main connection
+        static QMutex* writeMutex( const QString& fileName ) noexcept;
+
+        // Closes the connections of the calling thread, no copies of them may be left
+        static void releaseThread() noexcept;
+    };
+}
+
+#endif // CONNECTIONMANAGER_H
@@ -9,9 +9,9 @@ namespace PatientsDBManager
 
     Patient::Patient( const QString& name,
                       const QString& address,
-                      const QString& birthDate,
-                      const QString& admissionDate,
-                      const QString& discargeDate ) noexcept
+                      const QDate& birthDate,
+                      const QDate& admissionDate,
+                      const QDate& discargeDate ) noexcept
         : name{ name }
         , address{ address }
         , birthDate{ birthDate }
@@ -21,13 +21,16 @@ namespace PatientsDBManager
 
     Patient::Patient( const Patient& p )
         : Patient( p.name, p.address, p.birthDate, p.admissionDate, p.discargeDate )
-    {}
+    {
+        id = p.id;
+    }
 
     Patient& Patient::operator=( const Patient& p )
     {
         if( this == &p )
             return *this;
 
+        id = p.id;
         name = p.name;
         address = p.address;
         birthDate = p.birthDate;
@@ -38,7 +41,8 @@ namespace PatientsDBManager
     }
 
     Patient::Patient( Patient&& p )
-        : name( std::move( p.name ) )
+        : id( p.id )
+        , name( std::move( p.name ) )
         , address( std::move( p.address ) )
         , birthDate( std::move( p.birthDate ) )
         , admissionDate( std::move( p.admissionDate ) )
@@ -50,6 +54,7 @@ namespace PatientsDBManager
         if( this == &p )
             return *this;
 
+        id = p.id;
         name = std::move( p.name );
         address = std::move( p.address );
         birthDate = std::move( p.birthDate );
@@ -3,24 +3,26 @@
 
 #include <QDate>
 #include <QDateTime>
+#include <QVector>
 
 namespace PatientsDBManager
 {
     struct Patient
     {
     public:
+        int64_t id{ 0 };              // 0 until the patient is stored
         QString name;
         QString address;
-        QString birthDate;
-        QString admissionDate;
-        QString discargeDate;
+        QDate   birthDate;
+        QDate   admissionDate;
+        QDate   discargeDate;     // null while the patient is not discharged
 
         Patient() noexcept;
         Patient( const QString& name,
                  const QString& address,
-                 const QString& birthDate,
-                 const QString& admissionDate,
-                 const QString& discargeDate ) noexcept;
+                 const QDate& birthDate,
+                 const QDate& admissionDate,
+                 const QDate& discargeDate ) noexcept;
 
         Patient( const Patient& patient );
         Patient& operator=( const Patient& patient );
@@ -28,6 +30,25 @@ namespace PatientsDBManager
         Patient( Patient&& patient );
         Patient& operator=( Patient&& patient );
     };
+
+    struct PhotoInfo
+    {
+        int64_t id{ 0 };
+        QDateTime date;
+        QString fileName;
+        int64_t patientId{ 0 };
+        int64_t contentId{ 0 };
+    };
+
+    // Rowids of one table changed since the last poll of the change log
+    struct RowChanges
+    {
+        QVector<qint64> inserted;
+        QVector<qint64> updated;
+        QVector<qint64> deleted;
+
+        bool isEmpty() const noexcept { return inserted.isEmpty() && updated.isEmpty() && deleted.isEmpty(); }
+    };
 }
 
 
@@ -1,12 +1,45 @@
 #include "model/database.h"
 
 #include <QCoreApplication>
+#include <QEventLoop>
 #include <QFile>
 #include <QFileInfo>
+#include <QSqlDriver>
+#include <QSqlRecord>
+#include <QThread>
+
+#include <sqlite3.h>
+
+#include "model/connection_manager.h"
+#include "model/schema_migrator.h"
+#include "model/statement_cache.h"
+#include "utility/hash.h"
 
 namespace PatientsDBManager
 {
+    namespace
+    {
+        // Before dates were stored as integers they were dd.MM.yyyy text and
+        // timestamps dd.MM.yyyy hh:mm text in local time. Anything else,
+        // e.g. the "Not set" placeholder, converts to NULL.
+        QString julianDayFromText( const QString& column )
+        {
+            return "CAST( julianday( substr( " + column + ", 7, 4 ) || '-' || substr( " + column + ", 4, 2 ) || '-' || "
+                   "substr( " + column + ", 1, 2 ) ) + 0.5 AS INTEGER )";
+        }
 
+        QString unixTimeFromText( const QString& column )
+        {
+            return "CAST( strftime( '%s', substr( " + column + ", 7, 4 ) || '-' || substr( " + column + ", 4, 2 ) || '-' || "
+                   "substr( " + column + ", 1, 2 ) || ' ' || substr( " + column + ", 12, 5 ), 'utc' ) AS INTEGER )";
+        }
+
+        ConnectionOptions& connectionOptions()
+        {
+            static ConnectionOptions options;
+            return options;
+        }
+    }
 
     Database::Database( const QString& fileName, QObject* parent ) noexcept
         : QObject( parent )
@@ -15,8 +48,16 @@ namespace PatientsDBManager
         m_db = QSqlDatabase::database( "QSQLITE" );
         if( !m_db.isValid() )
             m_db = QSqlDatabase::addDatabase( "QSQLITE" );
+
+        m_editBuffer = new ( std::nothrow ) EditBuffer( m_db, this );
     }
 
+    Database::Database( const QSqlDatabase& db, const QString& fileName ) noexcept
+        : m_db( db )
+        , m_fileName( fileName )
+        , m_ownsConnection( false )
+    {}
+
     Database::~Database() noexcept
     {
         close();
@@ -44,6 +85,10 @@ namespace PatientsDBManager
                                 .arg( PATIENTS_TABLE_NAME );
                     return  EConnectionResult::NO_TABLE;
                 }
+
+                if( !migrate() )
+                    return EConnectionResult::OPENING_FAILED;
+
                 return EConnectionResult::CONNECTED;
             }
             return EConnectionResult::OPENING_FAILED;
@@ -55,40 +100,59 @@ namespace PatientsDBManager
         }
     }
 
-    QSqlTableModel *Database::createPatientsModel( QObject* parent ) const noexcept
+    PatientsModel* Database::createPatientsModel( QObject* parent ) const noexcept
     {
-        if( auto patientsModel = new ( std::nothrow ) QSqlTableModel( parent, m_db ) )
-        {
-            patientsModel->setTable( PATIENTS_TABLE_NAME );
-            patientsModel->setEditStrategy( QSqlTableModel::OnManualSubmit );
+        return new ( std::nothrow ) PatientsModel( m_db, m_editBuffer, parent );
+    }
 
-            patientsModel->setHeaderData( 0, Qt::Horizontal, "Id" );
-            patientsModel->setHeaderData( 1, Qt::Horizontal, "Name" );
-            patientsModel->setHeaderData( 2, Qt::Horizontal, "Address" );
-            patientsModel->setHeaderData( 3, Qt::Horizontal, "Birth date" );
-            patientsModel->setHeaderData( 4, Qt::Horizontal, "Admission date" );
-            patientsModel->setHeaderData( 5, Qt::Horizontal, "Discarge date" );
+    PhotoSetModel* Database::createPhotoSetModel( QObject* parent ) const noexcept
+    {
+        return new ( std::nothrow ) PhotoSetModel( m_db, m_editBuffer, parent );
+    }
 
-            return patientsModel;
-        }
-        else
-            return nullptr;
+    BlobDevice* Database::openPhoto( int64_t contentId, QObject* parent ) const noexcept
+    {
+        return new ( std::nothrow ) BlobDevice( getHandle(), PHOTO_CONTENTS_TABLE_NAME, "Photo", contentId, parent );
     }
 
-    QSqlTableModel *Database::createPhotoSetModel( QObject* parent ) const noexcept
+    sqlite3* Database::getHandle( const QSqlDatabase& db ) noexcept
     {
-        if( auto photoSetsModel = new ( std::nothrow ) QSqlTableModel( parent, m_db ) )
-        {
-            photoSetsModel->setTable( PHOTOS_SET_TABLE_NAME );
-            photoSetsModel->setEditStrategy( QSqlTableModel::OnManualSubmit );
+        return SqliteConnection::handle( db );
+    }
 
-            photoSetsModel->setHeaderData( 1, Qt::Horizontal, "Date" );
-            photoSetsModel->setHeaderData( 2, Qt::Horizontal, "Photo name" );
+    QSqlDatabase Database::openConnection( const QString& fileName, const QString& connectionName ) noexcept
+    {
+        auto db = QSqlDatabase::addDatabase( "QSQLITE", connectionName );
+        db.setDatabaseName( fileName );
+        if( !db.open() )
+        {
+            qDebug() << "Database::openConnection: " + db.lastError().text();
+            return db;
+        }
 
-            return photoSetsModel;
+        QSqlQuery query( db );
+        if( !query.exec( "PRAGMA foreign_keys = ON;" ) )
+        {
+            qDebug() << "Database::openConnection: " + query.lastError().text();
+            db.close();
+            return db;
         }
-        else
-            return nullptr;
+
+        // the connection still works in the journal mode the file has
+        if( !SqliteConnection::configure( db, getConnectionOptions() ) )
+            qDebug() << "Database::openConnection: the connection options were not applied";
+
+        return db;
+    }
+
+    void Database::setConnectionOptions( const ConnectionOptions& options ) noexcept
+    {
+        connectionOptions() = options;
+    }
+
+    const ConnectionOptions& Database::getConnectionOptions() noexcept
+    {
+        return connectionOptions();
     }
 
     QString Database::getConnectionResult( EConnectionResult result ) noexcept
@@ -123,6 +187,30 @@ namespace PatientsDBManager
                 qDebug() << "Database::open: " + query.lastError().text();
                 return false;
             }
+
+            const auto& options = getConnectionOptions();
+            if( !SqliteConnection::configure( m_db, options ) )
+                qDebug() << "Database::open: the connection options were not applied";
+
+            // Checkpoints of the main connection keep the WAL short while other
+            // instances hold read transactions the automatic checkpoint can not pass
+            if( options.walMode && options.checkpointIntervalMs > 0 )
+            {
+                if( !m_checkpointTimer )
+                {
+                    m_checkpointTimer = new ( std::nothrow ) QTimer( this );
+                    if( m_checkpointTimer )
+                    {
+                        QObject::connect( m_checkpointTimer, &QTimer::timeout, this, [this]
+                        {
+                            SqliteConnection::checkpoint( m_db, SqliteConnection::ECheckpointMode::PASSIVE );
+                        } );
+                    }
+                }
+
+                if( m_checkpointTimer )
+                    m_checkpointTimer->start( options.checkpointIntervalMs );
+            }
             return true;
         }
         else
@@ -138,7 +226,19 @@ namespace PatientsDBManager
     {
         if( open( databaseName ) )
         {
-            if( createPhotoSetsTable() && createPatientsTable() )
+            SchemaMigrator migrator( m_db );
+            addMigrations( migrator );
+
+            if( createPatientsTable() &&
+                createPatientsIndexes() &&
+                createPatientsSearch() &&
+                createPhotoContentsTable() &&
+                createPhotoSetsTable() &&
+                createPhotoSetsIndexes() &&
+                createPhotoThumbnailsTable() &&
+                createPhotoContentsTriggers() &&
+                createChangeLog() &&
+                migrator.setVersion( migrator.latestVersion() ) )
                 return true;
             else
             {
@@ -149,18 +249,10 @@ namespace PatientsDBManager
         return false;
     }
 
-    bool Database::createPatientsTable() noexcept
+    bool Database::createPatientsTable( const QString& tableName ) noexcept
     {
-        QSqlQuery query;
-        query.prepare( "CREATE TABLE " + PATIENTS_TABLE_NAME + " ("
-                       "'Id'	INTEGER NOT NULL UNIQUE,"
-                       "'Name'	TEXT,"
-                       "'Address' TEXT,"
-                       "'BirthDate'	TEXT,"
-                       "'AdmissionDate'	TEXT NOT NULL,"
-                       "'DiscargeDate'	TEXT,"
-                       "PRIMARY KEY( \"Id\" AUTOINCREMENT) );" );
-//        query.bindValue( ":tablename", PATIENTS_TABLE_NAME );
+        QSqlQuery query( m_db );
+        query.prepare( Schema::CreateStatement<Schema::Patients>( tableName ) );
 
         if( !query.exec() )
         {
@@ -173,20 +265,120 @@ namespace PatientsDBManager
         }
     }
 
-    bool Database::createPhotoSetsTable() noexcept
+    bool Database::createPatientsIndexes() noexcept
+    {
+        // "Admitted between" is a range scan over the first index. Patients that are
+        // not discharged yet are a small subset, so they get a partial index of their own.
+        // Every other sortable column is indexed too: the list reads its pages and counts
+        // the rows ahead of a new patient by ( column, Id ), which these indexes cover.
+        QStringList statements{
+            "CREATE INDEX IF NOT EXISTS " + PATIENTS_TABLE_NAME + "_AdmissionDate ON " +
+            PATIENTS_TABLE_NAME + " ( AdmissionDate );",
+            "CREATE INDEX IF NOT EXISTS " + PATIENTS_TABLE_NAME + "_NotDischarged ON " +
+            PATIENTS_TABLE_NAME + " ( AdmissionDate ) WHERE DiscargeDate IS NULL;" };
+
+        for( const QString column : { "Name", "Address", "BirthDate", "DiscargeDate" } )
+        {
+            statements.append( "CREATE INDEX IF NOT EXISTS " + PATIENTS_TABLE_NAME + "_" + column + " ON " +
+                               PATIENTS_TABLE_NAME + " ( " + column + " );" );
+        }
+
+        QSqlQuery query( m_db );
+        for( const auto& statement : statements )
+        {
+            if( !query.exec( statement ) )
+            {
+                qDebug() << "DataBase::createPatientsIndexes: " + query.lastError().text();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Database::createPatientsSearch() noexcept
+    {
+        // The index keeps its own copy of the text instead of reading Patients as
+        // external content: deleting a row that is not indexed yet is then harmless,
+        // which lets the index of an existing file be filled in chunks.
+        const QStringList statements{
+            "CREATE VIRTUAL TABLE IF NOT EXISTS " + PATIENTS_SEARCH_TABLE_NAME + " USING fts5( "
+            "Name, Address, tokenize = 'unicode61 remove_diacritics 2', prefix = '1 2 3' );",
+
+            "CREATE TRIGGER IF NOT EXISTS " + PATIENTS_TABLE_NAME + "_Search_Insert AFTER INSERT ON " + PATIENTS_TABLE_NAME + " "
+            "BEGIN "
+                "INSERT OR REPLACE INTO " + PATIENTS_SEARCH_TABLE_NAME + " ( rowid, Name, Address ) "
+                "VALUES ( NEW.Id, NEW.Name, NEW.Address ); "
+            "END;",
+
+            "CREATE TRIGGER IF NOT EXISTS " + PATIENTS_TABLE_NAME + "_Search_Update AFTER UPDATE OF Id, Name, Address ON " +
+            PATIENTS_TABLE_NAME + " "
+            "BEGIN "
+                "DELETE FROM " + PATIENTS_SEARCH_TABLE_NAME + " WHERE rowid = OLD.Id; "
+                "INSERT OR REPLACE INTO " + PATIENTS_SEARCH_TABLE_NAME + " ( rowid, Name, Address ) "
+                "VALUES ( NEW.Id, NEW.Name, NEW.Address ); "
+            "END;",
+
+            "CREATE TRIGGER IF NOT EXISTS " + PATIENTS_TABLE_NAME + "_Search_Delete AFTER DELETE ON " + PATIENTS_TABLE_NAME + " "
+            "BEGIN "
+                "DELETE FROM " + PATIENTS_SEARCH_TABLE_NAME + " WHERE rowid = OLD.Id; "
+            "END;" };
+
+        QSqlQuery query( m_db );
+        for( const auto& statement : statements )
+        {
+            if( !query.exec( statement ) )
+            {
+                qDebug() << "DataBase::createPatientsSearch: " + query.lastError().text();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Database::createChangeLog() noexcept
     {
-        QSqlQuery query;
-        query.prepare( "CREATE TABLE " + PHOTOS_SET_TABLE_NAME + " ("
-                       "'Id'	INTEGER NOT NULL UNIQUE,"
-                       "'Date'	TEXT NOT NULL,"
-                       "'Filename'	TEXT NOT NULL,"
-                       "'Photo'	BLOB NOT NULL,"
-                       "'Patient_Id' INTEGER NOT NULL,"
-                       "PRIMARY KEY(\"Id\" AUTOINCREMENT ), "
-                       "FOREIGN KEY(\"Patient_Id\") REFERENCES " +
-                       PATIENTS_TABLE_NAME + " (\"Id\") ON DELETE CASCADE ON UPDATE CASCADE );" );
+        // Every change of a patient or a photo set row is logged, so other processes
+        // can pull just the rows that changed. AUTOINCREMENT keeps Id growing after
+        // old entries are pruned.
+        QStringList statements{
+            "CREATE TABLE IF NOT EXISTS " + CHANGE_LOG_TABLE_NAME + " ( "
+            "Id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "TableName TEXT NOT NULL, "
+            "RowId INTEGER NOT NULL, "
+            "Operation TEXT NOT NULL );" };
+
+        for( const auto& tableName : { PATIENTS_TABLE_NAME, PHOTOS_SET_TABLE_NAME } )
+        {
+            const QList<QPair<QString, QString>> events{ { "Insert", "'I', NEW.Id" },
+                                                         { "Update", "'U', NEW.Id" },
+                                                         { "Delete", "'D', OLD.Id" } };
+            for( const auto& event : events )
+            {
+                statements.append( "CREATE TRIGGER IF NOT EXISTS " + tableName + "_Log_" + event.first + " "
+                                   "AFTER " + event.first.toUpper() + " ON " + tableName + " "
+                                   "BEGIN "
+                                       "INSERT INTO " + CHANGE_LOG_TABLE_NAME + " ( TableName, Operation, RowId ) "
+                                       "VALUES ( '" + tableName + "', " + event.second + " ); "
+                                   "END;" );
+            }
+        }
+
+        QSqlQuery query( m_db );
+        for( const auto& statement : statements )
+        {
+            if( !query.exec( statement ) )
+            {
+                qDebug() << "DataBase::createChangeLog: " + query.lastError().text();
+                return false;
+            }
+        }
+        return true;
+    }
 
-        //query.bindValue( ":tablename", PHOTOS_PACK_TABLE_NAME );
+    bool Database::createPhotoSetsTable( const QString& tableName ) noexcept
+    {
+        QSqlQuery query( m_db );
+        query.prepare( Schema::CreateStatement<Schema::PhotoSets>( tableName ) );
 
         if( !query.exec() )
         {
@@ -199,8 +391,522 @@ namespace PatientsDBManager
         }
     }
 
+    bool Database::createPhotoSetsIndexes() noexcept
+    {
+        // Serves the per-patient photo list and the cascade from Patients
+        QSqlQuery query( m_db );
+        if( !query.exec( "CREATE INDEX IF NOT EXISTS " + PHOTOS_SET_TABLE_NAME + "_Patient_Id ON " +
+                         PHOTOS_SET_TABLE_NAME + " ( Patient_Id );" ) )
+        {
+            qDebug() << "DataBase::createPhotoSetsIndexes: " + query.lastError().text();
+            return false;
+        }
+        return true;
+    }
+
+    bool Database::createPhotoContentsTable( const QString& tableName ) noexcept
+    {
+        QSqlQuery query( m_db );
+        query.prepare( Schema::CreateStatement<Schema::PhotoContents>( tableName ) );
+
+        if( !query.exec() ||
+            !query.exec( "CREATE INDEX " + PHOTO_CONTENTS_TABLE_NAME + "_Hash ON " + tableName + " ( Hash );" ) )
+        {
+            qDebug() << "DataBase::createPhotoContentsTable: " + query.lastError().text();
+            return false;
+        }
+        else
+        {
+            return true;
+        }
+    }
+
+    bool Database::createPhotoContentsTriggers() noexcept
+    {
+        // PhotoSets rows own a reference to their payload. Cascaded deletes from
+        // Patients fire these triggers as well, so a payload is freed together
+        // with its last reference.
+        const QStringList triggers{
+            "CREATE TRIGGER " + PHOTOS_SET_TABLE_NAME + "_ContentRef_Insert AFTER INSERT ON " + PHOTOS_SET_TABLE_NAME + " "
+            "BEGIN "
+                "UPDATE " + PHOTO_CONTENTS_TABLE_NAME + " SET RefCount = RefCount + 1 WHERE Id = NEW.Content_Id; "
+            "END;",
+
+            "CREATE TRIGGER " + PHOTOS_SET_TABLE_NAME + "_ContentRef_Delete AFTER DELETE ON " + PHOTOS_SET_TABLE_NAME + " "
+            "BEGIN "
+                "UPDATE " + PHOTO_CONTENTS_TABLE_NAME + " SET RefCount = RefCount - 1 WHERE Id = OLD.Content_Id; "
+                "DELETE FROM " + PHOTO_CONTENTS_TABLE_NAME + " WHERE Id = OLD.Content_Id AND RefCount <= 0; "
+            "END;",
+
+            "CREATE TRIGGER " + PHOTOS_SET_TABLE_NAME + "_ContentRef_Update AFTER UPDATE OF Content_Id ON " + PHOTOS_SET_TABLE_NAME + " "
+            "WHEN OLD.Content_Id <> NEW.Content_Id "
+            "BEGIN "
+                "UPDATE " + PHOTO_CONTENTS_TABLE_NAME + " SET RefCount = RefCount + 1 WHERE Id = NEW.Content_Id; "
+                "UPDATE " + PHOTO_CONTENTS_TABLE_NAME + " SET RefCount = RefCount - 1 WHERE Id = OLD.Content_Id; "
+                "DELETE FROM " + PHOTO_CONTENTS_TABLE_NAME + " WHERE Id = OLD.Content_Id AND RefCount <= 0; "
+            "END;" };
+
+        QSqlQuery query( m_db );
+        for( const auto& trigger : triggers )
+        {
+            if( !query.exec( trigger ) )
+            {
+                qDebug() << "DataBase::createPhotoContentsTriggers: " + query.lastError().text();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Database::createPhotoThumbnailsTable( const QString& tableName ) noexcept
+    {
+        QSqlQuery query( m_db );
+        query.prepare( Schema::CreateStatement<Schema::PhotoThumbnails>( tableName ) );
+
+        if( !query.exec() )
+        {
+            qDebug() << "DataBase::createPhotoThumbnailsTable: " + query.lastError().text();
+            return false;
+        }
+        else
+        {
+            return true;
+        }
+    }
+
+    bool Database::migrate() noexcept
+    {
+        {
+            SchemaMigrator migrator( m_db );
+            addMigrations( migrator );
+            if( migrator.version() == migrator.latestVersion() )
+                return true;
+        }
+
+        // A migration may copy every photo of the file, so it runs on a thread of its
+        // own while the caller keeps processing events
+        bool migrated = false;
+        auto thread = QThread::create( [this, &migrated]
+        {
+            Database migration( ConnectionManager::writer( m_fileName ), m_fileName );
+            migrated = migration.isConnected() && migration.applyMigrations();
+        } );
+
+        QEventLoop loop;
+        QObject::connect( thread, &QThread::finished, &loop, &QEventLoop::quit );
+        thread->start();
+        loop.exec( QEventLoop::ExcludeUserInputEvents );
+        thread->wait();
+        delete thread;
+
+        return migrated;
+    }
+
+    bool Database::applyMigrations() noexcept
+    {
+        SchemaMigrator migrator( m_db );
+        addMigrations( migrator );
+        return migrator.migrate();
+    }
+
+    void Database::addMigrations( SchemaMigrator& migrator ) noexcept
+    {
+        // Files created before the schema was versioned are at version 0 in any of
+        // the older layouts, so the first migrations look at the actual tables.
+        migrator.addMigration( 1, "content-addressed photo storage", [this, &migrator]
+        {
+            return migratePhotoStorage( migrator );
+        } );
+        migrator.addMigration( 2, "integer dates", [this, &migrator]
+        {
+            return migrateDates( migrator );
+        } );
+        migrator.addMigration( 3, "photo sets index by patient", [this]
+        {
+            return createPhotoSetsIndexes();
+        } );
+        migrator.addMigration( 4, "patients full-text search", [this, &migrator]
+        {
+            return migratePatientsSearch( migrator );
+        } );
+        migrator.addMigration( 5, "change log", [this, &migrator]
+        {
+            return migrator.changeSchema( "Database::createChangeLog", [this]( QSqlQuery& )
+            {
+                return createChangeLog();
+            } );
+        } );
+        migrator.addMigration( 6, "patients sort indexes", [this]
+        {
+            return createPatientsIndexes();
+        } );
+    }
+
+    bool Database::migratePhotoStorage( SchemaMigrator& migrator ) noexcept
+    {
+        const auto& tables = m_db.tables();
+        const auto& photoSetsRecord = m_db.record( PHOTOS_SET_TABLE_NAME );
+
+        if( photoSetsRecord.contains( "Content_Id" ) )
+            return true;
+
+        // Two older layouts exist: the BLOB inline in PhotoSets, or a PhotoContents
+        // table keyed by photo id. Either way every payload is hashed, stored once in
+        // the content-addressed table and PhotoSets is rebuilt to reference it.
+        const bool inlinePhotos = photoSetsRecord.contains( "Photo" );
+        if( !inlinePhotos && !tables.contains( PHOTO_CONTENTS_TABLE_NAME ) )
+        {
+            qDebug() << "Database::migratePhotoStorage: the photo contents are missing";
+            return false;
+        }
+
+        const auto& sourceTable = inlinePhotos ? PHOTOS_SET_TABLE_NAME : PHOTO_CONTENTS_TABLE_NAME;
+        const bool hasThumbnails = tables.contains( PHOTO_THUMBNAILS_TABLE_NAME );
+
+        const QString newPhotoSets = PHOTOS_SET_TABLE_NAME + "_new";
+        const QString newContents = PHOTO_CONTENTS_TABLE_NAME + "_new";
+        const QString newThumbnails = PHOTO_THUMBNAILS_TABLE_NAME + "_new";
+        const QString pendingPhotos = PHOTOS_SET_TABLE_NAME + "_pending";
+
+        // Writes of other connections to the old tables can not be mirrored by triggers
+        // alone, a new payload has to be hashed first. The triggers note the photo ids
+        // instead and their copies are made again before every chunk and the swap.
+        QVector<QPair<QString, QString>> sources{ { PHOTOS_SET_TABLE_NAME, "Id" } };
+        if( !inlinePhotos )
+            sources.append( qMakePair( PHOTO_CONTENTS_TABLE_NAME, QString( "rowid" ) ) );
+        if( hasThumbnails )
+            sources.append( qMakePair( PHOTO_THUMBNAILS_TABLE_NAME, QString( "Photo_Id" ) ) );
+
+        QStringList mirrorStatements{ "CREATE TABLE IF NOT EXISTS " + pendingPhotos + " ( Id INTEGER PRIMARY KEY );" };
+        for( const auto& source : sources )
+        {
+            const auto note = [&]( const QString& row )
+            {
+                return "INSERT OR IGNORE INTO " + pendingPhotos + " ( Id ) VALUES ( " + row + "." + source.second + " ); ";
+            };
+            const QList<QPair<QString, QString>> events{ { "Insert", note( "NEW" ) },
+                                                         { "Update", note( "OLD" ) + note( "NEW" ) },
+                                                         { "Delete", note( "OLD" ) } };
+            for( const auto& event : events )
+            {
+                mirrorStatements.append( "CREATE TRIGGER IF NOT EXISTS " + source.first + "_Migration_" + event.first + " "
+                                         "AFTER " + event.first.toUpper() + " ON " + source.first + " "
+                                         "BEGIN " + event.second + "END;" );
+            }
+        }
+
+        // The new tables are kept when the migration is interrupted and filled further on resume
+        const bool prepared = migrator.changeSchema( "Database::migratePhotoStorage", [&]( QSqlQuery& query )
+        {
+            if( !( tables.contains( newContents ) || createPhotoContentsTable( newContents ) ) ||
+                !( tables.contains( newPhotoSets ) || createPhotoSetsTable( newPhotoSets ) ) ||
+                !( tables.contains( newThumbnails ) || createPhotoThumbnailsTable( newThumbnails ) ) )
+                return false;
+
+            for( const auto& statement : mirrorStatements )
+            {
+                if( !query.exec( statement ) )
+                    return false;
+            }
+            return true;
+        } );
+        if( !prepared )
+            return false;
+
+        // The new tables reference each other by their final names,
+        // so foreign keys stay off until the swap
+        if( !migrator.setForeignKeys( false ) )
+            return false;
+
+        QSqlQuery selectPhotos( m_db );
+        QSqlQuery selectPending( m_db );
+        QSqlQuery clearPending( m_db );
+        QSqlQuery findCopy( m_db );
+        QSqlQuery releaseContent( m_db );
+        QSqlQuery dropContent( m_db );
+        QSqlQuery dropThumbnail( m_db );
+        QSqlQuery dropCopy( m_db );
+        QSqlQuery findContent( m_db );
+        QSqlQuery copyContent( m_db );
+        QSqlQuery addReference( m_db );
+        QSqlQuery copyPhoto( m_db );
+        QSqlQuery copyThumbnail( m_db );
+        selectPhotos.setForwardOnly( true );
+        selectPending.setForwardOnly( true );
+        findCopy.setForwardOnly( true );
+        findContent.setForwardOnly( true );
+
+        // A pending photo is copied again only when both its row and its payload still exist
+        QVector<QPair<QSqlQuery*, QString>> statements{
+            { &selectPhotos, "SELECT Id FROM " + PHOTOS_SET_TABLE_NAME + " WHERE Id > ? ORDER BY Id LIMIT ?;" },
+            { &selectPending, "SELECT p.Id, EXISTS( SELECT 1 FROM " + PHOTOS_SET_TABLE_NAME + " WHERE Id = p.Id ) AND "
+                              "EXISTS( SELECT 1 FROM " + sourceTable + " WHERE rowid = p.Id ) FROM " + pendingPhotos + " p;" },
+            { &clearPending, "DELETE FROM " + pendingPhotos + ";" },
+            { &findCopy, "SELECT Content_Id FROM " + newPhotoSets + " WHERE Id = ?;" },
+            { &releaseContent, "UPDATE " + newContents + " SET RefCount = RefCount - 1 WHERE Id = ?;" },
+            { &dropContent, "DELETE FROM " + newContents + " WHERE Id = ? AND RefCount <= 0;" },
+            { &dropThumbnail, "DELETE FROM " + newThumbnails + " WHERE Content_Id = ?;" },
+            { &dropCopy, "DELETE FROM " + newPhotoSets + " WHERE Id = ?;" },
+            { &findContent, "SELECT Id FROM " + newContents + " WHERE Sha256 = ?;" },
+            { &copyContent, "INSERT INTO " + newContents + " ( Hash, Sha256, RefCount, Photo ) "
+                            "SELECT ?, ?, 1, Photo FROM " + sourceTable + " WHERE rowid = ?;" },
+            { &addReference, "UPDATE " + newContents + " SET RefCount = RefCount + 1 WHERE Id = ?;" },
+            { &copyPhoto, "INSERT INTO " + newPhotoSets + " ( Id, Date, Filename, Patient_Id, Content_Id ) "
+                          "SELECT Id, COALESCE( " + unixTimeFromText( "Date" ) + ", strftime( '%s', 'now' ) ), "
+                          "Filename, Patient_Id, ? FROM " + PHOTOS_SET_TABLE_NAME + " WHERE Id = ?;" } };
+        if( hasThumbnails )
+        {
+            statements.append( qMakePair( &copyThumbnail, "INSERT OR IGNORE INTO " + newThumbnails + " ( Content_Id, Thumbnail ) "
+                                                          "SELECT ?, Thumbnail FROM " + PHOTO_THUMBNAILS_TABLE_NAME + " WHERE Photo_Id = ?;" ) );
+        }
+
+        for( const auto& statement : statements )
+        {
+            if( !statement.first->prepare( statement.second ) )
+            {
+                qDebug() << "Database::migratePhotoStorage: " + statement.first->lastError().text();
+                migrator.setForeignKeys( true );
+                return false;
+            }
+        }
+
+        // Removes the copy made before, together with the payload it referenced last
+        const auto dropPhotoCopy = [&]( qlonglong photoId )
+        {
+            QVariant contentId;
+            findCopy.bindValue( 0, photoId );
+            if( !findCopy.exec() )
+                return false;
+            if( findCopy.next() )
+                contentId = findCopy.value( 0 );
+            findCopy.finish();
+
+            if( !contentId.isValid() )
+                return true;
+
+            releaseContent.bindValue( 0, contentId );
+            dropContent.bindValue( 0, contentId );
+            dropCopy.bindValue( 0, photoId );
+            if( !releaseContent.exec() || !dropContent.exec() )
+                return false;
+
+            if( dropContent.numRowsAffected() > 0 )
+            {
+                dropThumbnail.bindValue( 0, contentId );
+                if( !dropThumbnail.exec() )
+                    return false;
+            }
+            return dropCopy.exec();
+        };
+
+        const auto copyPhotoRow = [&]( qlonglong photoId )
+        {
+            std::optional<quint64> key;
+            QByteArray sha256;
+            {
+                BlobDevice photo( getHandle(), sourceTable, "Photo", photoId );
+                if( !photo.open( QIODevice::ReadOnly ) )
+                    return false;
+                key = Utility::SampleKey( photo );
+                sha256 = Utility::Sha256( photo );
+            }
+            if( !key || sha256.isEmpty() )
+                return false;
+
+            QVariant contentId;
+            findContent.bindValue( 0, sha256 );
+            if( !findContent.exec() )
+                return false;
+            if( findContent.next() )
+                contentId = findContent.value( 0 );
+            findContent.finish();
+
+            if( contentId.isValid() )
+            {
+                addReference.bindValue( 0, contentId );
+                if( !addReference.exec() )
+                    return false;
+            }
+            else
+            {
+                copyContent.bindValue( 0, static_cast<qlonglong>( *key ) );
+                copyContent.bindValue( 1, sha256 );
+                copyContent.bindValue( 2, photoId );
+                if( !copyContent.exec() )
+                    return false;
+                contentId = copyContent.lastInsertId();
+            }
+
+            copyPhoto.bindValue( 0, contentId );
+            copyPhoto.bindValue( 1, photoId );
+            if( !copyPhoto.exec() )
+                return false;
+
+            if( hasThumbnails )
+            {
+                copyThumbnail.bindValue( 0, contentId );
+                copyThumbnail.bindValue( 1, photoId );
+                if( !copyThumbnail.exec() )
+                    return false;
+            }
+            return true;
+        };
+
+        const auto copyPendingPhotos = [&]
+        {
+            QVector<QPair<qlonglong, bool>> pendingIds;
+            if( !selectPending.exec() )
+                return false;
+            while( selectPending.next() )
+                pendingIds.append( qMakePair( selectPending.value( 0 ).toLongLong(), selectPending.value( 1 ).toBool() ) );
+            selectPending.finish();
+
+            for( const auto& pending : pendingIds )
+            {
+                if( !dropPhotoCopy( pending.first ) || ( pending.second && !copyPhotoRow( pending.first ) ) )
+                    return false;
+            }
+            return pendingIds.isEmpty() || clearPending.exec();
+        };
+
+        const bool copied = migrator.runInChunks( "photo storage", [&]( qint64& lastRowId, int chunkSize, int& processedRows )
+        {
+            if( !copyPendingPhotos() )
+                return false;
+
+            QVector<qlonglong> photoIds;
+            selectPhotos.bindValue( 0, lastRowId );
+            selectPhotos.bindValue( 1, chunkSize );
+            if( !selectPhotos.exec() )
+                return false;
+            while( selectPhotos.next() )
+                photoIds.append( selectPhotos.value( 0 ).toLongLong() );
+            selectPhotos.finish();
+
+            // a pending photo past the cursor may have been copied already
+            for( const auto photoId : photoIds )
+            {
+                if( !dropPhotoCopy( photoId ) || !copyPhotoRow( photoId ) )
+                    return false;
+            }
+
+            processedRows = photoIds.size();
+            if( !photoIds.isEmpty() )
+                lastRowId = photoIds.last();
+            return true;
+        } );
+        if( !copied )
+        {
+            migrator.setForeignKeys( true );
+            return false;
+        }
+
+        // The swap holds the write lock, so no write can slip in after the last pending copies
+        return migrator.changeSchema( "Database::migratePhotoStorage", [&]( QSqlQuery& query )
+        {
+            // another connection may have completed the migration meanwhile
+            if( !m_db.tables().contains( newPhotoSets ) )
+                return true;
+
+            if( !copyPendingPhotos() || !query.exec( "DROP TABLE " + pendingPhotos + ";" ) )
+                return false;
+
+            if( hasThumbnails && !query.exec( "DROP TABLE " + PHOTO_THUMBNAILS_TABLE_NAME + ";" ) )
+                return false;
+
+            if( !inlinePhotos && !query.exec( "DROP TABLE " + PHOTO_CONTENTS_TABLE_NAME + ";" ) )
+                return false;
+
+            return query.exec( "DROP TABLE " + PHOTOS_SET_TABLE_NAME + ";" ) &&
+                   query.exec( "ALTER TABLE " + newContents + " RENAME TO " + PHOTO_CONTENTS_TABLE_NAME + ";" ) &&
+                   query.exec( "ALTER TABLE " + newPhotoSets + " RENAME TO " + PHOTOS_SET_TABLE_NAME + ";" ) &&
+                   query.exec( "ALTER TABLE " + newThumbnails + " RENAME TO " + PHOTO_THUMBNAILS_TABLE_NAME + ";" ) &&
+                   createPhotoContentsTriggers() &&
+                   createPhotoSetsIndexes();
+        } );
+    }
+
+    bool Database::migrateDates( SchemaMigrator& migrator ) noexcept
+    {
+        // Column affinity would turn integers back into text, so the tables are rewritten
+        if( migrator.columnType( PATIENTS_TABLE_NAME, "AdmissionDate" ) != "INTEGER" )
+        {
+            const SchemaMigrator::TableRewrite patients{
+                PATIENTS_TABLE_NAME,
+                "Id",
+                "Id, Name, Address, BirthDate, AdmissionDate, DiscargeDate",
+                "Id, Name, Address, " + julianDayFromText( "BirthDate" ) + ", "
+                "COALESCE( " + julianDayFromText( "AdmissionDate" ) + ", CAST( julianday( 'now', 'localtime' ) + 0.5 AS INTEGER ) ), " +
+                julianDayFromText( "DiscargeDate" ),
+                [this]( const QString& tableName ){ return createPatientsTable( tableName ); },
+                [this]{ return createPatientsIndexes() && createPatientsSearch(); } };
+
+            if( !migrator.rewriteTable( patients ) )
+                return false;
+        }
+
+        if( migrator.columnType( PHOTOS_SET_TABLE_NAME, "Date" ) != "INTEGER" )
+        {
+            const SchemaMigrator::TableRewrite photoSets{
+                PHOTOS_SET_TABLE_NAME,
+                "Id",
+                "Id, Date, Filename, Patient_Id, Content_Id",
+                "Id, COALESCE( " + unixTimeFromText( "Date" ) + ", strftime( '%s', 'now' ) ), Filename, Patient_Id, Content_Id",
+                [this]( const QString& tableName ){ return createPhotoSetsTable( tableName ); },
+                [this]{ return createPhotoContentsTriggers() && createPhotoSetsIndexes(); } };
+
+            if( !migrator.rewriteTable( photoSets ) )
+                return false;
+        }
+
+        return true;
+    }
+
+    bool Database::migratePatientsSearch( SchemaMigrator& migrator ) noexcept
+    {
+        // The triggers index new changes right away, the existing rows are added in chunks
+        const bool created = migrator.changeSchema( "Database::migratePatientsSearch", [this]( QSqlQuery& )
+        {
+            return createPatientsSearch();
+        } );
+
+        return created &&
+               migrator.copyInChunks( "patients search", PATIENTS_TABLE_NAME, "Id",
+                                      "INSERT OR REPLACE INTO " + PATIENTS_SEARCH_TABLE_NAME + " ( rowid, Name, Address ) "
+                                      "SELECT Id, Name, Address FROM " + PATIENTS_TABLE_NAME + " WHERE Id > ? AND Id <= ?;" );
+    }
+
     void Database::close() noexcept
     {
+        // a borrowed connection is closed by its owner
+        if( !m_ownsConnection )
+            return;
+
+        if( m_editBuffer && m_db.isOpen() )
+            m_editBuffer->flush();
+
+        if( m_checkpointTimer )
+            m_checkpointTimer->stop();
+
+        if( m_db.isOpen() )
+        {
+            const auto& options = getConnectionOptions();
+            if( options.walMode && options.truncateOnClose )
+                SqliteConnection::checkpoint( m_db, SqliteConnection::ECheckpointMode::TRUNCATE );
+
+            const auto statistics = SqliteConnection::totalLockStatistics();
+            if( statistics.busyEvents > 0 )
+            {
+                qDebug() << QString( "Database::close: %1 statements found the database locked, %2 retries, "
+                                     "%3 ms waited, %4 timeouts" )
+                            .arg( statistics.busyEvents )
+                            .arg( statistics.retries )
+                            .arg( statistics.waitMs )
+                            .arg( statistics.timeouts );
+            }
+        }
+
+        StatementCache::release( m_db.connectionName() );
         if( m_db.isOpen() )
             m_db.close();
     }
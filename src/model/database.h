@@ -1,20 +1,37 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <QByteArray>
 #include <QDate>
+#include <QDateTime>
 #include <QDebug>
 #include <QFile>
 #include <QSql>
 #include <QSqlDatabase>
 #include <QSqlError>
-#include <QSqlTableModel>
 #include <QSqlQuery>
 #include <QObject>
+#include <QTimer>
+
+#include "model/blob_device.h"
+#include "model/edit_buffer.h"
+#include "model/patients_model.h"
+#include "model/photo_set_model.h"
+#include "model/sqlite_connection.h"
+#include "model/table_schema.h"
+
+struct sqlite3;
 
 namespace PatientsDBManager
 {
-    static const QString PATIENTS_TABLE_NAME = "Patients";
-    static const QString PHOTOS_SET_TABLE_NAME = "PhotoSets";
+    class SchemaMigrator;
+
+    static const QString PATIENTS_TABLE_NAME = Schema::TableName<Schema::Patients>();
+    static const QString PHOTOS_SET_TABLE_NAME = Schema::TableName<Schema::PhotoSets>();
+    static const QString PHOTO_CONTENTS_TABLE_NAME = Schema::TableName<Schema::PhotoContents>();
+    static const QString PHOTO_THUMBNAILS_TABLE_NAME = Schema::TableName<Schema::PhotoThumbnails>();
+    static const QString PATIENTS_SEARCH_TABLE_NAME = "PatientsSearch";
+    static const QString CHANGE_LOG_TABLE_NAME = "ChangeLog";
 
     class Database : public QObject
     {
@@ -28,22 +45,58 @@ namespace PatientsDBManager
         EConnectionResult connect() noexcept;
         bool isConnected() const noexcept { return m_db.isOpen(); }
 
-        QSqlTableModel* createPatientsModel( QObject* parent = nullptr ) const noexcept;
-        QSqlTableModel* createPhotoSetModel( QObject* parent = nullptr ) const noexcept;
+        PatientsModel* createPatientsModel( QObject* parent = nullptr ) const noexcept;
+        PhotoSetModel*  createPhotoSetModel( QObject* parent = nullptr ) const noexcept;
+
+        // Edits of both models are written through it, flushed before the connection closes
+        EditBuffer* getEditBuffer() const noexcept { return m_editBuffer; }
+
+        BlobDevice* openPhoto( int64_t contentId, QObject* parent = nullptr ) const noexcept;
 
         QSqlDatabase& getConnection() noexcept { return m_db; }
         const QSqlDatabase& getConnection() const noexcept { return m_db; }
 
+        sqlite3* getHandle() const noexcept { return getHandle( m_db ); }
+        static sqlite3* getHandle( const QSqlDatabase& db ) noexcept;
+
+        const QString& getFileName() const noexcept { return m_fileName; }
+
+        static QSqlDatabase openConnection( const QString& fileName, const QString& connectionName ) noexcept;
+
+        // Every connection opened afterwards is configured with the options
+        static void setConnectionOptions( const ConnectionOptions& options ) noexcept;
+        static const ConnectionOptions& getConnectionOptions() noexcept;
+
         static QString getConnectionResult( EConnectionResult result ) noexcept;
 
     private:
         QSqlDatabase m_db;
         QString      m_fileName;
+        EditBuffer*  m_editBuffer{ nullptr };
+        QTimer*      m_checkpointTimer{ nullptr };
+        bool         m_ownsConnection{ true };
+
+        // Runs the migrations over a connection of another thread, which stays open afterwards
+        Database( const QSqlDatabase& db, const QString& fileName ) noexcept;
 
         bool open( const QString &databaseName ) noexcept;
         bool restore( const QString& databaseName ) noexcept;
-        bool createPatientsTable() noexcept;
-        bool createPhotoSetsTable() noexcept;
+        bool createPatientsTable( const QString& tableName = PATIENTS_TABLE_NAME ) noexcept;
+        bool createPatientsIndexes() noexcept;
+        bool createPatientsSearch() noexcept;
+        bool createPhotoSetsTable( const QString& tableName = PHOTOS_SET_TABLE_NAME ) noexcept;
+        bool createPhotoContentsTable( const QString& tableName = PHOTO_CONTENTS_TABLE_NAME ) noexcept;
+        bool createPhotoContentsTriggers() noexcept;
+        bool createPhotoThumbnailsTable( const QString& tableName = PHOTO_THUMBNAILS_TABLE_NAME ) noexcept;
+        bool createPhotoSetsIndexes() noexcept;
+        bool createChangeLog() noexcept;
+
+        bool migrate() noexcept;
+        bool applyMigrations() noexcept;
+        void addMigrations( SchemaMigrator& migrator ) noexcept;
+        bool migratePhotoStorage( SchemaMigrator& migrator ) noexcept;
+        bool migrateDates( SchemaMigrator& migrator ) noexcept;
+        bool migratePatientsSearch( SchemaMigrator& migrator ) noexcept;
         void close() noexcept;
 
     };
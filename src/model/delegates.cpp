@@ -3,10 +3,12 @@
 #include <QDateEdit>
 #include <QDebug>
 #include <QLineEdit>
+#include <QPainter>
 #include <QRegExpValidator>
 #include <QToolTip>
 
 #include "utility/global.h"
+#include "utility/utility.h"
 #include "view/date_edit_ex.h"
 
 namespace PatientsDBManager
@@ -142,6 +144,19 @@ namespace PatientsDBManager
         m_nullable = enable;
     }
 
+    void DateItemDelegate::paint( QPainter* painter,
+                                  const QStyleOptionViewItem& option,
+                                  const QModelIndex& index ) const
+    {
+        const auto& date = Utility::DateFromDbValue( index.data( Qt::EditRole ) );
+
+        const auto& itemOption = setOptions( index, option );
+        drawBackground( painter, itemOption, index );
+        drawDisplay( painter, itemOption, itemOption.rect,
+                     date.isValid() ? date.toString( Global::DATE_FORMAT ) : Global::EMPTY_CELL_DEFAULT_VALUE );
+        drawFocus( painter, itemOption, itemOption.rect );
+    }
+
     QWidget* DateItemDelegate::createEditor( QWidget* parent,
                                              const QStyleOptionViewItem& /*option*/,
                                              const QModelIndex& index ) const
@@ -153,9 +168,7 @@ namespace PatientsDBManager
         editor->setMinimumDate( QDate( 100, 1, 1 ) );
         editor->reset();
 
-        const auto& stringDate = index.model()->data( index, Qt::EditRole ).toString();
-
-        auto date = QDate::fromString( stringDate, Global::DATE_FORMAT );
+        const auto& date = Utility::DateFromDbValue( index.model()->data( index, Qt::EditRole ) );
         if( m_isCurrentDateAsMinimal )
             editor->setMinimumDate( date );
         else
@@ -166,9 +179,8 @@ namespace PatientsDBManager
 
     void DateItemDelegate::setEditorData( QWidget* editor, const QModelIndex& index ) const
     {
-        QString value = index.model()->data( index, Qt::EditRole ).toString();
+        const auto& date = Utility::DateFromDbValue( index.model()->data( index, Qt::EditRole ) );
         auto dateEditor = static_cast<DateEditEx*>( editor );
-        const auto& date = QDate::fromString( value, Global::DATE_FORMAT );
         dateEditor->setDate( date.isValid() ? date : QDate::currentDate() );
     }
 
@@ -177,23 +189,18 @@ namespace PatientsDBManager
                                          const QModelIndex& index ) const
     {
         auto dateEditor = static_cast<DateEditEx*>( editor );
-        const auto& currentDate = dateEditor->date();
+        const auto& currentDate = dateEditor->isEmpty() ? QDate() : dateEditor->date();
 
-        model->setData( index, dateEditor->isEmpty() ?
-                                   Global::EMPTY_CELL_DEFAULT_VALUE :
-                                   currentDate.toString( Global::DATE_FORMAT ) );
+        model->setData( index, Utility::DateToDbValue( currentDate ) );
 
         auto modifyCell = [&]( const QModelIndex& index )
         {
             if( index.isValid() )
             {
-                const auto& stringDate = index.model()->data( index, Qt::EditRole ).toString();
-                const auto& siblingDate = QDate::fromString( stringDate, Global::DATE_FORMAT );
+                const auto& siblingDate = Utility::DateFromDbValue( index.model()->data( index, Qt::EditRole ) );
 
                 if( currentDate > siblingDate && siblingDate.isValid() )
-                    model->setData( index, currentDate.toString( Global::DATE_FORMAT ) );
-                else if( stringDate.isEmpty() )
-                    model->setData( index, Global::EMPTY_CELL_DEFAULT_VALUE );
+                    model->setData( index, Utility::DateToDbValue( currentDate ) );
             }
         };
 
@@ -229,6 +236,19 @@ namespace PatientsDBManager
         : QItemDelegate( parent )
     {}
 
+    void DateTimeItemDelegate::paint( QPainter* painter,
+                                      const QStyleOptionViewItem& option,
+                                      const QModelIndex& index ) const
+    {
+        const auto& dateTime = Utility::DateTimeFromDbValue( index.data( Qt::EditRole ) );
+
+        const auto& itemOption = setOptions( index, option );
+        drawBackground( painter, itemOption, index );
+        drawDisplay( painter, itemOption, itemOption.rect,
+                     dateTime.isValid() ? dateTime.toString( Global::DATE_TIME_FORMAT ) : Global::EMPTY_CELL_DEFAULT_VALUE );
+        drawFocus( painter, itemOption, itemOption.rect );
+    }
+
     QWidget* DateTimeItemDelegate::createEditor( QWidget* parent,
                                                  const QStyleOptionViewItem& /*option*/,
                                                  const QModelIndex& /*index*/ ) const
@@ -240,8 +260,7 @@ namespace PatientsDBManager
 
     void DateTimeItemDelegate::setEditorData( QWidget* editor, const QModelIndex& index ) const
     {
-        auto dateTime = QDateTime::fromString( index.model()->data( index, Qt::EditRole ).toString(),
-                                               Global::DATE_TIME_FORMAT );
+        const auto& dateTime = Utility::DateTimeFromDbValue( index.model()->data( index, Qt::EditRole ) );
         auto dateTimeEditor = static_cast<QDateTimeEdit*>( editor );
         dateTimeEditor->setDateTime( dateTime.isValid() ? dateTime
                                                         : QDateTime::currentDateTime() );
@@ -255,7 +274,7 @@ namespace PatientsDBManager
         auto dateTime = dateEditor->dateTime();
         if( !dateTime.isValid() )
             dateTime = QDateTime::currentDateTime();
-        model->setData( index, dateTime.toString( Global::DATE_TIME_FORMAT ) );
+        model->setData( index, Utility::DateTimeToDbValue( dateTime ) );
     }
 
     void DateTimeItemDelegate::updateEditorGeometry( QWidget* editor,
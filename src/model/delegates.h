@@ -77,6 +77,10 @@ namespace PatientsDBManager
         void setNullable( bool enable ) noexcept;
 
     protected:
+        // The model holds the stored integer value, it is formatted only for display
+        void paint( QPainter* painter,
+                    const QStyleOptionViewItem& option,
+                    const QModelIndex& index ) const override;
         QWidget* createEditor( QWidget* parent,
                                const QStyleOptionViewItem& option,
                                const QModelIndex& index ) const override;
@@ -107,6 +111,10 @@ namespace PatientsDBManager
         explicit DateTimeItemDelegate( QObject* parent = nullptr );
 
     protected:
+        // The model holds the stored integer value, it is formatted only for display
+        void paint( QPainter* painter,
+                    const QStyleOptionViewItem& option,
+                    const QModelIndex& index ) const override;
         QWidget* createEditor( QWidget* parent,
                                const QStyleOptionViewItem& option,
                                const QModelIndex& index ) const override;
@@ -0,0 +1,96 @@
+#include "edit_buffer.h"
+
+#include <tuple>
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QSqlQuery>
+
+#include "model/connection_manager.h"
+#include "model/statement_cache.h"
+
+namespace PatientsDBManager
+{
+    bool EditBuffer::CellKey::operator<( const CellKey& other ) const noexcept
+    {
+        return std::tie( table, id, column ) < std::tie( other.table, other.id, other.column );
+    }
+
+    EditBuffer::EditBuffer( const QSqlDatabase& db, QObject* parent ) noexcept
+        : QObject( parent )
+        , m_db( db )
+    {
+        // the window is not extended by later edits, so steady typing still gets written
+        m_flushTimer.setSingleShot( true );
+        m_flushTimer.setInterval( FLUSH_DELAY_MS );
+        connect( &m_flushTimer, &QTimer::timeout, this, &EditBuffer::flush );
+    }
+
+    EditBuffer::~EditBuffer()
+    {
+        flush();
+    }
+
+    void EditBuffer::stage( const QString& table, qint64 id, int column, const QString& columnName,
+                            const QVariant& value ) noexcept
+    {
+        m_edits.insert( CellKey{ table, id, column }, Edit{ columnName, value } );
+        if( !m_flushTimer.isActive() )
+            m_flushTimer.start();
+    }
+
+    std::optional<QVariant> EditBuffer::pendingValue( const QString& table, qint64 id, int column ) const noexcept
+    {
+        const auto edit = m_edits.constFind( CellKey{ table, id, column } );
+        if( edit == m_edits.constEnd() )
+            return std::nullopt;
+        return edit->value;
+    }
+
+    bool EditBuffer::flush() noexcept
+    {
+        m_flushTimer.stop();
+        if( m_edits.isEmpty() )
+            return true;
+
+        // A failed transaction is not retried: the same edit would fail again
+        const auto edits = m_edits;
+        m_edits.clear();
+
+        // released before the signals, their slots may show a dialog
+        QMutexLocker writeLocker( ConnectionManager::writeMutex( m_db.databaseName() ) );
+
+        auto fail = [this, &writeLocker]( const QSqlError& error )
+        {
+            qDebug() << "EditBuffer::flush: " + error.text();
+            m_db.rollback();
+            writeLocker.unlock();
+            emit flushFailed( error );
+            return false;
+        };
+
+        if( !m_db.transaction() )
+            return fail( m_db.lastError() );
+
+        for( auto edit = edits.constBegin(); edit != edits.constEnd(); ++edit )
+        {
+            QSqlError error;
+            auto query = StatementCache::statement( m_db, "UPDATE " + edit.key().table + " SET " + edit->columnName +
+                                                          " = ? WHERE Id = ?;", error );
+            if( !query )
+                return fail( error );
+
+            query->bindValue( 0, edit->value );
+            query->bindValue( 1, edit.key().id );
+            if( !query->exec() )
+                return fail( query->lastError() );
+        }
+
+        if( !m_db.commit() )
+            return fail( m_db.lastError() );
+        writeLocker.unlock();
+
+        emit flushed();
+        return true;
+    }
+}
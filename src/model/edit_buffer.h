@@ -0,0 +1,83 @@
+#ifndef EDITBUFFER_H
+#define EDITBUFFER_H
+
+#include <optional>
+
+#include <QMap>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QString>
+#include <QTimer>
+#include <QVariant>
+
+#include "model/table_schema.h"
+
+namespace PatientsDBManager
+{
+    // Write-behind buffer of cell edits. Edits are kept for FLUSH_DELAY_MS after
+    // the first one, a later edit of the same cell replaces the earlier value, and
+    // all of them are then written in one transaction. Models show staged values
+    // over the rows they read, see pendingValue().
+    //
+    // flush() writes the edits at once; it is called when the edited row loses
+    // the focus and before the connection is closed.
+    class EditBuffer : public QObject
+    {
+        Q_OBJECT
+    public:
+        static constexpr int FLUSH_DELAY_MS = 250;
+
+        explicit EditBuffer( const QSqlDatabase& db, QObject* parent = nullptr ) noexcept;
+        ~EditBuffer() override;
+
+        template<typename Table>
+        void stage( qint64 id, int column, const QVariant& value ) noexcept
+        {
+            stage( Schema::TableName<Table>(), id, column, Schema::ColumnName<Table>( column ), value );
+        }
+
+        template<typename Table>
+        std::optional<QVariant> pendingValue( qint64 id, int column ) const noexcept
+        {
+            return pendingValue( Schema::TableName<Table>(), id, column );
+        }
+
+        bool isEmpty() const noexcept { return m_edits.isEmpty(); }
+
+    public slots:
+        // Returns false when the transaction failed, the edits are dropped then
+        bool flush() noexcept;
+
+    signals:
+        void flushed();
+        // The rows of the failed edits have to be read again
+        void flushFailed( const QSqlError& error );
+
+    private:
+        struct CellKey
+        {
+            QString table;
+            qint64  id{ 0 };
+            int     column{ 0 };
+
+            bool operator<( const CellKey& other ) const noexcept;
+        };
+
+        struct Edit
+        {
+            QString  columnName;
+            QVariant value;
+        };
+
+        QSqlDatabase        m_db;
+        QTimer              m_flushTimer;
+        QMap<CellKey, Edit> m_edits;
+
+        void stage( const QString& table, qint64 id, int column, const QString& columnName,
+                    const QVariant& value ) noexcept;
+        std::optional<QVariant> pendingValue( const QString& table, qint64 id, int column ) const noexcept;
+    };
+}
+
+#endif // EDITBUFFER_H
@@ -6,6 +6,34 @@ namespace PatientsDBManager
         : QAbstractProxyModel( parent )
     {}
 
+    void HorizontalProxyModel::setSourceModel( QAbstractItemModel* newSourceModel )
+    {
+        if( sourceModel() )
+            disconnect( sourceModel(), nullptr, this, nullptr );
+
+        beginResetModel();
+        QAbstractProxyModel::setSourceModel( newSourceModel );
+        endResetModel();
+
+        if( !newSourceModel )
+            return;
+
+        // rows of the source are columns here, so any change of their number resets the proxy
+        connect( newSourceModel, &QAbstractItemModel::modelAboutToBeReset, this, &HorizontalProxyModel::beginResetModel );
+        connect( newSourceModel, &QAbstractItemModel::modelReset, this, &HorizontalProxyModel::endResetModel );
+        connect( newSourceModel, &QAbstractItemModel::rowsAboutToBeInserted, this, &HorizontalProxyModel::beginResetModel );
+        connect( newSourceModel, &QAbstractItemModel::rowsInserted, this, &HorizontalProxyModel::endResetModel );
+        connect( newSourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, &HorizontalProxyModel::beginResetModel );
+        connect( newSourceModel, &QAbstractItemModel::rowsRemoved, this, &HorizontalProxyModel::endResetModel );
+        connect( newSourceModel, &QAbstractItemModel::layoutAboutToBeChanged, this, [this]{ emit layoutAboutToBeChanged(); } );
+        connect( newSourceModel, &QAbstractItemModel::layoutChanged, this, [this]{ emit layoutChanged(); } );
+        connect( newSourceModel, &QAbstractItemModel::dataChanged, this,
+                 [this]( const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles )
+        {
+            emit dataChanged( mapFromSource( topLeft ), mapFromSource( bottomRight ), roles );
+        } );
+    }
+
     QModelIndex HorizontalProxyModel::mapToSource( const QModelIndex& proxyIndex ) const
     {
         return sourceModel() ? sourceModel()->index( proxyIndex.column(), proxyIndex.row() )
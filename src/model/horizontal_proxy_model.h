@@ -11,6 +11,8 @@ namespace PatientsDBManager
     public:
         HorizontalProxyModel( QObject* parent = nullptr );
 
+        void setSourceModel( QAbstractItemModel* sourceModel ) override;
+
         QModelIndex mapToSource( const QModelIndex& proxyIndex ) const override;
         QModelIndex mapFromSource( const QModelIndex& sourceIndex ) const override;
         QModelIndex index( int row, int column, const QModelIndex& parent = QModelIndex() ) const override;
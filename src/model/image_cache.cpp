@@ -0,0 +1,173 @@
+#include "image_cache.h"
+
+#include <list>
+
+#include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+
+#if defined( Q_OS_WIN )
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace PatientsDBManager
+{
+    namespace
+    {
+        using Key = QPair<qint64, int>;
+
+        struct CachedImage
+        {
+            Key               key;
+            ImageCache::Entry entry;
+            qint64            bytes{ 0 };
+        };
+
+        struct Cache
+        {
+            QMutex                                       mutex;
+            std::list<CachedImage>                       images;     // most recently used first
+            QHash<Key, std::list<CachedImage>::iterator> index;
+            qint64                                       budget{ ImageCache::DEFAULT_BUDGET };
+            ImageCache::Statistics                       statistics;
+        };
+
+        Cache& imageCache()
+        {
+            static Cache cache;
+            return cache;
+        }
+
+        Key makeKey( int64_t contentId, ImageCache::EResolution resolution )
+        {
+            return qMakePair( static_cast<qint64>( contentId ), static_cast<int>( resolution ) );
+        }
+
+        // Physical memory still available to processes, -1 when it is not known
+        qint64 availableMemory()
+        {
+#if defined( Q_OS_WIN )
+            MEMORYSTATUSEX status;
+            status.dwLength = sizeof( status );
+            if( GlobalMemoryStatusEx( &status ) )
+                return static_cast<qint64>( status.ullAvailPhys );
+#elif defined( Q_OS_LINUX )
+            // MemAvailable counts the page cache that can be dropped, free memory does not
+            QFile meminfo( "/proc/meminfo" );
+            if( meminfo.open( QIODevice::ReadOnly ) )
+            {
+                for( const auto& line : meminfo.readAll().split( '\n' ) )
+                {
+                    if( line.startsWith( "MemAvailable:" ) )
+                        return line.mid( 13 ).trimmed().split( ' ' ).first().toLongLong() * 1024;
+                }
+            }
+#endif
+            return -1;
+        }
+
+        // Called with the mutex locked
+        void evictTo( Cache& cache, qint64 bytes )
+        {
+            while( cache.statistics.bytes > bytes && !cache.images.empty() )
+            {
+                const auto& oldest = cache.images.back();
+                cache.statistics.bytes -= oldest.bytes;
+                cache.index.remove( oldest.key );
+                cache.images.pop_back();
+                ++cache.statistics.evictions;
+            }
+            cache.statistics.count = cache.index.size();
+        }
+    }
+
+    std::optional<ImageCache::Entry> ImageCache::find( int64_t contentId, EResolution resolution ) noexcept
+    {
+        auto& cache = imageCache();
+        QMutexLocker locker( &cache.mutex );
+
+        const auto image = cache.index.constFind( makeKey( contentId, resolution ) );
+        if( image == cache.index.constEnd() )
+        {
+            ++cache.statistics.misses;
+            return std::nullopt;
+        }
+
+        ++cache.statistics.hits;
+        cache.images.splice( cache.images.begin(), cache.images, *image );
+        return cache.images.front().entry;
+    }
+
+    void ImageCache::insert( int64_t contentId, EResolution resolution, const Entry& entry ) noexcept
+    {
+        const qint64 bytes = entry.image.bytesPerLine() * static_cast<qint64>( entry.image.height() );
+        const auto key = makeKey( contentId, resolution );
+
+        // checked outside the lock, it reads a file on Linux
+        const auto available = availableMemory();
+        const bool lowMemory = available >= 0 && available < LOW_MEMORY;
+
+        auto& cache = imageCache();
+        QMutexLocker locker( &cache.mutex );
+
+        const auto cached = cache.index.constFind( key );
+        if( cached != cache.index.constEnd() )
+        {
+            cache.statistics.bytes -= ( *cached )->bytes;
+            cache.images.erase( *cached );
+            cache.index.remove( key );
+        }
+
+        // an image over the budget would only push out everything else
+        if( bytes > cache.budget )
+        {
+            cache.statistics.count = cache.index.size();
+            return;
+        }
+
+        cache.images.push_front( CachedImage{ key, entry, bytes } );
+        cache.index.insert( key, cache.images.begin() );
+        cache.statistics.bytes += bytes;
+
+        if( lowMemory )
+            qDebug() << QString( "ImageCache::insert: %1 MiB of memory available, shrinking" ).arg( available >> 20 );
+
+        evictTo( cache, lowMemory ? cache.budget / 2 : cache.budget );
+    }
+
+    void ImageCache::clear() noexcept
+    {
+        auto& cache = imageCache();
+        QMutexLocker locker( &cache.mutex );
+        cache.images.clear();
+        cache.index.clear();
+        cache.statistics.bytes = 0;
+        cache.statistics.count = 0;
+    }
+
+    qint64 ImageCache::budget() noexcept
+    {
+        auto& cache = imageCache();
+        QMutexLocker locker( &cache.mutex );
+        return cache.budget;
+    }
+
+    void ImageCache::setBudget( qint64 bytes ) noexcept
+    {
+        auto& cache = imageCache();
+        QMutexLocker locker( &cache.mutex );
+        cache.budget = qMax<qint64>( 0, bytes );
+        evictTo( cache, cache.budget );
+    }
+
+    ImageCache::Statistics ImageCache::statistics() noexcept
+    {
+        auto& cache = imageCache();
+        QMutexLocker locker( &cache.mutex );
+        return cache.statistics;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <optional>
+
+#include <QImage>
+#include <QtGlobal>
+
+namespace PatientsDBManager
+{
+    // Decoded photos shared by the whole process, keyed by content and resolution.
+    // Entries are accounted by the bytes of their pixels; the least recently used
+    // ones are evicted when the budget is exceeded, and down to half the budget
+    // when the system runs low on memory. Safe to use from any thread.
+    class ImageCache
+    {
+    public:
+        enum class EResolution : char { PREVIEW, FULL };
+
+        static constexpr qint64 DEFAULT_BUDGET = 256 * 1024 * 1024;
+        // Below this much available system memory the cache shrinks on every insert
+        static constexpr qint64 LOW_MEMORY = 512 * 1024 * 1024;
+
+        struct Entry
+        {
+            QImage image;
+            QSize  fullSize;    // the stored size of the photo
+        };
+
+        struct Statistics
+        {
+            qint64 hits{ 0 };
+            qint64 misses{ 0 };
+            qint64 evictions{ 0 };
+            qint64 bytes{ 0 };
+            int    count{ 0 };
+        };
+
+        static std::optional<Entry> find( int64_t contentId, EResolution resolution ) noexcept;
+        static void insert( int64_t contentId, EResolution resolution, const Entry& entry ) noexcept;
+        static void clear() noexcept;
+
+        static qint64 budget() noexcept;
+        static void setBudget( qint64 bytes ) noexcept;
+
+        static Statistics statistics() noexcept;
+    };
+}
+
+#endif // IMAGECACHE_H
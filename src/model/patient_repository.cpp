@@ -0,0 +1,265 @@
+#include "patient_repository.h"
+
+#include <utility>
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include "model/connection_manager.h"
+#include "model/database.h"
+#include "model/statement_cache.h"
+#include "utility/utility.h"
+
+namespace PatientsDBManager
+{
+    const QString PatientRepository::SELECT_LIST = Schema::SELECT_LIST<PatientRepository::Table>.toString();
+
+    PatientRepository::PatientRepository( const QSqlDatabase& db ) noexcept
+        : m_db( db )
+    {}
+
+    std::optional<Patient> PatientRepository::find( int64_t id ) noexcept
+    {
+        auto query = statement( "SELECT " + SELECT_LIST + " FROM " + PATIENTS_TABLE_NAME + " WHERE Id = ?;" );
+        if( !query )
+            return std::nullopt;
+
+        query->bindValue( 0, static_cast<qlonglong>( id ) );
+        if( !query->exec() )
+        {
+            m_lastError = query->lastError();
+            qDebug() << "PatientRepository::find: " + m_lastError.text();
+            return std::nullopt;
+        }
+
+        std::optional<Patient> patient;
+        if( query->next() )
+            patient = readPatient( *query );
+        query->finish();
+
+        return patient;
+    }
+
+    std::optional<QVector<Patient>> PatientRepository::select( const QString& statement,
+                                                               const QVariantList& bindValues, bool cached ) noexcept
+    {
+        QSqlQuery uncached( m_db );
+        auto query = cached ? this->statement( statement ) : prepare( uncached, statement );
+        if( !query )
+            return std::nullopt;
+
+        for( int i = 0; i < bindValues.size(); ++i )
+            query->bindValue( i, bindValues[i] );
+
+        if( !query->exec() )
+        {
+            m_lastError = query->lastError();
+            return std::nullopt;
+        }
+
+        QVector<Patient> patients;
+        while( query->next() )
+            patients.append( readPatient( *query ) );
+
+        const auto error = query->lastError();
+        query->finish();
+        if( error.isValid() )
+        {
+            m_lastError = error;
+            return std::nullopt;
+        }
+
+        return patients;
+    }
+
+    std::optional<int> PatientRepository::count( const QString& statement, const QVariantList& bindValues,
+                                                 bool cached ) noexcept
+    {
+        QSqlQuery uncached( m_db );
+        auto query = cached ? this->statement( statement ) : prepare( uncached, statement );
+        if( !query )
+            return std::nullopt;
+
+        for( int i = 0; i < bindValues.size(); ++i )
+            query->bindValue( i, bindValues[i] );
+
+        if( !query->exec() || !query->next() )
+        {
+            m_lastError = query->lastError();
+            return std::nullopt;
+        }
+
+        const int count = query->value( 0 ).toInt();
+        query->finish();
+        return count;
+    }
+
+    std::optional<int64_t> PatientRepository::insert( const Patient& patient ) noexcept
+    {
+        auto query = statement( "INSERT INTO " + PATIENTS_TABLE_NAME + " ( Name, Address, BirthDate, AdmissionDate, DiscargeDate ) "
+                                "VALUES ( ?, ?, ?, ?, ? );" );
+        if( !query )
+            return std::nullopt;
+
+        query->bindValue( 0, Schema::DbValue<Table, Table::NAME>( patient.name ) );
+        query->bindValue( 1, Schema::DbValue<Table, Table::ADDRESS>( patient.address ) );
+        query->bindValue( 2, Schema::DbValue<Table, Table::BIRTH_DATE>( patient.birthDate ) );
+        query->bindValue( 3, Schema::DbValue<Table, Table::ADMISSION_DATE>( patient.admissionDate ) );
+        query->bindValue( 4, Schema::DbValue<Table, Table::DISCARGE_DATE>( patient.discargeDate ) );
+
+        if( !query->exec() )
+        {
+            m_lastError = query->lastError();
+            qDebug() << "PatientRepository::insert: " + m_lastError.text();
+            return std::nullopt;
+        }
+
+        return query->lastInsertId().toLongLong();
+    }
+
+    bool PatientRepository::update( int64_t id, int column, const QVariant& value ) noexcept
+    {
+        if( column <= Table::ID || column >= Table::COLUMN_COUNT )
+            return false;
+
+        auto query = statement( "UPDATE " + PATIENTS_TABLE_NAME + " SET " + columnName( column ) + " = ? WHERE Id = ?;" );
+        if( !query )
+            return false;
+
+        query->bindValue( 0, value );
+        query->bindValue( 1, static_cast<qlonglong>( id ) );
+
+        if( !query->exec() )
+        {
+            m_lastError = query->lastError();
+            qDebug() << "PatientRepository::update: " + m_lastError.text();
+            return false;
+        }
+
+        return true;
+    }
+
+    std::optional<int> PatientRepository::remove( const QVector<qint64>& ids ) noexcept
+    {
+        if( ids.isEmpty() )
+            return 0;
+
+        auto fail = [this]( const QSqlError& error ) -> std::optional<int>
+        {
+            m_lastError = error;
+            qDebug() << "PatientRepository::remove: " + m_lastError.text();
+            m_db.rollback();
+            return std::nullopt;
+        };
+
+        QMutexLocker writeLocker( ConnectionManager::writeMutex( m_db.databaseName() ) );
+        if( !m_db.transaction() )
+            return fail( m_db.lastError() );
+
+        // The text depends on the number of ids, so these statements are not cached.
+        // Rows deleted by ON DELETE CASCADE are not reported by changes(), so the
+        // photos are counted inside the same transaction before the delete.
+        const auto idList = Utility::IdList( ids );
+
+        QSqlQuery query( m_db );
+        query.setForwardOnly( true );
+        if( !query.exec( "SELECT COUNT(*) FROM " + PHOTOS_SET_TABLE_NAME + " WHERE Patient_Id IN (" + idList + ");" ) ||
+            !query.next() )
+        {
+            return fail( query.lastError() );
+        }
+
+        const int removedPhotos = query.value( 0 ).toInt();
+        query.finish();
+
+        if( !query.exec( "DELETE FROM " + PATIENTS_TABLE_NAME + " WHERE Id IN (" + idList + ");" ) )
+            return fail( query.lastError() );
+
+        if( !m_db.commit() )
+            return fail( m_db.lastError() );
+
+        return removedPhotos;
+    }
+
+    QString PatientRepository::columnName( int column ) noexcept
+    {
+        return Schema::ColumnName<Table>( column );
+    }
+
+    QVariant PatientRepository::value( const Patient& patient, int column ) noexcept
+    {
+        switch( column )
+        {
+            case Table::ID:
+                return Schema::DbValue<Table, Table::ID>( patient.id );
+            case Table::NAME:
+                return Schema::DbValue<Table, Table::NAME>( patient.name );
+            case Table::ADDRESS:
+                return Schema::DbValue<Table, Table::ADDRESS>( patient.address );
+            case Table::BIRTH_DATE:
+                return Schema::DbValue<Table, Table::BIRTH_DATE>( patient.birthDate );
+            case Table::ADMISSION_DATE:
+                return Schema::DbValue<Table, Table::ADMISSION_DATE>( patient.admissionDate );
+            case Table::DISCARGE_DATE:
+                return Schema::DbValue<Table, Table::DISCARGE_DATE>( patient.discargeDate );
+            default:
+                return QVariant();
+        }
+    }
+
+    void PatientRepository::setValue( Patient& patient, int column, const QVariant& value ) noexcept
+    {
+        switch( column )
+        {
+            case Table::ID:
+                patient.id = Schema::Traits<Table, Table::ID>::fromDb( value );
+                break;
+            case Table::NAME:
+                patient.name = Schema::Traits<Table, Table::NAME>::fromDb( value );
+                break;
+            case Table::ADDRESS:
+                patient.address = Schema::Traits<Table, Table::ADDRESS>::fromDb( value );
+                break;
+            case Table::BIRTH_DATE:
+                patient.birthDate = Schema::Traits<Table, Table::BIRTH_DATE>::fromDb( value );
+                break;
+            case Table::ADMISSION_DATE:
+                patient.admissionDate = Schema::Traits<Table, Table::ADMISSION_DATE>::fromDb( value );
+                break;
+            case Table::DISCARGE_DATE:
+                patient.discargeDate = Schema::Traits<Table, Table::DISCARGE_DATE>::fromDb( value );
+                break;
+            default:
+                break;
+        }
+    }
+
+    QSqlQuery* PatientRepository::statement( const QString& sql ) noexcept
+    {
+        return StatementCache::statement( m_db, sql, m_lastError );
+    }
+
+    QSqlQuery* PatientRepository::prepare( QSqlQuery& query, const QString& sql ) noexcept
+    {
+        query.setForwardOnly( true );
+        if( !query.prepare( sql ) )
+        {
+            m_lastError = query.lastError();
+            qDebug() << "PatientRepository::prepare: " + m_lastError.text();
+            return nullptr;
+        }
+        return &query;
+    }
+
+    Patient PatientRepository::readPatient( const QSqlQuery& query ) noexcept
+    {
+        Patient patient;
+        patient.id = Schema::Value<Table, Table::ID>( query );
+        patient.name = Schema::Value<Table, Table::NAME>( query );
+        patient.address = Schema::Value<Table, Table::ADDRESS>( query );
+        patient.birthDate = Schema::Value<Table, Table::BIRTH_DATE>( query );
+        patient.admissionDate = Schema::Value<Table, Table::ADMISSION_DATE>( query );
+        patient.discargeDate = Schema::Value<Table, Table::DISCARGE_DATE>( query );
+        return patient;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef PATIENTREPOSITORY_H
+#define PATIENTREPOSITORY_H
+
+#include <optional>
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include "model/data_types.h"
+#include "model/table_schema.h"
+
+namespace PatientsDBManager
+{
+    // Typed access to the patients table on one connection. Statements are taken
+    // from the StatementCache of the connection, so each is compiled once, and
+    // rows are read forward only straight into Patient values. Statements whose
+    // text changes from call to call, e.g. with IN lists, are prepared uncached
+    // so they do not push the reused ones out of the cache.
+    class PatientRepository
+    {
+    public:
+        using Table = Schema::Patients;
+
+        static const QString SELECT_LIST;
+
+        explicit PatientRepository( const QSqlDatabase& db ) noexcept;
+
+        std::optional<Patient> find( int64_t id ) noexcept;
+
+        // Reads the rows of a statement that selects SELECT_LIST
+        std::optional<QVector<Patient>> select( const QString& statement, const QVariantList& bindValues,
+                                                bool cached = true ) noexcept;
+        std::optional<int> count( const QString& statement, const QVariantList& bindValues, bool cached = true ) noexcept;
+
+        // Returns the Id of the new patient
+        std::optional<int64_t> insert( const Patient& patient ) noexcept;
+        bool update( int64_t id, int column, const QVariant& value ) noexcept;
+
+        // Deletes the patients with one statement in one transaction and returns
+        // how many of their photos were deleted with them
+        std::optional<int> remove( const QVector<qint64>& ids ) noexcept;
+
+        QSqlError lastError() const noexcept { return m_lastError; }
+
+        static QString columnName( int column ) noexcept;
+
+        // Column values as they are stored, dates as Julian day numbers
+        static QVariant value( const Patient& patient, int column ) noexcept;
+        static void setValue( Patient& patient, int column, const QVariant& value ) noexcept;
+
+    private:
+        QSqlDatabase m_db;
+        QSqlError    m_lastError;
+
+        QSqlQuery* statement( const QString& sql ) noexcept;
+        QSqlQuery* prepare( QSqlQuery& query, const QString& sql ) noexcept;
+        static Patient readPatient( const QSqlQuery& query ) noexcept;
+    };
+}
+
+#endif // PATIENTREPOSITORY_H
@@ -0,0 +1,165 @@
+#include "patient_search.h"
+
+#include <QDebug>
+#include <QRegularExpression>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+#include <sqlite3.h>
+
+#include "model/connection_manager.h"
+#include "model/database.h"
+
+namespace PatientsDBManager
+{
+    PatientSearch::PatientSearch( const Database& db, QObject* parent ) noexcept
+        : QObject( parent )
+        , m_dbFileName( db.getFileName() )
+    {
+        m_debounceTimer.setSingleShot( true );
+        m_debounceTimer.setInterval( DEBOUNCE_MS );
+        connect( &m_debounceTimer, &QTimer::timeout, this, &PatientSearch::submit );
+
+        m_workerThread = QThread::create( [this]{ run(); } );
+        m_workerThread->setParent( this );
+        m_workerThread->start();
+    }
+
+    PatientSearch::~PatientSearch()
+    {
+        {
+            QMutexLocker locker( &m_mutex );
+            m_stopped = true;
+            if( m_handle )
+                sqlite3_interrupt( m_handle );
+            m_requestReady.wakeAll();
+        }
+        m_workerThread->wait();
+    }
+
+    QString PatientSearch::matchExpression( const QString& text )
+    {
+        // Splitting on what the unicode61 tokenizer treats as separators leaves
+        // no FTS5 syntax characters in the words
+        static const QRegularExpression separators( "[^\\w]+", QRegularExpression::UseUnicodePropertiesOption );
+
+        QStringList terms;
+        for( const auto& word : text.split( separators ) )
+        {
+            if( !word.isEmpty() )
+                terms.append( "\"" + word + "\"*" );
+        }
+
+        return terms.join( ' ' );
+    }
+
+    void PatientSearch::search( const QString& text ) noexcept
+    {
+        m_text = text.simplified();
+
+        if( matchExpression( m_text ).isEmpty() )
+        {
+            m_debounceTimer.stop();
+            interrupt();
+            emit searchCleared();
+            return;
+        }
+
+        m_debounceTimer.start();
+    }
+
+    void PatientSearch::submit() noexcept
+    {
+        QMutexLocker locker( &m_mutex );
+        m_requestText = m_text;
+        m_hasRequest = true;
+        ++m_generation;
+
+        // the query still running answers outdated text
+        if( m_handle )
+            sqlite3_interrupt( m_handle );
+
+        m_requestReady.wakeOne();
+    }
+
+    void PatientSearch::interrupt() noexcept
+    {
+        QMutexLocker locker( &m_mutex );
+        m_hasRequest = false;
+        ++m_generation;
+
+        if( m_handle )
+            sqlite3_interrupt( m_handle );
+    }
+
+    void PatientSearch::run() noexcept
+    {
+        auto db = ConnectionManager::reader( m_dbFileName );
+
+        // FTS5 yields matches in rowid order, so the limit stops the scan early
+        QSqlQuery query( db );
+        query.setForwardOnly( true );
+        if( !db.isOpen() ||
+            !query.prepare( "SELECT rowid FROM " + PATIENTS_SEARCH_TABLE_NAME + " WHERE " +
+                            PATIENTS_SEARCH_TABLE_NAME + " MATCH ? ORDER BY rowid LIMIT ?;" ) )
+        {
+            qDebug() << "PatientSearch::run: " + query.lastError().text() + db.lastError().text();
+        }
+        else
+        {
+            {
+                QMutexLocker locker( &m_mutex );
+                m_handle = Database::getHandle( db );
+            }
+
+            forever
+            {
+                QString text;
+                quint64 generation = 0;
+                {
+                    QMutexLocker locker( &m_mutex );
+                    while( !m_hasRequest && !m_stopped )
+                        m_requestReady.wait( &m_mutex );
+
+                    if( m_stopped )
+                        break;
+
+                    text = m_requestText;
+                    generation = m_generation;
+                    m_hasRequest = false;
+                }
+
+                QVector<qint64> patientIds;
+                query.bindValue( 0, matchExpression( text ) );
+                query.bindValue( 1, RESULT_LIMIT + 1 );
+                bool completed = query.exec();
+                while( completed && query.next() )
+                    patientIds.append( query.value( 0 ).toLongLong() );
+                completed = completed && !query.lastError().isValid();
+                const auto error = query.lastError().text();
+                query.finish();
+
+                QMutexLocker locker( &m_mutex );
+                if( generation != m_generation || m_stopped )
+                    continue;
+
+                if( !completed )
+                {
+                    qDebug() << "PatientSearch::run: " + error;
+                    continue;
+                }
+
+                const bool truncated = patientIds.size() > RESULT_LIMIT;
+                if( truncated )
+                    patientIds.resize( RESULT_LIMIT );
+
+                emit resultsReady( text, patientIds, truncated );
+            }
+
+            QMutexLocker locker( &m_mutex );
+            m_handle = nullptr;
+        }
+    }
+}
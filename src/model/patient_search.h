@@ -0,0 +1,66 @@
+#ifndef PATIENTSEARCH_H
+#define PATIENTSEARCH_H
+
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <QWaitCondition>
+
+struct sqlite3;
+
+namespace PatientsDBManager
+{
+    class Database;
+
+    // As-you-type patient search over the full-text index of names and addresses.
+    // Keystrokes are debounced, the query runs on a connection of its own and a
+    // newer request interrupts the one still running, so only the latest text
+    // is answered.
+    class PatientSearch : public QObject
+    {
+        Q_OBJECT
+    public:
+        static constexpr int DEBOUNCE_MS = 150;
+        static constexpr int RESULT_LIMIT = 1000;
+
+        explicit PatientSearch( const Database& db, QObject* parent = nullptr ) noexcept;
+        ~PatientSearch() override;
+
+        // Every word of the text is matched as a prefix, all of them have to match
+        static QString matchExpression( const QString& text );
+
+    public slots:
+        void search( const QString& text ) noexcept;
+
+    signals:
+        // Ids are in ascending order, truncated is set when more than RESULT_LIMIT patients match
+        void resultsReady( const QString& text, const QVector<qint64>& patientIds, bool truncated );
+        void searchCleared();
+
+    private slots:
+        void submit() noexcept;
+
+    private:
+        QString m_dbFileName;
+        QTimer  m_debounceTimer;
+        QString m_text;
+
+        QThread* m_workerThread{ nullptr };
+
+        QMutex         m_mutex;
+        QWaitCondition m_requestReady;
+        QString        m_requestText;
+        quint64        m_generation{ 0 };
+        bool           m_hasRequest{ false };
+        bool           m_stopped{ false };
+        sqlite3*       m_handle{ nullptr };
+
+        void run() noexcept;
+        void interrupt() noexcept;
+    };
+}
+
+#endif // PATIENTSEARCH_H
@@ -0,0 +1,731 @@
+#include "patients_model.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include <QDebug>
+
+#include "model/database.h"
+#include "utility/utility.h"
+
+namespace PatientsDBManager
+{
+    namespace
+    {
+        const char* const COLUMN_TITLES[PatientsModel::COLUMN_COUNT] =
+            { "Id", "Name", "Address", "Birth date", "Admission date", "Discarge date" };
+    }
+
+    PatientsModel::PatientsModel( const QSqlDatabase& db, EditBuffer* editBuffer, QObject* parent ) noexcept
+        : QAbstractTableModel( parent )
+        , m_db( db )
+        , m_worker( db.databaseName() )
+        , m_repository( m_db )
+        , m_editBuffer( editBuffer )
+    {
+        connect( &m_worker, &QueryWorker::busyChanged, this, &PatientsModel::busyChanged );
+    }
+
+    int PatientsModel::rowCount( const QModelIndex& parent ) const
+    {
+        return parent.isValid() ? 0 : m_rowCount;
+    }
+
+    int PatientsModel::columnCount( const QModelIndex& parent ) const
+    {
+        return parent.isValid() ? 0 : COLUMN_COUNT;
+    }
+
+    QVariant PatientsModel::data( const QModelIndex& index, int role ) const
+    {
+        if( !index.isValid() || ( role != Qt::DisplayRole && role != Qt::EditRole ) )
+            return QVariant();
+
+        const auto patient = row( index.row() );
+        return patient ? PatientRepository::value( *patient, index.column() ) : QVariant();
+    }
+
+    bool PatientsModel::setData( const QModelIndex& index, const QVariant& value, int role )
+    {
+        if( !index.isValid() || role != Qt::EditRole || !( flags( index ) & Qt::ItemIsEditable ) )
+            return false;
+
+        const auto id = patientId( index.row() );
+        if( !id )
+            return false;
+
+        if( m_editBuffer )
+        {
+            m_editBuffer->stage<Schema::Patients>( id, index.column(), value );
+
+            // the pages read again below have to see the new value
+            if( index.column() == m_sortColumn && !m_editBuffer->flush() )
+                return false;
+        }
+        else if( !m_repository.update( id, index.column(), value ) )
+        {
+            m_lastError = m_repository.lastError();
+            return false;
+        }
+
+        // the row may move to another position, so every page is read again
+        if( index.column() == m_sortColumn )
+        {
+            emit layoutAboutToBeChanged();
+            invalidatePages();
+            emit layoutChanged();
+            return true;
+        }
+
+        if( auto cachedPage = m_pages.object( index.row() / PAGE_SIZE ) )
+        {
+            if( index.row() % PAGE_SIZE < cachedPage->size() )
+                PatientRepository::setValue( ( *cachedPage )[index.row() % PAGE_SIZE], index.column(), value );
+        }
+
+        emit dataChanged( index, index, { Qt::DisplayRole, Qt::EditRole } );
+        return true;
+    }
+
+    QVariant PatientsModel::headerData( int section, Qt::Orientation orientation, int role ) const
+    {
+        if( orientation != Qt::Horizontal || role != Qt::DisplayRole || section < 0 || section >= COLUMN_COUNT )
+            return QAbstractTableModel::headerData( section, orientation, role );
+
+        return COLUMN_TITLES[section];
+    }
+
+    Qt::ItemFlags PatientsModel::flags( const QModelIndex& index ) const
+    {
+        auto flags = QAbstractTableModel::flags( index );
+        if( index.isValid() && index.column() != ID )
+            flags |= Qt::ItemIsEditable;
+        return flags;
+    }
+
+    bool PatientsModel::removeRows( int row, int count, const QModelIndex& parent )
+    {
+        if( parent.isValid() || row < 0 || count <= 0 || row + count > m_rowCount )
+            return false;
+
+        QVector<int> rows;
+        rows.reserve( count );
+        for( int i = row; i < row + count; ++i )
+            rows.append( i );
+
+        return removePatients( rows ).has_value();
+    }
+
+    void PatientsModel::sort( int column, Qt::SortOrder order )
+    {
+        if( column < 0 || column >= COLUMN_COUNT || ( column == m_sortColumn && order == m_sortOrder ) )
+            return;
+
+        beginResetModel();
+        m_sortColumn = column;
+        m_sortOrder = order;
+        invalidatePages();
+        endResetModel();
+    }
+
+    bool PatientsModel::select() noexcept
+    {
+        m_worker.cancelAll();
+        m_pendingPages.clear();
+
+        const auto statement = "SELECT COUNT(*) FROM " + PATIENTS_TABLE_NAME + whereClause( QString() ) + ";";
+        const bool cached = m_filter.isEmpty();
+        m_worker.submit( [this, statement, cached]( const QSqlDatabase& db ) -> QueryWorker::Completion
+        {
+            PatientRepository repository( db );
+            const auto count = repository.count( statement, {}, cached );
+            if( !count )
+            {
+                const auto error = repository.lastError();
+                return [this, error]
+                {
+                    m_lastError = error;
+                    qDebug() << "PatientsModel::select: " + m_lastError.text();
+                    emit queryFailed( m_lastError );
+                };
+            }
+
+            return [this, count = *count]
+            {
+                beginResetModel();
+                m_rowCount = count;
+                invalidatePages();
+                endResetModel();
+
+                m_lastError = QSqlError();
+            };
+        } );
+
+        return true;
+    }
+
+    bool PatientsModel::addPatient( const Patient& patient ) noexcept
+    {
+        const auto id = m_repository.insert( patient );
+        if( !id )
+        {
+            m_lastError = m_repository.lastError();
+            return false;
+        }
+
+        RowChanges changes;
+        changes.inserted.append( *id );
+        applyChanges( changes );
+        return true;
+    }
+
+    void PatientsModel::applyChanges( const RowChanges& changes ) noexcept
+    {
+        const auto loaded = loadedRows();
+
+        // The position of a row that is not loaded is unknown, so its deletion needs a recount
+        QVector<int> deletedRows;
+        for( const auto id : changes.deleted )
+        {
+            const auto row = loaded.constFind( id );
+            if( row == loaded.constEnd() )
+            {
+                select();
+                return;
+            }
+            deletedRows.append( *row );
+        }
+        removeLoadedRows( deletedRows );
+
+        // An update of a row that is not loaded only matters if it may have moved
+        bool moved = false;
+        QVector<qint64> updated;
+        for( const auto id : changes.updated )
+        {
+            if( loaded.contains( id ) )
+                updated.append( id );
+            else if( m_sortColumn != ID )
+                moved = true;
+        }
+
+        if( moved )
+        {
+            emit layoutAboutToBeChanged();
+            invalidatePages();
+            emit layoutChanged();
+        }
+
+        const auto inserted = changes.inserted;
+        if( updated.isEmpty() && inserted.isEmpty() )
+            return;
+
+        const auto filter = m_filter;
+        const auto statement = "SELECT " + PatientRepository::SELECT_LIST + " FROM " + PATIENTS_TABLE_NAME +
+                               whereClause( "Id IN (" + Utility::IdList( updated + inserted ) + ")" ) + ";";
+
+        m_worker.submit( [this, statement, filter, updated, inserted]( const QSqlDatabase& db ) -> QueryWorker::Completion
+        {
+            QSqlError error;
+            const auto rows = readRows( db, RowsQuery{ statement, {}, true, false }, error );
+            if( !rows )
+            {
+                return [this, error]
+                {
+                    m_lastError = error;
+                    qDebug() << "PatientsModel::applyChanges: " + m_lastError.text();
+                    emit queryFailed( m_lastError );
+                };
+            }
+
+            return [this, rows = *rows, filter, updated, inserted]
+            {
+                if( filter != m_filter )
+                    return;
+
+                const auto loaded = loadedRows();
+                QSet<qint64> readIds;
+                QVector<Row> newRows;
+                bool moved = false;
+
+                for( const auto& patient : rows )
+                {
+                    const auto id = patient.id;
+                    readIds.insert( id );
+
+                    const auto row = loaded.constFind( id );
+                    if( row == loaded.constEnd() )
+                    {
+                        if( inserted.contains( id ) )
+                            newRows.append( patient );
+                        continue;
+                    }
+
+                    auto updatedRow = patient;
+                    applyPendingEdits( updatedRow );
+
+                    auto& cachedRow = ( *m_pages.object( *row / PAGE_SIZE ) )[*row % PAGE_SIZE];
+                    if( PatientRepository::value( cachedRow, m_sortColumn ) !=
+                        PatientRepository::value( updatedRow, m_sortColumn ) )
+                        moved = true;
+
+                    cachedRow = std::move( updatedRow );
+                    emit dataChanged( index( *row, 0 ), index( *row, COLUMN_COUNT - 1 ), { Qt::DisplayRole, Qt::EditRole } );
+                }
+
+                if( moved )
+                {
+                    emit layoutAboutToBeChanged();
+                    invalidatePages();
+                    emit layoutChanged();
+                }
+                else
+                {
+                    // updated rows that were not read back were deleted or left the filter
+                    QVector<int> leftRows;
+                    for( const auto id : updated )
+                    {
+                        const auto row = loaded.constFind( id );
+                        if( !readIds.contains( id ) && row != loaded.constEnd() )
+                            leftRows.append( *row );
+                    }
+                    removeLoadedRows( leftRows );
+                }
+
+                insertPatientRows( newRows );
+            };
+        } );
+    }
+
+    void PatientsModel::insertPatientRows( const QVector<Row>& rows ) noexcept
+    {
+        if( rows.isEmpty() )
+            return;
+
+        // In Id order the rows after a new one are counted: a new rowid is the
+        // largest, so that range is short. In any other order the rows ahead are,
+        // a scan over the index of the sort column that does not read the table.
+        QVector<RowsQuery> counts;
+        for( const auto& patient : rows )
+        {
+            RowsQuery count;
+            const auto condition = m_sortColumn == ID
+                                   ? keyCondition( keyOf( patient ), true, count.bindValues )
+                                   : keyCondition( keyOf( patient ), m_sortOrder == Qt::DescendingOrder, count.bindValues );
+            count.statement = "SELECT COUNT(*) FROM " + PATIENTS_TABLE_NAME + whereClause( condition ) + ";";
+            count.cached = m_filter.isEmpty();
+            counts.append( count );
+        }
+
+        const int sortColumn = m_sortColumn;
+        const auto sortOrder = m_sortOrder;
+        const auto filter = m_filter;
+
+        m_worker.submit( [this, rows, counts, sortColumn, sortOrder, filter]( const QSqlDatabase& db ) -> QueryWorker::Completion
+        {
+            PatientRepository repository( db );
+            QVector<QPair<int, Row>> insertions;
+            for( int i = 0; i < rows.size(); ++i )
+            {
+                const auto count = repository.count( counts[i].statement, counts[i].bindValues, counts[i].cached );
+                if( !count )
+                {
+                    const auto error = repository.lastError();
+                    return [this, error]
+                    {
+                        m_lastError = error;
+                        qDebug() << "PatientsModel::insertPatientRows: " + m_lastError.text();
+                        select();
+                    };
+                }
+                insertions.append( qMakePair( *count, rows[i] ) );
+            }
+
+            // Counted rows are either old or inserted before, so the smallest count goes first
+            std::sort( insertions.begin(), insertions.end(),
+                       []( const QPair<int, Row>& left, const QPair<int, Row>& right ){ return left.first < right.first; } );
+
+            return [this, insertions, sortColumn, sortOrder, filter]
+            {
+                // the order or the filter changed in the meantime
+                if( sortColumn != m_sortColumn || sortOrder != m_sortOrder || filter != m_filter )
+                {
+                    select();
+                    return;
+                }
+
+                const bool countedAfter = sortColumn == ID && sortOrder == Qt::AscendingOrder;
+                for( const auto& insertion : insertions )
+                    insertPatientRow( countedAfter ? m_rowCount - insertion.first : insertion.first, insertion.second );
+            };
+        } );
+    }
+
+    std::optional<int> PatientsModel::removePatients( const QVector<int>& rows ) noexcept
+    {
+        const auto ranges = Utility::RowRanges( rows );
+
+        QVector<qint64> ids;
+        ids.reserve( rows.size() );
+        for( const auto& range : ranges )
+        {
+            for( int row = range.first; row <= range.second; ++row )
+            {
+                // a row whose page is still being read cannot be removed by its Id
+                const auto id = patientId( row );
+                if( !id )
+                {
+                    m_lastError = QSqlError( "Some of the patients are still being loaded", QString(),
+                                             QSqlError::UnknownError );
+                    return std::nullopt;
+                }
+                ids.append( id );
+            }
+        }
+
+        if( ids.isEmpty() )
+            return 0;
+
+        // staged edits of the rows are written first, so they are logged in order
+        if( m_editBuffer )
+            m_editBuffer->flush();
+
+        const auto removedPhotos = m_repository.remove( ids );
+        if( !removedPhotos )
+        {
+            m_lastError = m_repository.lastError();
+            return std::nullopt;
+        }
+
+        removeLoadedRows( rows );
+        return removedPhotos;
+    }
+
+    void PatientsModel::setFilter( const QString& filter ) noexcept
+    {
+        m_filter = filter;
+        select();
+    }
+
+    void PatientsModel::setPageBudget( int pages ) noexcept
+    {
+        m_pages.setMaxCost( qMax( pages, 1 ) );
+    }
+
+    int64_t PatientsModel::patientId( int row ) const noexcept
+    {
+        const auto patient = this->row( row );
+        return patient ? patient->id : 0;
+    }
+
+    const PatientsModel::Row* PatientsModel::row( int row ) const noexcept
+    {
+        if( row < 0 || row >= m_rowCount )
+            return nullptr;
+
+        const int pageIndex = row / PAGE_SIZE;
+        const int pageRow = row % PAGE_SIZE;
+        const auto rows = page( pageIndex );
+        if( !rows )
+            return nullptr;
+
+        if( pageRow < rows->size() )
+            return &rows->at( pageRow );
+
+        // only a prefix of the page survived an insertion or a removal
+        requestPage( pageIndex );
+        return nullptr;
+    }
+
+    const QVector<PatientsModel::Row>* PatientsModel::page( int pageIndex ) const noexcept
+    {
+        if( auto cachedPage = m_pages.object( pageIndex ) )
+            return cachedPage;
+
+        requestPage( pageIndex );
+        return nullptr;
+    }
+
+    void PatientsModel::requestPage( int pageIndex ) const noexcept
+    {
+        if( pageRowCount( pageIndex ) <= 0 || m_pendingPages.contains( pageIndex ) )
+            return;
+
+        m_pendingPages.insert( pageIndex );
+
+        // data() asks for the page, its arrival changes the model
+        auto model = const_cast<PatientsModel*>( this );
+        const auto generation = m_pagesGeneration;
+        const auto query = pageQuery( pageIndex );
+
+        m_worker.submit( [model, pageIndex, generation, query]( const QSqlDatabase& db ) -> QueryWorker::Completion
+        {
+            QSqlError error;
+            auto rows = readRows( db, query, error );
+            if( !rows )
+            {
+                return [model, pageIndex, generation, error]
+                {
+                    if( generation != model->m_pagesGeneration )
+                        return;
+
+                    model->m_pendingPages.remove( pageIndex );
+                    model->m_lastError = error;
+                    qDebug() << "PatientsModel::requestPage: " + error.text();
+                    emit model->queryFailed( error );
+                };
+            }
+
+            return [model, pageIndex, generation, rows = std::move( *rows )]
+            {
+                model->pageLoaded( pageIndex, generation, rows );
+            };
+        } );
+    }
+
+    void PatientsModel::pageLoaded( int pageIndex, quint64 generation, QVector<Row> rows ) noexcept
+    {
+        // the page was read before a reset or a layout change
+        if( generation != m_pagesGeneration )
+            return;
+
+        m_pendingPages.remove( pageIndex );
+        if( rows.isEmpty() )
+            return;
+
+        if( m_editBuffer && !m_editBuffer->isEmpty() )
+        {
+            for( auto& row : rows )
+                applyPendingEdits( row );
+        }
+
+        m_bounds[pageIndex] = PageBounds{ keyOf( rows.first() ), keyOf( rows.last() ) };
+
+        const int firstRow = pageIndex * PAGE_SIZE;
+        const int lastRow = qMin( firstRow + rows.size(), m_rowCount ) - 1;
+
+        m_pages.insert( pageIndex, new QVector<Row>( std::move( rows ) ) );
+
+        // The cache evicts pages without notice, bounds are only kept for the cached ones
+        for( auto bounds = m_bounds.begin(); bounds != m_bounds.end(); )
+            bounds = m_pages.contains( bounds.key() ) ? std::next( bounds ) : m_bounds.erase( bounds );
+
+        if( lastRow >= firstRow )
+            emit dataChanged( index( firstRow, 0 ), index( lastRow, COLUMN_COUNT - 1 ), { Qt::DisplayRole, Qt::EditRole } );
+    }
+
+    PatientsModel::RowsQuery PatientsModel::pageQuery( int pageIndex ) const
+    {
+        const int size = pageRowCount( pageIndex );
+
+        // A neighbour of a page read before is a plain range scan from its key
+        if( auto previous = m_bounds.constFind( pageIndex - 1 ); previous != m_bounds.constEnd() )
+            return rowsQuery( &previous->last, true, 0, size );
+
+        if( auto next = m_bounds.constFind( pageIndex + 1 ); next != m_bounds.constEnd() )
+            return rowsQuery( &next->first, false, 0, size );
+
+        // Otherwise the fewest rows are skipped from the closest known key or table end
+        const int firstRow = pageIndex * PAGE_SIZE;
+
+        const Key* anchor = nullptr;
+        bool forward = true;
+        int offset = firstRow;
+
+        const int fromEnd = m_rowCount - ( firstRow + size );
+        if( fromEnd < offset )
+        {
+            forward = false;
+            offset = fromEnd;
+        }
+
+        // only pages strictly after and before count, a page is never its own anchor
+        auto after = m_bounds.upperBound( pageIndex );
+        if( after != m_bounds.end() )
+        {
+            const int skipped = qMax( 0, ( after.key() - pageIndex - 1 ) * PAGE_SIZE );
+            if( skipped < offset )
+            {
+                anchor = &after->first;
+                forward = false;
+                offset = skipped;
+            }
+        }
+
+        if( auto before = m_bounds.lowerBound( pageIndex ); before != m_bounds.begin() )
+        {
+            --before;
+            const int skipped = qMax( 0, ( pageIndex - before.key() - 1 ) * PAGE_SIZE );
+            if( skipped < offset )
+            {
+                anchor = &before->last;
+                forward = true;
+                offset = skipped;
+            }
+        }
+
+        return rowsQuery( anchor, forward, offset, size );
+    }
+
+    PatientsModel::RowsQuery PatientsModel::rowsQuery( const Key* anchor, bool forward, int offset, int limit ) const
+    {
+        // Reading backwards is the same scan in the opposite direction
+        const bool ascending = forward == ( m_sortOrder == Qt::AscendingOrder );
+        const QString direction = ascending ? " ASC" : " DESC";
+
+        QString orderBy = " ORDER BY ";
+        if( m_sortColumn != ID )
+            orderBy += PatientRepository::columnName( m_sortColumn ) + direction + ", ";
+        orderBy += "Id" + direction;
+
+        RowsQuery query;
+        query.forward = forward;
+        query.cached = m_filter.isEmpty();
+
+        const QString condition = anchor ? keyCondition( *anchor, ascending, query.bindValues ) : QString();
+        query.statement = "SELECT " + PatientRepository::SELECT_LIST + " FROM " + PATIENTS_TABLE_NAME +
+                          whereClause( condition ) + orderBy + " LIMIT ? OFFSET ?;";
+        query.bindValues << limit << offset;
+
+        return query;
+    }
+
+    std::optional<QVector<PatientsModel::Row>> PatientsModel::readRows( const QSqlDatabase& db, const RowsQuery& request,
+                                                                       QSqlError& error ) noexcept
+    {
+        PatientRepository repository( db );
+        auto rows = repository.select( request.statement, request.bindValues, request.cached );
+        if( !rows )
+        {
+            error = repository.lastError();
+            return std::nullopt;
+        }
+
+        if( !request.forward )
+            std::reverse( rows->begin(), rows->end() );
+
+        return rows;
+    }
+
+    QString PatientsModel::keyCondition( const Key& anchor, bool greater, QVariantList& bindValues ) const
+    {
+        if( m_sortColumn == ID )
+        {
+            bindValues << anchor.id;
+            return greater ? "Id > ?" : "Id < ?";
+        }
+
+        // NULLs sort first in ascending order
+        const QString column = PatientRepository::columnName( m_sortColumn );
+        if( anchor.sortValue.isNull() )
+        {
+            bindValues << anchor.id;
+            return greater ? "( " + column + " IS NOT NULL OR Id > ? )"
+                           : "( " + column + " IS NULL AND Id < ? )";
+        }
+
+        bindValues << anchor.sortValue << anchor.id;
+        return greater ? "( " + column + ", Id ) > ( ?, ? )"
+                       : "( ( " + column + ", Id ) < ( ?, ? ) OR " + column + " IS NULL )";
+    }
+
+    PatientsModel::Key PatientsModel::keyOf( const Row& row ) const
+    {
+        return Key{ PatientRepository::value( row, m_sortColumn ), row.id };
+    }
+
+    void PatientsModel::applyPendingEdits( Row& row ) const noexcept
+    {
+        if( !m_editBuffer )
+            return;
+
+        for( int column = ID + 1; column < COLUMN_COUNT; ++column )
+        {
+            if( const auto value = m_editBuffer->pendingValue<Schema::Patients>( row.id, column ) )
+                PatientRepository::setValue( row, column, *value );
+        }
+    }
+
+    int PatientsModel::pageRowCount( int pageIndex ) const noexcept
+    {
+        if( pageIndex < 0 )
+            return 0;
+        return qBound( 0, m_rowCount - pageIndex * PAGE_SIZE, PAGE_SIZE );
+    }
+
+    QHash<qint64, int> PatientsModel::loadedRows() const noexcept
+    {
+        QHash<qint64, int> rows;
+        for( const auto pageIndex : m_pages.keys() )
+        {
+            const auto cachedPage = m_pages.object( pageIndex );
+            for( int i = 0; i < cachedPage->size(); ++i )
+                rows.insert( cachedPage->at( i ).id, pageIndex * PAGE_SIZE + i );
+        }
+        return rows;
+    }
+
+    void PatientsModel::removeLoadedRows( const QVector<int>& rows ) noexcept
+    {
+        for( const auto& range : Utility::RowRanges( rows ) )
+        {
+            beginRemoveRows( QModelIndex(), range.first, range.second );
+            m_rowCount -= range.second - range.first + 1;
+            invalidateRowsFrom( range.first );
+            endRemoveRows();
+        }
+    }
+
+    void PatientsModel::insertPatientRow( int position, const Row& newRow ) noexcept
+    {
+        position = qBound( 0, position, m_rowCount );
+
+        beginInsertRows( QModelIndex(), position, position );
+        ++m_rowCount;
+        invalidateRowsFrom( position );
+        if( auto cachedPage = m_pages.object( position / PAGE_SIZE ) )
+        {
+            if( cachedPage->size() == position % PAGE_SIZE )
+                cachedPage->append( newRow );
+        }
+        endInsertRows();
+    }
+
+    void PatientsModel::invalidateRowsFrom( int firstRow ) noexcept
+    {
+        // Rows before firstRow keep their positions, the page holding it keeps them as a prefix
+        const int firstPage = firstRow / PAGE_SIZE;
+
+        ++m_pagesGeneration;
+        m_pendingPages.clear();
+
+        for( const auto pageIndex : m_pages.keys() )
+        {
+            if( pageIndex > firstPage )
+                m_pages.remove( pageIndex );
+        }
+
+        if( auto cachedPage = m_pages.object( firstPage ) )
+            cachedPage->resize( qMin( cachedPage->size(), firstRow % PAGE_SIZE ) );
+
+        m_bounds.erase( m_bounds.lowerBound( firstPage ), m_bounds.end() );
+    }
+
+    void PatientsModel::invalidatePages() noexcept
+    {
+        ++m_pagesGeneration;
+        m_pages.clear();
+        m_bounds.clear();
+        m_pendingPages.clear();
+    }
+
+    QString PatientsModel::whereClause( const QString& condition ) const
+    {
+        if( m_filter.isEmpty() && condition.isEmpty() )
+            return QString();
+        if( m_filter.isEmpty() )
+            return " WHERE " + condition;
+        if( condition.isEmpty() )
+            return " WHERE ( " + m_filter + " )";
+        return " WHERE ( " + m_filter + " ) AND " + condition;
+    }
+}
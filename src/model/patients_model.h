@@ -0,0 +1,156 @@
+#ifndef PATIENTSMODEL_H
+#define PATIENTSMODEL_H
+
+#include <optional>
+
+#include <QAbstractTableModel>
+#include <QCache>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include "model/data_types.h"
+#include "model/edit_buffer.h"
+#include "model/patient_repository.h"
+#include "model/query_worker.h"
+
+namespace PatientsDBManager
+{
+    // Read/write model of the patients table that scales to millions of rows.
+    // Rows are read in pages by keyset pagination on ( sort column, Id ) and only
+    // a budget of recently used pages is kept. rowCount() is a cached COUNT.
+    //
+    // The first and the last key of every page read so far are remembered, so a
+    // neighbouring page is one index range scan. A far jump starts from the
+    // nearest remembered key, or from either end of the table.
+    //
+    // Counting and page reads run on a QueryWorker; rows of a page still being
+    // read are empty until it arrives. select() supersedes the queries before it.
+    class PatientsModel : public QAbstractTableModel
+    {
+        Q_OBJECT
+    public:
+        // Every column of the table is shown
+        enum EColumn : int
+        {
+            ID = Schema::Patients::ID,
+            NAME = Schema::Patients::NAME,
+            ADDRESS = Schema::Patients::ADDRESS,
+            BIRTH_DATE = Schema::Patients::BIRTH_DATE,
+            ADMISSION_DATE = Schema::Patients::ADMISSION_DATE,
+            DISCARGE_DATE = Schema::Patients::DISCARGE_DATE,
+            COLUMN_COUNT = Schema::Patients::COLUMN_COUNT
+        };
+
+        static constexpr int PAGE_SIZE = 256;
+        static constexpr int DEFAULT_PAGE_BUDGET = 16;
+
+        // Edits are staged in editBuffer when it is given, otherwise written at once
+        explicit PatientsModel( const QSqlDatabase& db, EditBuffer* editBuffer = nullptr,
+                                QObject* parent = nullptr ) noexcept;
+
+        int rowCount( const QModelIndex& parent = QModelIndex() ) const override;
+        int columnCount( const QModelIndex& parent = QModelIndex() ) const override;
+        QVariant data( const QModelIndex& index, int role = Qt::DisplayRole ) const override;
+        bool setData( const QModelIndex& index, const QVariant& value, int role = Qt::EditRole ) override;
+        QVariant headerData( int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const override;
+        Qt::ItemFlags flags( const QModelIndex& index ) const override;
+        bool removeRows( int row, int count, const QModelIndex& parent = QModelIndex() ) override;
+        void sort( int column, Qt::SortOrder order = Qt::AscendingOrder ) override;
+
+        // Starts counting the rows, failures are reported by queryFailed()
+        bool select() noexcept;
+        bool addPatient( const Patient& patient ) noexcept;
+
+        // Deletes the patients of the rows with one statement in one transaction and
+        // returns how many of their photos were deleted with them
+        std::optional<int> removePatients( const QVector<int>& rows ) noexcept;
+
+        // Pulls rows changed elsewhere into the loaded pages: loaded rows are updated
+        // in place and new rows inserted at their position
+        void applyChanges( const RowChanges& changes ) noexcept;
+
+        // SQL condition over the Patients columns, an empty filter selects every patient
+        void setFilter( const QString& filter ) noexcept;
+        const QString& filter() const noexcept { return m_filter; }
+
+        void setPageBudget( int pages ) noexcept;
+        int pageBudget() const noexcept { return m_pages.maxCost(); }
+
+        int64_t patientId( int row ) const noexcept;
+
+        bool isBusy() const noexcept { return m_worker.isBusy(); }
+
+        QSqlError lastError() const noexcept { return m_lastError; }
+
+    signals:
+        void busyChanged( bool busy );
+        void queryFailed( const QSqlError& error );
+
+    private:
+        using Row = Patient;
+
+        struct Key
+        {
+            QVariant sortValue;
+            qint64   id{ 0 };
+        };
+
+        struct PageBounds
+        {
+            Key first;
+            Key last;
+        };
+
+        struct RowsQuery
+        {
+            QString      statement;
+            QVariantList bindValues;
+            bool         forward{ true };
+            bool         cached{ true };    // false for text that changes from call to call
+        };
+
+        QSqlDatabase m_db;
+        QString      m_filter;
+        int          m_sortColumn{ ID };
+        Qt::SortOrder m_sortOrder{ Qt::AscendingOrder };
+        int          m_rowCount{ 0 };
+
+        mutable QueryWorker               m_worker;
+        PatientRepository                 m_repository;
+        EditBuffer*                       m_editBuffer{ nullptr };
+        mutable QCache<int, QVector<Row>> m_pages{ DEFAULT_PAGE_BUDGET };
+        mutable QMap<int, PageBounds>     m_bounds;
+        mutable QSet<int>                 m_pendingPages;
+        quint64                           m_pagesGeneration{ 0 };
+        QSqlError                         m_lastError;
+
+        const Row* row( int row ) const noexcept;
+        const QVector<Row>* page( int pageIndex ) const noexcept;
+        void requestPage( int pageIndex ) const noexcept;
+        void pageLoaded( int pageIndex, quint64 generation, QVector<Row> rows ) noexcept;
+        RowsQuery pageQuery( int pageIndex ) const;
+        RowsQuery rowsQuery( const Key* anchor, bool forward, int offset, int limit ) const;
+        static std::optional<QVector<Row>> readRows( const QSqlDatabase& db, const RowsQuery& request,
+                                                     QSqlError& error ) noexcept;
+        QString keyCondition( const Key& anchor, bool greater, QVariantList& bindValues ) const;
+        Key keyOf( const Row& row ) const;
+        void applyPendingEdits( Row& row ) const noexcept;
+
+        int pageRowCount( int pageIndex ) const noexcept;
+        QHash<qint64, int> loadedRows() const noexcept;
+        void removeLoadedRows( const QVector<int>& rows ) noexcept;
+        void insertPatientRows( const QVector<Row>& rows ) noexcept;
+        void insertPatientRow( int position, const Row& newRow ) noexcept;
+        void invalidateRowsFrom( int firstRow ) noexcept;
+        void invalidatePages() noexcept;
+        QString whereClause( const QString& condition ) const;
+    };
+}
+
+#endif // PATIENTSMODEL_H
@@ -0,0 +1,178 @@
+#include "photo_decoder.h"
+
+#include <new>
+
+#include <QHash>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "model/blob_device.h"
+#include "model/connection_manager.h"
+#include "model/database.h"
+#include "model/image_cache.h"
+#include "utility/utility.h"
+
+namespace PatientsDBManager
+{
+    // The requests made since the last cancelAll(). The decoder detaches itself
+    // under the mutex, so a task never posts to a deleted decoder. cancel() moves
+    // the generation of a photo on, requests of an older one are dropped.
+    struct PhotoDecoder::Requests
+    {
+        QMutex                 mutex;
+        PhotoDecoder*          owner{ nullptr };
+        QHash<int64_t, int>    generations;
+    };
+
+    class PhotoDecodeTask : public QRunnable
+    {
+    public:
+        PhotoDecodeTask( std::shared_ptr<PhotoDecoder::Requests> requests, const QString& dbFileName, int64_t contentId,
+                         int generation, const QSize& boundingSize ) noexcept
+            : m_requests( std::move( requests ) )
+            , m_dbFileName( dbFileName )
+            , m_contentId( contentId )
+            , m_generation( generation )
+            , m_boundingSize( boundingSize )
+        {}
+
+        void run() override
+        {
+            {
+                QMutexLocker locker( &m_requests->mutex );
+                if( !m_requests->owner || m_requests->generations.value( m_contentId ) != m_generation )
+                    return;
+            }
+
+            QImage image;
+            QSize fullSize;
+            QString errorString = "The photo can not be read";
+            {
+                auto db = ConnectionManager::reader( m_dbFileName );
+                if( db.isOpen() )
+                {
+                    BlobDevice photo( Database::getHandle( db ), PHOTO_CONTENTS_TABLE_NAME, "Photo", m_contentId );
+                    if( photo.open( QIODevice::ReadOnly ) )
+                    {
+                        image = Utility::DecodeImage( photo, m_boundingSize, &fullSize, &errorString );
+                        photo.close();
+                    }
+                }
+            }
+
+            if( !image.isNull() )
+                ImageCache::insert( m_contentId, PhotoDecoder::resolution( m_boundingSize ), { image, fullSize } );
+
+            QMutexLocker locker( &m_requests->mutex );
+            if( auto owner = m_requests->owner )
+            {
+                // delivered only when no cancel() or cancelAll() came in between
+                QMetaObject::invokeMethod( owner, [owner, requests = m_requests, contentId = m_contentId,
+                                                   generation = m_generation, image, fullSize, errorString]
+                {
+                    if( requests != owner->m_requests || !owner->isCurrent( contentId, generation ) )
+                        return;
+
+                    if( image.isNull() )
+                        emit owner->failed( contentId, errorString );
+                    else
+                        emit owner->decoded( contentId, image, fullSize );
+                }, Qt::QueuedConnection );
+            }
+        }
+
+    private:
+        std::shared_ptr<PhotoDecoder::Requests> m_requests;
+        QString                                 m_dbFileName;
+        int64_t                                 m_contentId;
+        int                                     m_generation;
+        QSize                                   m_boundingSize;
+    };
+
+
+//==========================================================================================
+
+
+    PhotoDecoder::PhotoDecoder( const QString& dbFileName, QObject* parent ) noexcept
+        : QObject( parent )
+        , m_dbFileName( dbFileName )
+        , m_requests( std::make_shared<Requests>() )
+    {
+        m_requests->owner = this;
+    }
+
+    PhotoDecoder::~PhotoDecoder()
+    {
+        detach();
+    }
+
+    void PhotoDecoder::decode( int64_t contentId, const QSize& boundingSize ) noexcept
+    {
+        int generation = 0;
+        {
+            QMutexLocker locker( &m_requests->mutex );
+            generation = m_requests->generations.value( contentId );
+        }
+
+        // A cached preview serves only the bounds it was decoded for, another screen may need more pixels
+        const auto cached = ImageCache::find( contentId, resolution( boundingSize ) );
+        if( cached && ( !boundingSize.isValid() || cached->image.size() == boundedSize( cached->fullSize, boundingSize ) ) )
+        {
+            // queued like a decoded photo, the caller may not expect the signal during the call
+            QMetaObject::invokeMethod( this, [this, requests = m_requests, contentId, generation, entry = *cached]
+            {
+                if( requests == m_requests && isCurrent( contentId, generation ) )
+                    emit decoded( contentId, entry.image, entry.fullSize );
+            }, Qt::QueuedConnection );
+            return;
+        }
+
+        auto task = new ( std::nothrow ) PhotoDecodeTask( m_requests, m_dbFileName, contentId, generation, boundingSize );
+        if( !task )
+        {
+            emit failed( contentId, "Not enough memory to decode the photo" );
+            return;
+        }
+        QThreadPool::globalInstance()->start( task );
+    }
+
+    void PhotoDecoder::cancel( int64_t contentId ) noexcept
+    {
+        QMutexLocker locker( &m_requests->mutex );
+        ++m_requests->generations[contentId];
+    }
+
+    void PhotoDecoder::cancelAll() noexcept
+    {
+        detach();
+        m_requests = std::make_shared<Requests>();
+        m_requests->owner = this;
+    }
+
+    QSize PhotoDecoder::boundedSize( const QSize& fullSize, const QSize& boundingSize ) noexcept
+    {
+        return fullSize.width() > boundingSize.width() || fullSize.height() > boundingSize.height()
+                   ? fullSize.scaled( boundingSize, Qt::KeepAspectRatio )
+                   : fullSize;
+    }
+
+    ImageCache::EResolution PhotoDecoder::resolution( const QSize& boundingSize ) noexcept
+    {
+        return boundingSize.isValid() ? ImageCache::EResolution::PREVIEW : ImageCache::EResolution::FULL;
+    }
+
+    void PhotoDecoder::detach() noexcept
+    {
+        QMutexLocker locker( &m_requests->mutex );
+        m_requests->owner = nullptr;
+    }
+
+    bool PhotoDecoder::isCurrent( int64_t contentId, int generation ) const noexcept
+    {
+        QMutexLocker locker( &m_requests->mutex );
+        return m_requests->generations.value( contentId ) == generation;
+    }
+}
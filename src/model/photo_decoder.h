@@ -0,0 +1,57 @@
+#ifndef PHOTODECODER_H
+#define PHOTODECODER_H
+
+#include <memory>
+
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QString>
+
+#include "model/image_cache.h"
+
+namespace PatientsDBManager
+{
+    // Decodes stored photos on the global thread pool, each pool thread reading
+    // through a reader connection of its own. A request gives the size the image
+    // has to fit in, so a preview near screen size is decoded without allocating
+    // the full resolution frame. Results arrive on the thread of the decoder;
+    // after cancel() or cancelAll() the requests made before it, of the photo
+    // or of all photos, are not reported and do not start if queued. Decoded
+    // images go to the ImageCache, so a photo decoded once is not decoded again
+    // by any viewer while it stays there.
+    class PhotoDecoder : public QObject
+    {
+        Q_OBJECT
+    public:
+        explicit PhotoDecoder( const QString& dbFileName, QObject* parent = nullptr ) noexcept;
+        ~PhotoDecoder() override;
+
+        // An invalid bounding size decodes at full resolution
+        void decode( int64_t contentId, const QSize& boundingSize ) noexcept;
+        void cancel( int64_t contentId ) noexcept;
+        void cancelAll() noexcept;
+
+    signals:
+        // fullSize is the stored size, image is smaller when it was bounded
+        void decoded( int64_t contentId, const QImage& image, const QSize& fullSize );
+        void failed( int64_t contentId, const QString& error );
+
+    private:
+        struct Requests;
+
+        QString                   m_dbFileName;
+        std::shared_ptr<Requests> m_requests;
+
+        void detach() noexcept;
+        bool isCurrent( int64_t contentId, int generation ) const noexcept;
+
+        // The size DecodeImage() gives a photo of fullSize within boundingSize
+        static QSize boundedSize( const QSize& fullSize, const QSize& boundingSize ) noexcept;
+        static ImageCache::EResolution resolution( const QSize& boundingSize ) noexcept;
+
+        friend class PhotoDecodeTask;
+    };
+}
+
+#endif // PHOTODECODER_H
@@ -0,0 +1,452 @@
+#include "photo_importer.h"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSqlError>
+
+#include "model/blob_device.h"
+#include "model/connection_manager.h"
+#include "model/database.h"
+#include "utility/global.h"
+#include "utility/hash.h"
+#include "utility/utility.h"
+
+namespace PatientsDBManager
+{
+    class ImportReadTask : public QRunnable
+    {
+    public:
+        ImportReadTask( PhotoImporter* importer, const QString& filePath, bool fullRead ) noexcept
+            : m_importer( importer )
+            , m_filePath( filePath )
+            , m_fullRead( fullRead )
+        {}
+
+        void run() override
+        {
+            m_importer->readFile( m_filePath, m_fullRead );
+            m_importer->readFinished();
+        }
+
+    private:
+        PhotoImporter* m_importer;
+        QString        m_filePath;
+        bool           m_fullRead;
+    };
+
+
+//==========================================================================================
+
+
+    PhotoImporter::PhotoImporter( const Database& db, int64_t patientId, const QStringList& files, QObject* parent ) noexcept
+        : QObject( parent )
+        , m_dbFileName( db.getFileName() )
+        , m_patientId( patientId )
+        , m_files( files )
+    {}
+
+    PhotoImporter::~PhotoImporter()
+    {
+        cancel();
+        if( m_writerThread )
+            m_writerThread->wait();
+        m_readerPool.waitForDone();
+    }
+
+    void PhotoImporter::start() noexcept
+    {
+        if( m_writerThread )
+            return;
+
+        m_pendingReads = m_files.size();
+
+        // The writer loads the known content keys first and then feeds the readers
+        m_writerThread = QThread::create( [this]{ writeBatches(); } );
+        m_writerThread->setParent( this );
+        m_writerThread->start();
+    }
+
+    void PhotoImporter::cancel() noexcept
+    {
+        m_canceled = true;
+
+        QMutexLocker locker( &m_queueMutex );
+        m_queueNotFull.wakeAll();
+        m_queueNotEmpty.wakeAll();
+    }
+
+    void PhotoImporter::readFile( const QString& filePath, bool fullRead ) noexcept
+    {
+        if( m_canceled )
+            return;
+
+        auto file = std::make_shared<QFile>( filePath );
+        if( !file->open( QIODevice::ReadOnly ) || file->size() == 0 )
+        {
+            reportFailure( filePath, "The file cannot be read or is empty" );
+            return;
+        }
+
+        const auto key = Utility::SampleKey( *file );
+        if( !key )
+        {
+            reportFailure( filePath, file->errorString() );
+            return;
+        }
+
+        QFileInfo fileInfo( filePath );
+        auto fileTime = fileInfo.fileTime( QFileDevice::FileBirthTime );
+        if( !fileTime.isValid() )
+            fileTime = QDateTime::currentDateTime();
+
+        ImportItem item{ filePath, fileInfo.baseName(), fileTime, *key };
+
+        bool knownKey = false;
+        if( !fullRead )
+        {
+            QMutexLocker locker( &m_keysMutex );
+            knownKey = m_knownKeys.contains( *key );
+        }
+
+        if( knownKey )
+        {
+            // Most likely a duplicate: only the hash is needed to confirm it
+            item.sha256 = Utility::Sha256( *file );
+        }
+        else
+        {
+            // The mapping is shared by the hash, the decoder and the writer
+            item.data = Utility::MapFile( *file );
+            if( item.data.isNull() )
+            {
+                reportFailure( filePath, file->errorString() );
+                return;
+            }
+            item.source = file;
+            item.sha256 = QCryptographicHash::hash( item.data, QCryptographicHash::Sha256 );
+
+            QBuffer buffer( &item.data );
+            buffer.open( QIODevice::ReadOnly );
+
+            // Producing the thumbnail decodes the whole stream, which also
+            // catches truncated or corrupted files.
+            QString errorString;
+            item.thumbnail = Utility::CreateThumbnail( buffer, Global::THUMBNAIL_SIZE, &errorString );
+            if( item.thumbnail.isEmpty() )
+            {
+                reportFailure( filePath, errorString );
+                return;
+            }
+        }
+
+        if( item.sha256.isEmpty() )
+        {
+            reportFailure( filePath, file->errorString() );
+            return;
+        }
+
+        QMutexLocker locker( &m_queueMutex );
+        while( m_queue.size() >= MAX_QUEUED_ITEMS && !m_canceled )
+            m_queueNotFull.wait( &m_queueMutex );
+
+        if( m_canceled )
+            return;
+
+        m_queue.enqueue( std::move( item ) );
+        m_queueNotEmpty.wakeOne();
+    }
+
+    void PhotoImporter::readFinished() noexcept
+    {
+        QMutexLocker locker( &m_queueMutex );
+        --m_pendingReads;
+        m_queueNotEmpty.wakeOne();
+    }
+
+    void PhotoImporter::reportFailure( const QString& filePath, const QString& reason ) noexcept
+    {
+        emit fileFailed( filePath, reason );
+        emit progressChanged( ++m_processed, m_files.size() );
+    }
+
+    void PhotoImporter::writeBatches() noexcept
+    {
+        int imported = 0;
+        {
+            auto db = ConnectionManager::writer( m_dbFileName );
+
+            // Statements are prepared once and re-bound for every photo
+            WriterStatements statements{ QSqlQuery( db ), QSqlQuery( db ), QSqlQuery( db ), QSqlQuery( db ),
+                                         QSqlQuery( db ) };
+            statements.findContent.setForwardOnly( true );
+
+            QSqlQuery selectKeys( db );
+            selectKeys.setForwardOnly( true );
+
+            const bool prepared =
+                    db.isOpen() &&
+                    statements.findContent.prepare( "SELECT Id FROM " + PHOTO_CONTENTS_TABLE_NAME + " WHERE Sha256 = ?;" ) &&
+                    statements.insertContent.prepare( "INSERT INTO " + PHOTO_CONTENTS_TABLE_NAME + " ( Hash, Sha256, Photo ) "
+                                                      "VALUES ( ?, ?, ? );" ) &&
+                    statements.insertEmptyContent.prepare( "INSERT INTO " + PHOTO_CONTENTS_TABLE_NAME +
+                                                           " ( Hash, Sha256, Photo ) VALUES ( ?, ?, zeroblob( ? ) );" ) &&
+                    statements.insertThumbnail.prepare( "INSERT OR IGNORE INTO " + PHOTO_THUMBNAILS_TABLE_NAME +
+                                                        " ( Content_Id, Thumbnail ) VALUES ( ?, ? );" ) &&
+                    statements.insertPhoto.prepare( "INSERT INTO " + PHOTOS_SET_TABLE_NAME +
+                                                    " ( Date, Filename, Patient_Id, Content_Id ) VALUES ( ?, ?, ?, ? );" ) &&
+                    selectKeys.exec( "SELECT Hash FROM " + PHOTO_CONTENTS_TABLE_NAME + ";" );
+            if( !prepared )
+            {
+                const auto& error = db.isOpen() ? selectKeys.lastError().text() +
+                                                  statements.findContent.lastError().text() +
+                                                  statements.insertContent.lastError().text() +
+                                                  statements.insertEmptyContent.lastError().text() +
+                                                  statements.insertThumbnail.lastError().text() +
+                                                  statements.insertPhoto.lastError().text()
+                                                : db.lastError().text();
+                qDebug() << "PhotoImporter::writeBatches: " + error;
+                emit fileFailed( m_dbFileName, error );
+                cancel();
+            }
+            else
+            {
+                QMutexLocker locker( &m_keysMutex );
+                while( selectKeys.next() )
+                    m_knownKeys.insert( static_cast<quint64>( selectKeys.value( 0 ).toLongLong() ) );
+            }
+            selectKeys.finish();
+
+            for( const auto& filePath : m_files )
+            {
+                if( m_canceled )
+                    break;
+                m_readerPool.start( new ImportReadTask( this, filePath, false ) );
+            }
+
+            QVector<ImportItem> batch;
+            while( !m_canceled )
+            {
+                {
+                    QMutexLocker locker( &m_queueMutex );
+                    while( m_queue.isEmpty() && m_pendingReads > 0 && !m_canceled )
+                        m_queueNotEmpty.wait( &m_queueMutex );
+
+                    if( m_canceled || ( m_queue.isEmpty() && m_pendingReads == 0 ) )
+                        break;
+
+                    qint64 batchBytes = 0;
+                    while( !m_queue.isEmpty() && batch.size() < BATCH_SIZE && batchBytes < BATCH_BYTES )
+                    {
+                        batch.append( m_queue.dequeue() );
+                        batchBytes += batch.last().data.size();
+                    }
+                    m_queueNotFull.wakeAll();
+                }
+
+                imported += writeBatch( batch, db, statements );
+                batch.clear();
+            }
+        }
+
+        qDebug() << QString( "PhotoImporter: %1 photos imported, %2 of them linked to already stored content" )
+                    .arg( imported )
+                    .arg( m_deduplicated );
+
+        emit finished( imported, m_canceled );
+    }
+
+    int PhotoImporter::writeBatch( const QVector<ImportItem>& batch, QSqlDatabase& db, WriterStatements& statements ) noexcept
+    {
+        // The write lock is held by one transaction at a time, so the edits and deletes
+        // of the GUI thread wait for a transaction, not for the whole batch
+        int written = 0;
+        for( int first = 0; first < batch.size() && !m_canceled; )
+            first = writeTransaction( batch, first, db, statements, written );
+
+        emit progressChanged( m_processed, m_files.size() );
+        return written;
+    }
+
+    int PhotoImporter::writeTransaction( const QVector<ImportItem>& batch, int first, QSqlDatabase& db,
+                                        WriterStatements& statements, int& written ) noexcept
+    {
+        // readers go on, the other writers of the file wait for the transaction
+        QMutexLocker writeLocker( ConnectionManager::writeMutex( m_dbFileName ) );
+
+        int end = first;
+        auto failTransaction = [&]( const QString& reason )
+        {
+            for( int i = first; i < qMin( end + 1, batch.size() ); ++i )
+                reportFailure( batch[i].filePath, reason );
+            return qMin( end + 1, batch.size() );
+        };
+
+        if( !db.transaction() )
+            return failTransaction( db.lastError().text() );
+
+        const auto deduplicated = m_deduplicated;
+
+        const auto handle = Database::getHandle( db );
+
+        // A large file is committed on its own and the transaction ends once its time
+        // budget is spent, with at least one file in it
+        QElapsedTimer lockTimer;
+        lockTimer.start();
+
+        QStringList retries;
+        QVector<qint64> photoIds;
+        for( ; end < batch.size(); ++end )
+        {
+            const bool large = batch[end].data.size() > LARGE_ITEM_BYTES;
+            if( end > first && ( large || lockTimer.elapsed() >= WRITE_LOCK_BUDGET_MS ) )
+                break;
+
+            if( !writeItem( batch[end], handle, statements, retries, photoIds ) )
+            {
+                m_deduplicated = deduplicated;
+                db.rollback();
+                return failTransaction( db.lastError().text() +
+                                        statements.findContent.lastError().text() +
+                                        statements.insertContent.lastError().text() +
+                                        statements.insertEmptyContent.lastError().text() +
+                                        statements.insertThumbnail.lastError().text() +
+                                        statements.insertPhoto.lastError().text() );
+            }
+
+            if( large )
+            {
+                ++end;
+                break;
+            }
+        }
+        --end;
+
+        // a cancel request discards the transaction that is still open
+        if( m_canceled )
+        {
+            db.rollback();
+            return batch.size();
+        }
+
+        if( !db.commit() )
+        {
+            const auto& error = db.lastError().text();
+            m_deduplicated = deduplicated;
+            db.rollback();
+            return failTransaction( error );
+        }
+        writeLocker.unlock();
+
+        {
+            QMutexLocker locker( &m_keysMutex );
+            for( int i = first; i <= end; ++i )
+                m_knownKeys.insert( batch[i].key );
+        }
+
+        // The sample key matched but the content did not: read these files in full
+        if( !retries.isEmpty() )
+        {
+            {
+                QMutexLocker locker( &m_queueMutex );
+                m_pendingReads += retries.size();
+            }
+            for( const auto& filePath : retries )
+                m_readerPool.start( new ImportReadTask( this, filePath, true ) );
+        }
+
+        const int committed = end - first + 1 - retries.size();
+        m_processed += committed;
+        written += committed;
+        if( !photoIds.isEmpty() )
+            emit photosAdded( photoIds );
+        return end + 1;
+    }
+
+    bool PhotoImporter::writeItem( const ImportItem& item, sqlite3* handle, WriterStatements& statements,
+                                   QStringList& retries, QVector<qint64>& photoIds ) noexcept
+    {
+        QVariant contentId;
+
+        statements.findContent.bindValue( 0, item.sha256 );
+        if( !statements.findContent.exec() )
+            return false;
+        if( statements.findContent.next() )
+            contentId = statements.findContent.value( 0 );
+        statements.findContent.finish();
+
+        if( contentId.isValid() )
+        {
+            ++m_deduplicated;
+        }
+        else if( item.data.isEmpty() )
+        {
+            retries.append( item.filePath );
+            return true;
+        }
+        else
+        {
+            if( !writeContent( item, handle, statements, contentId ) )
+                return false;
+
+            statements.insertThumbnail.bindValue( 0, contentId );
+            statements.insertThumbnail.bindValue( 1, item.thumbnail );
+            if( !statements.insertThumbnail.exec() )
+                return false;
+        }
+
+        statements.insertPhoto.bindValue( 0, Utility::DateTimeToDbValue( item.date ) );
+        statements.insertPhoto.bindValue( 1, item.fileName );
+        statements.insertPhoto.bindValue( 2, static_cast<qlonglong>( m_patientId ) );
+        statements.insertPhoto.bindValue( 3, contentId );
+        if( !statements.insertPhoto.exec() )
+            return false;
+
+        photoIds.append( statements.insertPhoto.lastInsertId().toLongLong() );
+        return true;
+    }
+
+    bool PhotoImporter::writeContent( const ImportItem& item, sqlite3* handle, WriterStatements& statements,
+                                      QVariant& contentId ) noexcept
+    {
+        // Small files are bound straight from the mapping
+        if( item.data.size() < STREAM_THRESHOLD )
+        {
+            statements.insertContent.bindValue( 0, static_cast<qlonglong>( item.key ) );
+            statements.insertContent.bindValue( 1, item.sha256 );
+            statements.insertContent.bindValue( 2, item.data );
+            if( !statements.insertContent.exec() )
+                return false;
+            contentId = statements.insertContent.lastInsertId();
+            return true;
+        }
+
+        // Large ones get a BLOB of their size that is filled chunk by chunk, so
+        // the statement never holds a copy of the whole file
+        statements.insertEmptyContent.bindValue( 0, static_cast<qlonglong>( item.key ) );
+        statements.insertEmptyContent.bindValue( 1, item.sha256 );
+        statements.insertEmptyContent.bindValue( 2, item.data.size() );
+        if( !statements.insertEmptyContent.exec() )
+            return false;
+        contentId = statements.insertEmptyContent.lastInsertId();
+
+        BlobDevice photo( handle, PHOTO_CONTENTS_TABLE_NAME, "Photo", contentId.toLongLong() );
+        if( !photo.open( QIODevice::WriteOnly ) )
+            return false;
+
+        for( qint64 offset = 0; offset < item.data.size(); offset += BLOB_CHUNK_SIZE )
+        {
+            const auto length = qMin( BLOB_CHUNK_SIZE, item.data.size() - offset );
+            if( photo.write( item.data.constData() + offset, length ) != length )
+            {
+                qDebug() << "PhotoImporter::writeContent: " + photo.errorString();
+                return false;
+            }
+        }
+        return true;
+    }
+}
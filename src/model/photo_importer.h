@@ -0,0 +1,130 @@
+#ifndef PHOTOIMPORTER_H
+#define PHOTOIMPORTER_H
+
+#include <atomic>
+#include <memory>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include <QVariant>
+#include <QVector>
+#include <QWaitCondition>
+
+struct sqlite3;
+
+namespace PatientsDBManager
+{
+    class Database;
+
+    // Imports a set of image files for one patient.
+    // Files are read, hashed, validated and thumbnailed in parallel on a thread pool;
+    // a single writer thread with its own connection commits them in batched
+    // transactions of at most WRITE_LOCK_BUDGET_MS, so the write lock of the file
+    // is not held for a whole batch. Payloads are content-addressed: a file whose sample key is
+    // already known is only hashed and, once the SHA-256 confirms it, linked to the
+    // stored payload without being decoded or written again.
+    // Files are memory mapped rather than read: hashing, decoding and writing all
+    // work on the mapping, and files from STREAM_THRESHOLD on are written into a
+    // zeroblob() in chunks of BLOB_CHUNK_SIZE instead of being bound whole.
+    // All signals are delivered to the importer's thread.
+    class PhotoImporter : public QObject
+    {
+        Q_OBJECT
+    public:
+        PhotoImporter( const Database& db, int64_t patientId, const QStringList& files, QObject* parent = nullptr ) noexcept;
+        ~PhotoImporter() override;
+
+        void start() noexcept;
+
+        int fileCount() const noexcept { return m_files.size(); }
+
+    public slots:
+        void cancel() noexcept;
+
+    signals:
+        void progressChanged( int processed, int total );
+        void fileFailed( const QString& filePath, const QString& reason );
+        // Ids of the PhotoSets rows of a committed batch
+        void photosAdded( const QVector<qint64>& photoIds );
+        void finished( int imported, bool canceled );
+
+    private:
+        struct ImportItem
+        {
+            QString    filePath;
+            QString    fileName;
+            QDateTime  date;
+            quint64    key{ 0 };
+            QByteArray sha256;
+            QByteArray data;        // empty for a probable duplicate, see Utility::MapFile()
+            QByteArray thumbnail;
+            std::shared_ptr<QFile> source;  // keeps the mapping of data alive
+        };
+
+        struct WriterStatements
+        {
+            QSqlQuery findContent;
+            QSqlQuery insertContent;
+            QSqlQuery insertEmptyContent;
+            QSqlQuery insertThumbnail;
+            QSqlQuery insertPhoto;
+        };
+
+        static constexpr int    BATCH_SIZE = 32;
+        static constexpr qint64 BATCH_BYTES = 64 * 1024 * 1024;
+        static constexpr qint64 LARGE_ITEM_BYTES = BATCH_BYTES / BATCH_SIZE;
+        static constexpr qint64 WRITE_LOCK_BUDGET_MS = 50;
+        static constexpr int    MAX_QUEUED_ITEMS = 2 * BATCH_SIZE;
+        static constexpr qint64 STREAM_THRESHOLD = 1024 * 1024;
+        static constexpr qint64 BLOB_CHUNK_SIZE = 256 * 1024;
+
+        QString     m_dbFileName;
+        int64_t     m_patientId{ 0 };
+        QStringList m_files;
+
+        QThreadPool m_readerPool;
+        QThread*    m_writerThread{ nullptr };
+
+        QMutex             m_queueMutex;
+        QWaitCondition     m_queueNotEmpty;
+        QWaitCondition     m_queueNotFull;
+        QQueue<ImportItem> m_queue;
+        int                m_pendingReads{ 0 };
+
+        QMutex        m_keysMutex;
+        QSet<quint64> m_knownKeys;
+
+        std::atomic_bool m_canceled{ false };
+        std::atomic_int  m_processed{ 0 };
+        int              m_deduplicated{ 0 };
+
+        void readFile( const QString& filePath, bool fullRead ) noexcept;
+        void writeBatches() noexcept;
+        int writeBatch( const QVector<ImportItem>& batch, QSqlDatabase& db, WriterStatements& statements ) noexcept;
+        // Commits the items from first on that fit into one transaction and returns
+        // the index of the first item left for the next one
+        int writeTransaction( const QVector<ImportItem>& batch, int first, QSqlDatabase& db,
+                              WriterStatements& statements, int& written ) noexcept;
+        bool writeItem( const ImportItem& item, sqlite3* handle, WriterStatements& statements, QStringList& retries,
+                        QVector<qint64>& photoIds ) noexcept;
+        bool writeContent( const ImportItem& item, sqlite3* handle, WriterStatements& statements,
+                           QVariant& contentId ) noexcept;
+
+        void reportFailure( const QString& filePath, const QString& reason ) noexcept;
+        void readFinished() noexcept;
+
+        friend class ImportReadTask;
+    };
+}
+
+#endif // PHOTOIMPORTER_H
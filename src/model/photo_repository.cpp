@@ -0,0 +1,172 @@
+#include "photo_repository.h"
+
+#include <utility>
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include "model/connection_manager.h"
+#include "model/database.h"
+#include "model/statement_cache.h"
+#include "utility/utility.h"
+
+namespace PatientsDBManager
+{
+    namespace
+    {
+        const QString PHOTOS_SELECT_STATEMENT = "SELECT " + Schema::SELECT_LIST<PhotoRepository::Table>.toString() +
+                                                " FROM " + PHOTOS_SET_TABLE_NAME;
+    }
+
+    PhotoRepository::PhotoRepository( const QSqlDatabase& db ) noexcept
+        : m_db( db )
+    {}
+
+    std::optional<QVector<PhotoInfo>> PhotoRepository::photosOf( std::optional<int64_t> patientId ) noexcept
+    {
+        if( !patientId )
+        {
+            auto query = statement( PHOTOS_SELECT_STATEMENT + " ORDER BY Id;" );
+            if( !query )
+                return std::nullopt;
+
+            return readPhotos( *query );
+        }
+
+        auto query = statement( PHOTOS_SELECT_STATEMENT + " WHERE Patient_Id = ? ORDER BY Id;" );
+        if( !query )
+            return std::nullopt;
+
+        query->bindValue( 0, static_cast<qlonglong>( *patientId ) );
+        return readPhotos( *query );
+    }
+
+    std::optional<QVector<PhotoInfo>> PhotoRepository::find( const QVector<qint64>& ids ) noexcept
+    {
+        if( ids.isEmpty() )
+            return QVector<PhotoInfo>();
+
+        // the text depends on the number of ids, so the statement is not cached
+        QSqlQuery query( m_db );
+        query.setForwardOnly( true );
+        if( !query.prepare( PHOTOS_SELECT_STATEMENT + " WHERE Id IN (" + Utility::IdList( ids ) + ") ORDER BY Id;" ) )
+        {
+            m_lastError = query.lastError();
+            return std::nullopt;
+        }
+
+        return readPhotos( query );
+    }
+
+    bool PhotoRepository::updateDate( int64_t id, const QDateTime& date ) noexcept
+    {
+        return updateColumn( Table::DATE, id, Schema::DbValue<Table, Table::DATE>( date ) );
+    }
+
+    bool PhotoRepository::updateFileName( int64_t id, const QString& fileName ) noexcept
+    {
+        return updateColumn( Table::FILENAME, id, Schema::DbValue<Table, Table::FILENAME>( fileName ) );
+    }
+
+    bool PhotoRepository::remove( const QVector<qint64>& ids ) noexcept
+    {
+        if( ids.isEmpty() )
+            return true;
+
+        QMutexLocker writeLocker( ConnectionManager::writeMutex( m_db.databaseName() ) );
+        if( !m_db.transaction() )
+        {
+            m_lastError = m_db.lastError();
+            return false;
+        }
+
+        QSqlQuery query( m_db );
+        if( !query.exec( "DELETE FROM " + PHOTOS_SET_TABLE_NAME + " WHERE Id IN (" + Utility::IdList( ids ) + ");" ) ||
+            !m_db.commit() )
+        {
+            m_lastError = query.lastError().isValid() ? query.lastError() : m_db.lastError();
+            qDebug() << "PhotoRepository::remove: " + m_lastError.text();
+            m_db.rollback();
+            return false;
+        }
+
+        return true;
+    }
+
+    std::optional<QByteArray> PhotoRepository::thumbnail( int64_t contentId ) noexcept
+    {
+        auto query = statement( "SELECT Thumbnail FROM " + PHOTO_THUMBNAILS_TABLE_NAME + " WHERE Content_Id = ?;" );
+        if( !query )
+            return std::nullopt;
+
+        query->bindValue( 0, static_cast<qlonglong>( contentId ) );
+        if( !query->exec() )
+        {
+            m_lastError = query->lastError();
+            return std::nullopt;
+        }
+
+        QByteArray thumbnail;
+        if( query->next() )
+            thumbnail = query->value( 0 ).toByteArray();
+        query->finish();
+
+        return thumbnail;
+    }
+
+    QSqlQuery* PhotoRepository::statement( const QString& sql ) noexcept
+    {
+        return StatementCache::statement( m_db, sql, m_lastError );
+    }
+
+    std::optional<QVector<PhotoInfo>> PhotoRepository::readPhotos( QSqlQuery& query ) noexcept
+    {
+        if( !query.exec() )
+        {
+            m_lastError = query.lastError();
+            return std::nullopt;
+        }
+
+        QVector<PhotoInfo> photos;
+        while( query.next() )
+        {
+            PhotoInfo photo;
+            photo.id = Schema::Value<Table, Table::ID>( query );
+            photo.date = Schema::Value<Table, Table::DATE>( query );
+            photo.fileName = Schema::Value<Table, Table::FILENAME>( query );
+            photo.patientId = Schema::Value<Table, Table::PATIENT_ID>( query );
+            photo.contentId = Schema::Value<Table, Table::CONTENT_ID>( query );
+            photos.append( std::move( photo ) );
+        }
+
+        const auto error = query.lastError();
+        query.finish();
+        if( error.isValid() )
+        {
+            m_lastError = error;
+            return std::nullopt;
+        }
+
+        return photos;
+    }
+
+    bool PhotoRepository::updateColumn( int column, int64_t id, const QVariant& value ) noexcept
+    {
+        auto query = statement( "UPDATE " + PHOTOS_SET_TABLE_NAME + " SET " + Schema::ColumnName<Table>( column ) +
+                                " = ? WHERE Id = ?;" );
+        if( !query )
+            return false;
+
+        query->bindValue( 0, value );
+        query->bindValue( 1, static_cast<qlonglong>( id ) );
+
+        if( !query->exec() )
+        {
+            m_lastError = query->lastError();
+            qDebug() << "PhotoRepository::updateColumn: " + m_lastError.text();
+            return false;
+        }
+
+        return true;
+    }
+}
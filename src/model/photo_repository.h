@@ -0,0 +1,54 @@
+#ifndef PHOTOREPOSITORY_H
+#define PHOTOREPOSITORY_H
+
+#include <optional>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include "model/data_types.h"
+#include "model/table_schema.h"
+
+namespace PatientsDBManager
+{
+    // Typed access to the photo sets and their thumbnails on one connection,
+    // with the statements of the StatementCache of the connection
+    class PhotoRepository
+    {
+    public:
+        using Table = Schema::PhotoSets;
+
+        explicit PhotoRepository( const QSqlDatabase& db ) noexcept;
+
+        // Photos ordered by Id, all of them without a patient
+        std::optional<QVector<PhotoInfo>> photosOf( std::optional<int64_t> patientId ) noexcept;
+        std::optional<QVector<PhotoInfo>> find( const QVector<qint64>& ids ) noexcept;
+
+        bool updateDate( int64_t id, const QDateTime& date ) noexcept;
+        bool updateFileName( int64_t id, const QString& fileName ) noexcept;
+
+        // Deletes the photos with one statement in one transaction
+        bool remove( const QVector<qint64>& ids ) noexcept;
+
+        // JPEG encoded thumbnail, empty while it is not created yet
+        std::optional<QByteArray> thumbnail( int64_t contentId ) noexcept;
+
+        QSqlError lastError() const noexcept { return m_lastError; }
+
+    private:
+        QSqlDatabase m_db;
+        QSqlError    m_lastError;
+
+        QSqlQuery* statement( const QString& sql ) noexcept;
+        std::optional<QVector<PhotoInfo>> readPhotos( QSqlQuery& query ) noexcept;
+        bool updateColumn( int column, int64_t id, const QVariant& value ) noexcept;
+    };
+}
+
+#endif // PHOTOREPOSITORY_H
@@ -0,0 +1,454 @@
+#include "photo_set_model.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <QDebug>
+#include <QImage>
+#include <QPixmap>
+#include <QStringList>
+
+#include "model/database.h"
+#include "utility/global.h"
+#include "utility/utility.h"
+
+namespace PatientsDBManager
+{
+    PhotoSetModel::PhotoSetModel( const QSqlDatabase& db, EditBuffer* editBuffer, QObject* parent ) noexcept
+        : QAbstractTableModel( parent )
+        , m_db( db )
+        , m_worker( db.databaseName() )
+        , m_editBuffer( editBuffer )
+        , m_repository( m_db )
+        , m_thumbnailWorker( db.databaseName() )
+    {
+        connect( &m_worker, &QueryWorker::busyChanged, this, &PhotoSetModel::busyChanged );
+
+        // keeps the row height while the thumbnail loads
+        QPixmap placeholder( Global::THUMBNAIL_SIZE, Global::THUMBNAIL_SIZE );
+        placeholder.fill( Qt::transparent );
+        m_thumbnailPlaceholder = QIcon( placeholder );
+
+        // The rows painted in one pass are collected into batches
+        m_thumbnailTimer.setSingleShot( true );
+        m_thumbnailTimer.setInterval( 0 );
+        connect( &m_thumbnailTimer, &QTimer::timeout, this, &PhotoSetModel::loadThumbnails );
+    }
+
+    int PhotoSetModel::rowCount( const QModelIndex& parent ) const
+    {
+        return parent.isValid() ? 0 : m_photos.size();
+    }
+
+    int PhotoSetModel::columnCount( const QModelIndex& parent ) const
+    {
+        return parent.isValid() ? 0 : COLUMN_COUNT;
+    }
+
+    QVariant PhotoSetModel::data( const QModelIndex& index, int role ) const
+    {
+        if( !index.isValid() || index.row() >= m_photos.size() )
+            return QVariant();
+
+        const auto& photo = m_photos[index.row()];
+
+        if( role == Qt::DecorationRole )
+            return index.column() == FILENAME ? QVariant( thumbnail( photo.contentId ) ) : QVariant();
+
+        if( role != Qt::DisplayRole && role != Qt::EditRole )
+            return QVariant();
+
+        switch( index.column() )
+        {
+            case ID:
+                return static_cast<qlonglong>( photo.id );
+            case DATE:
+                return Utility::DateTimeToDbValue( photo.date );
+            case FILENAME:
+                return photo.fileName;
+            case PATIENT_ID:
+                return static_cast<qlonglong>( photo.patientId );
+            default:
+                return QVariant();
+        }
+    }
+
+    bool PhotoSetModel::setData( const QModelIndex& index, const QVariant& value, int role )
+    {
+        if( !index.isValid() || role != Qt::EditRole || index.row() >= m_photos.size() )
+            return false;
+
+        if( index.column() != DATE && index.column() != FILENAME )
+            return false;
+
+        auto& photo = m_photos[index.row()];
+        if( m_editBuffer )
+            m_editBuffer->stage<Schema::PhotoSets>( photo.id, index.column(), value );
+        else if( !( index.column() == DATE ? m_repository.updateDate( photo.id, Utility::DateTimeFromDbValue( value ) )
+                                           : m_repository.updateFileName( photo.id, value.toString() ) ) )
+        {
+            m_lastError = m_repository.lastError();
+            return false;
+        }
+
+        setValue( photo, index.column(), value );
+
+        emit dataChanged( index, index, { Qt::DisplayRole, Qt::EditRole } );
+        return true;
+    }
+
+    QVariant PhotoSetModel::headerData( int section, Qt::Orientation orientation, int role ) const
+    {
+        if( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+            return QAbstractTableModel::headerData( section, orientation, role );
+
+        switch( section )
+        {
+            case ID:
+                return "Id";
+            case DATE:
+                return "Date";
+            case FILENAME:
+                return "Photo name";
+            case PATIENT_ID:
+                return "Patient_Id";
+            default:
+                return QVariant();
+        }
+    }
+
+    Qt::ItemFlags PhotoSetModel::flags( const QModelIndex& index ) const
+    {
+        auto flags = QAbstractTableModel::flags( index );
+        if( index.column() == DATE || index.column() == FILENAME )
+            flags |= Qt::ItemIsEditable;
+        return flags;
+    }
+
+    bool PhotoSetModel::removeRows( int row, int count, const QModelIndex& parent )
+    {
+        if( parent.isValid() || row < 0 || count <= 0 || row + count > m_photos.size() )
+            return false;
+
+        QVector<int> rows;
+        rows.reserve( count );
+        for( int i = row; i < row + count; ++i )
+            rows.append( i );
+
+        return removePhotos( rows );
+    }
+
+    bool PhotoSetModel::removePhotos( const QVector<int>& rows ) noexcept
+    {
+        const auto ranges = Utility::RowRanges( rows );
+
+        QVector<qint64> ids;
+        ids.reserve( rows.size() );
+        for( const auto& range : ranges )
+        {
+            if( range.first < 0 || range.second >= m_photos.size() )
+                return false;
+
+            for( int row = range.first; row <= range.second; ++row )
+                ids.append( m_photos[row].id );
+        }
+
+        if( ids.isEmpty() )
+            return true;
+
+        if( m_editBuffer )
+            m_editBuffer->flush();
+
+        if( !m_repository.remove( ids ) )
+        {
+            m_lastError = m_repository.lastError();
+            return false;
+        }
+
+        removeLoadedPhotos( ids );
+        return true;
+    }
+
+    bool PhotoSetModel::select() noexcept
+    {
+        m_worker.cancelAll();
+
+        const auto patientId = m_patientId;
+        m_worker.submit( [this, patientId]( const QSqlDatabase& db ) -> QueryWorker::Completion
+        {
+            PhotoRepository repository( db );
+            const auto photos = repository.photosOf( patientId );
+            if( !photos )
+            {
+                const auto error = repository.lastError();
+                return [this, error]
+                {
+                    m_lastError = error;
+                    qDebug() << "PhotoSetModel::select: " + m_lastError.text();
+                    emit queryFailed( m_lastError );
+                };
+            }
+
+            return [this, photos = *photos]
+            {
+                beginResetModel();
+                m_photos = photos;
+                for( auto& photo : m_photos )
+                    applyPendingEdits( photo );
+                endResetModel();
+
+                m_lastError = QSqlError();
+            };
+        } );
+
+        return true;
+    }
+
+    void PhotoSetModel::refreshPhotos( const QVector<qint64>& photoIds ) noexcept
+    {
+        if( photoIds.isEmpty() )
+            return;
+
+        m_worker.submit( [this, photoIds]( const QSqlDatabase& db ) -> QueryWorker::Completion
+        {
+            PhotoRepository repository( db );
+            const auto photos = repository.find( photoIds );
+            if( !photos )
+            {
+                const auto error = repository.lastError();
+                return [this, error]
+                {
+                    m_lastError = error;
+                    qDebug() << "PhotoSetModel::refreshPhotos: " + m_lastError.text();
+                    emit queryFailed( m_lastError );
+                };
+            }
+
+            return [this, photoIds, photos = *photos]
+            {
+                QSet<qint64> readIds;
+                for( const auto& photo : photos )
+                {
+                    if( !m_patientId || photo.patientId == *m_patientId )
+                    {
+                        readIds.insert( photo.id );
+                        updatePhoto( photo );
+                    }
+                }
+
+                // the rest were deleted or moved to another patient
+                QVector<qint64> removedIds;
+                for( const auto id : photoIds )
+                {
+                    if( !readIds.contains( id ) )
+                        removedIds.append( id );
+                }
+                removeLoadedPhotos( removedIds );
+            };
+        } );
+    }
+
+    void PhotoSetModel::applyChanges( const RowChanges& changes ) noexcept
+    {
+        removeLoadedPhotos( changes.deleted );
+        refreshPhotos( changes.inserted + changes.updated );
+    }
+
+    void PhotoSetModel::updatePhoto( PhotoInfo photo ) noexcept
+    {
+        applyPendingEdits( photo );
+
+        // Rows are ordered by Id, new photos mostly land at the end
+        auto position = std::lower_bound( m_photos.begin(), m_photos.end(), photo.id,
+                                          []( const PhotoInfo& info, int64_t id ){ return info.id < id; } );
+        const int row = static_cast<int>( position - m_photos.begin() );
+
+        if( position != m_photos.end() && position->id == photo.id )
+        {
+            if( position->contentId != photo.contentId )
+                m_thumbnails.remove( position->contentId );
+
+            *position = photo;
+            emit dataChanged( index( row, 0 ), index( row, COLUMN_COUNT - 1 ) );
+            return;
+        }
+
+        beginInsertRows( QModelIndex(), row, row );
+        m_photos.insert( row, photo );
+        endInsertRows();
+    }
+
+    void PhotoSetModel::removeLoadedPhotos( const QVector<qint64>& photoIds ) noexcept
+    {
+        if( photoIds.isEmpty() )
+            return;
+
+        QSet<qint64> ids;
+        for( const auto id : photoIds )
+            ids.insert( id );
+
+        QVector<int> rows;
+        for( int row = 0; row < m_photos.size(); ++row )
+        {
+            if( ids.contains( m_photos[row].id ) )
+                rows.append( row );
+        }
+
+        for( const auto& range : Utility::RowRanges( rows ) )
+        {
+            beginRemoveRows( QModelIndex(), range.first, range.second );
+            m_photos.remove( range.first, range.second - range.first + 1 );
+            endRemoveRows();
+        }
+    }
+
+    void PhotoSetModel::setPatientId( int64_t patientId ) noexcept
+    {
+        // the photos of the previous patient are not shown while the new ones load
+        if( m_patientId != patientId )
+        {
+            cancelThumbnails();
+            beginResetModel();
+            m_photos.clear();
+            endResetModel();
+        }
+
+        m_patientId = patientId;
+        select();
+    }
+
+    void PhotoSetModel::refreshThumbnails( const QVector<qint64>& contentIds ) noexcept
+    {
+        // a read still in progress may have missed the new thumbnail, its result is dropped
+        for( const auto contentId : contentIds )
+        {
+            m_thumbnails.remove( contentId );
+            m_requestedThumbnails.remove( contentId );
+        }
+
+        for( int row = 0; row < m_photos.size(); ++row )
+        {
+            if( contentIds.contains( m_photos[row].contentId ) )
+            {
+                const auto& cell = index( row, FILENAME );
+                emit dataChanged( cell, cell, { Qt::DecorationRole } );
+            }
+        }
+    }
+
+    QIcon PhotoSetModel::thumbnail( int64_t contentId ) const noexcept
+    {
+        if( auto cached = m_thumbnails.object( contentId ) )
+            return *cached;
+
+        if( !m_requestedThumbnails.contains( contentId ) )
+        {
+            m_requestedThumbnails.insert( contentId, ++m_thumbnailRequests );
+            m_thumbnailQueue.append( contentId );
+            if( !m_thumbnailTimer.isActive() )
+                m_thumbnailTimer.start();
+        }
+        return m_thumbnailPlaceholder;
+    }
+
+    bool PhotoSetModel::hasThumbnail( int row ) const noexcept
+    {
+        if( row < 0 || row >= m_photos.size() )
+            return false;
+
+        const auto cached = m_thumbnails.object( m_photos[row].contentId );
+        return cached && !cached->isNull();
+    }
+
+    void PhotoSetModel::loadThumbnails() noexcept
+    {
+        // ids refreshed since they were queued are requested again by the view
+        QVector<QPair<qint64, quint64>> queue;
+        for( const auto contentId : std::exchange( m_thumbnailQueue, QVector<qint64>() ) )
+        {
+            if( m_requestedThumbnails.contains( contentId ) )
+                queue.append( qMakePair( contentId, m_requestedThumbnails.value( contentId ) ) );
+        }
+
+        for( int first = 0; first < queue.size(); first += THUMBNAIL_BATCH_SIZE )
+        {
+            const auto requests = queue.mid( first, THUMBNAIL_BATCH_SIZE );
+            m_thumbnailWorker.submit( [this, requests]( const QSqlDatabase& db ) -> QueryWorker::Completion
+            {
+                // QPixmap belongs to the GUI thread, the JPEGs are decoded into images here
+                PhotoRepository repository( db );
+                QVector<QImage> images;
+                images.reserve( requests.size() );
+                for( const auto& request : requests )
+                {
+                    QImage image;
+                    const auto data = repository.thumbnail( request.first );
+                    if( data && !data->isEmpty() )
+                        image.loadFromData( *data, "JPG" );
+                    images.append( image );
+                }
+
+                return [this, requests, images]
+                {
+                    // A missing thumbnail is cached as a null icon until the backfill job
+                    // reports it through refreshThumbnails(). A read that was made before
+                    // the refresh is dropped.
+                    QSet<qint64> loaded;
+                    for( int i = 0; i < requests.size(); ++i )
+                    {
+                        const auto contentId = requests[i].first;
+                        if( m_requestedThumbnails.value( contentId ) != requests[i].second )
+                            continue;
+
+                        m_requestedThumbnails.remove( contentId );
+                        loaded.insert( contentId );
+                        const auto icon = images[i].isNull() ? QIcon() : QIcon( QPixmap::fromImage( images[i] ) );
+                        m_thumbnails.insert( contentId, new QIcon( icon ) );
+                    }
+
+                    for( int row = 0; row < m_photos.size(); ++row )
+                    {
+                        if( loaded.contains( m_photos[row].contentId ) )
+                        {
+                            const auto& cell = index( row, FILENAME );
+                            emit dataChanged( cell, cell, { Qt::DecorationRole } );
+                        }
+                    }
+                };
+            } );
+        }
+    }
+
+    void PhotoSetModel::cancelThumbnails() noexcept
+    {
+        m_thumbnailWorker.cancelAll();
+        m_thumbnailTimer.stop();
+        m_thumbnailQueue.clear();
+        m_requestedThumbnails.clear();
+    }
+
+    void PhotoSetModel::applyPendingEdits( PhotoInfo& photo ) const noexcept
+    {
+        if( !m_editBuffer || m_editBuffer->isEmpty() )
+            return;
+
+        for( const auto column : { DATE, FILENAME } )
+        {
+            if( const auto value = m_editBuffer->pendingValue<Schema::PhotoSets>( photo.id, column ) )
+                setValue( photo, column, *value );
+        }
+    }
+
+    void PhotoSetModel::setValue( PhotoInfo& photo, int column, const QVariant& value ) noexcept
+    {
+        if( column == DATE )
+            photo.date = Utility::DateTimeFromDbValue( value );
+        else if( column == FILENAME )
+            photo.fileName = value.toString();
+    }
+
+    int64_t PhotoSetModel::photoId( int row ) const noexcept
+    {
+        return ( row >= 0 && row < m_photos.size() ) ? m_photos[row].id : 0;
+    }
+}
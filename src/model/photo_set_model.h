@@ -0,0 +1,112 @@
+#ifndef PHOTOSETMODEL_H
+#define PHOTOSETMODEL_H
+
+#include <optional>
+
+#include <QAbstractTableModel>
+#include <QCache>
+#include <QHash>
+#include <QIcon>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QTimer>
+#include <QVector>
+
+#include "model/data_types.h"
+#include "model/edit_buffer.h"
+#include "model/photo_repository.h"
+#include "model/query_worker.h"
+
+namespace PatientsDBManager
+{
+    // Read/write model over the photo metadata of PhotoSets. The image payload
+    // is never selected; it is streamed on demand by a PhotoDecoder.
+    // The file name column carries the photo thumbnail as its decoration.
+    // Photo sets are selected on a QueryWorker, a newer select() cancels the older one.
+    // Thumbnails are read and decoded in batches on a worker of their own, a
+    // blank placeholder is shown until they arrive.
+    class PhotoSetModel : public QAbstractTableModel
+    {
+        Q_OBJECT
+    public:
+        // Content_Id is read with the other columns but not shown
+        enum EColumn : int
+        {
+            ID = Schema::PhotoSets::ID,
+            DATE = Schema::PhotoSets::DATE,
+            FILENAME = Schema::PhotoSets::FILENAME,
+            PATIENT_ID = Schema::PhotoSets::PATIENT_ID,
+            COLUMN_COUNT = Schema::PhotoSets::CONTENT_ID
+        };
+
+        // Edits are staged in editBuffer when it is given, otherwise written at once
+        explicit PhotoSetModel( const QSqlDatabase& db, EditBuffer* editBuffer = nullptr,
+                                QObject* parent = nullptr ) noexcept;
+
+        int rowCount( const QModelIndex& parent = QModelIndex() ) const override;
+        int columnCount( const QModelIndex& parent = QModelIndex() ) const override;
+        QVariant data( const QModelIndex& index, int role = Qt::DisplayRole ) const override;
+        bool setData( const QModelIndex& index, const QVariant& value, int role = Qt::EditRole ) override;
+        QVariant headerData( int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const override;
+        Qt::ItemFlags flags( const QModelIndex& index ) const override;
+        bool removeRows( int row, int count, const QModelIndex& parent = QModelIndex() ) override;
+
+        // Starts reading the photo set, failures are reported by queryFailed()
+        bool select() noexcept;
+        void setPatientId( int64_t patientId ) noexcept;
+
+        // Deletes the photos of the rows with one statement in one transaction
+        bool removePhotos( const QVector<int>& rows ) noexcept;
+
+        int64_t photoId( int row ) const noexcept;
+        const PhotoInfo& photo( int row ) const noexcept { return m_photos[row]; }
+        // false while the thumbnail is loading or when the photo has none
+        bool hasThumbnail( int row ) const noexcept;
+
+        bool isBusy() const noexcept { return m_worker.isBusy(); }
+
+        QSqlError lastError() const noexcept { return m_lastError; }
+
+    public slots:
+        void refreshThumbnails( const QVector<qint64>& contentIds ) noexcept;
+        // Reads the given photos again: those of the current patient are inserted
+        // or updated, the rest are removed from the model
+        void refreshPhotos( const QVector<qint64>& photoIds ) noexcept;
+        void applyChanges( const RowChanges& changes ) noexcept;
+
+    signals:
+        void busyChanged( bool busy );
+        void queryFailed( const QSqlError& error );
+
+    private:
+        static constexpr int THUMBNAIL_CACHE_SIZE = 512;
+        static constexpr int THUMBNAIL_BATCH_SIZE = 32;
+
+        QSqlDatabase           m_db;
+        QueryWorker            m_worker;
+        EditBuffer*            m_editBuffer{ nullptr };
+        QVector<PhotoInfo>     m_photos;
+        std::optional<int64_t> m_patientId;
+        QSqlError              m_lastError;
+
+        PhotoRepository                m_repository;
+        QueryWorker                    m_thumbnailWorker;
+        QIcon                          m_thumbnailPlaceholder;
+        mutable QCache<qint64, QIcon>  m_thumbnails{ THUMBNAIL_CACHE_SIZE };
+        mutable QHash<qint64, quint64> m_requestedThumbnails;     // queued or being read, by request number
+        mutable quint64                m_thumbnailRequests{ 0 };
+        mutable QVector<qint64>        m_thumbnailQueue;
+        mutable QTimer                 m_thumbnailTimer;
+
+        QIcon thumbnail( int64_t contentId ) const noexcept;
+        void loadThumbnails() noexcept;
+        void cancelThumbnails() noexcept;
+        void updatePhoto( PhotoInfo photo ) noexcept;
+        void applyPendingEdits( PhotoInfo& photo ) const noexcept;
+        static void setValue( PhotoInfo& photo, int column, const QVariant& value ) noexcept;
+        void removeLoadedPhotos( const QVector<qint64>& photoIds ) noexcept;
+    };
+}
+
+#endif // PHOTOSETMODEL_H
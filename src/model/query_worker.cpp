@@ -0,0 +1,121 @@
+#include "query_worker.h"
+
+#include <QDebug>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QSqlError>
+
+#include <sqlite3.h>
+
+#include "model/connection_manager.h"
+#include "model/database.h"
+
+namespace PatientsDBManager
+{
+    QueryWorker::QueryWorker( const QString& dbFileName, QObject* parent ) noexcept
+        : QObject( parent )
+        , m_dbFileName( dbFileName )
+    {
+        m_workerThread = QThread::create( [this]{ run(); } );
+        m_workerThread->setParent( this );
+        m_workerThread->start();
+    }
+
+    QueryWorker::~QueryWorker()
+    {
+        {
+            QMutexLocker locker( &m_mutex );
+            m_stopped = true;
+            m_jobs.clear();
+            if( m_running && m_handle )
+                sqlite3_interrupt( m_handle );
+            m_jobAvailable.wakeAll();
+        }
+        m_workerThread->wait();
+    }
+
+    void QueryWorker::submit( Job job ) noexcept
+    {
+        {
+            QMutexLocker locker( &m_mutex );
+            m_jobs.enqueue( QueuedJob{ std::move( job ), m_generation } );
+            m_jobAvailable.wakeOne();
+        }
+
+        if( m_pendingJobs++ == 0 )
+            emit busyChanged( true );
+    }
+
+    void QueryWorker::cancelAll() noexcept
+    {
+        {
+            QMutexLocker locker( &m_mutex );
+            ++m_generation;
+            m_pendingJobs -= m_jobs.size();
+            m_jobs.clear();
+
+            // sqlite3_interrupt() would also stop a statement started afterwards
+            // if none is running now
+            if( m_running && m_handle )
+                sqlite3_interrupt( m_handle );
+        }
+
+        if( m_pendingJobs == 0 )
+            emit busyChanged( false );
+    }
+
+    void QueryWorker::run() noexcept
+    {
+        // the reader of this thread, closed when the thread finishes
+        auto db = ConnectionManager::reader( m_dbFileName );
+        if( !db.isOpen() )
+            qDebug() << "QueryWorker::run: " + db.lastError().text();
+
+        {
+            QMutexLocker locker( &m_mutex );
+            m_handle = db.isOpen() ? Database::getHandle( db ) : nullptr;
+        }
+
+        forever
+        {
+            QueuedJob queued;
+            {
+                QMutexLocker locker( &m_mutex );
+                while( m_jobs.isEmpty() && !m_stopped )
+                    m_jobAvailable.wait( &m_mutex );
+
+                if( m_stopped )
+                    break;
+
+                queued = m_jobs.dequeue();
+                m_running = true;
+            }
+
+            auto completion = queued.job( db );
+
+            {
+                QMutexLocker locker( &m_mutex );
+                m_running = false;
+            }
+
+            const auto generation = queued.generation;
+            QMetaObject::invokeMethod( this, [this, generation, completion]{ deliver( generation, completion ); },
+                                       Qt::QueuedConnection );
+        }
+
+        QMutexLocker locker( &m_mutex );
+        m_handle = nullptr;
+    }
+
+    void QueryWorker::deliver( quint64 generation, const Completion& completion ) noexcept
+    {
+        --m_pendingJobs;
+
+        // m_generation only changes on this thread
+        if( generation == m_generation && completion )
+            completion();
+
+        if( m_pendingJobs == 0 )
+            emit busyChanged( false );
+    }
+}
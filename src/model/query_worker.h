@@ -0,0 +1,65 @@
+#ifndef QUERYWORKER_H
+#define QUERYWORKER_H
+
+#include <functional>
+
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QSqlDatabase>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+struct sqlite3;
+
+namespace PatientsDBManager
+{
+    // Runs the queries of a model on a connection and a thread of its own.
+    // A job is executed on the worker connection and returns the completion
+    // that applies its result; completions are called on the thread that owns
+    // the worker, in submission order. cancelAll() drops the queued jobs and
+    // interrupts the running one, so a superseded query never reaches the model.
+    class QueryWorker : public QObject
+    {
+        Q_OBJECT
+    public:
+        using Completion = std::function<void()>;
+        using Job = std::function<Completion( const QSqlDatabase& db )>;
+
+        explicit QueryWorker( const QString& dbFileName, QObject* parent = nullptr ) noexcept;
+        ~QueryWorker() override;
+
+        void submit( Job job ) noexcept;
+        void cancelAll() noexcept;
+
+        bool isBusy() const noexcept { return m_pendingJobs > 0; }
+
+    signals:
+        void busyChanged( bool busy );
+
+    private:
+        struct QueuedJob
+        {
+            Job     job;
+            quint64 generation{ 0 };
+        };
+
+        QString  m_dbFileName;
+        QThread* m_workerThread{ nullptr };
+        int      m_pendingJobs{ 0 };
+
+        QMutex            m_mutex;
+        QWaitCondition    m_jobAvailable;
+        QQueue<QueuedJob> m_jobs;
+        quint64           m_generation{ 0 };
+        bool              m_running{ false };
+        bool              m_stopped{ false };
+        sqlite3*          m_handle{ nullptr };
+
+        void run() noexcept;
+        void deliver( quint64 generation, const Completion& completion ) noexcept;
+    };
+}
+
+#endif // QUERYWORKER_H
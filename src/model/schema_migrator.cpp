@@ -0,0 +1,356 @@
+#include "schema_migrator.h"
+
+#include <limits>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSqlError>
+#include <QStringList>
+#include <QThread>
+
+namespace PatientsDBManager
+{
+    namespace
+    {
+        const QString PROGRESS_TABLE_NAME = "SchemaMigrationProgress";
+
+        // Pause between chunks that lets writers of other connections take the lock
+        constexpr unsigned long CHUNK_PAUSE_MS = 20;
+    }
+
+    SchemaMigrator::SchemaMigrator( const QSqlDatabase& db ) noexcept
+        : m_db( db )
+    {}
+
+    void SchemaMigrator::addMigration( int version, const QString& description, const std::function<bool()>& apply )
+    {
+        Q_ASSERT( m_migrations.isEmpty() || m_migrations.last().version < version );
+        m_migrations.append( Migration{ version, description, apply } );
+    }
+
+    int SchemaMigrator::latestVersion() const noexcept
+    {
+        return m_migrations.isEmpty() ? 0 : m_migrations.last().version;
+    }
+
+    int SchemaMigrator::version() const noexcept
+    {
+        QSqlQuery query( m_db );
+        if( !query.exec( "PRAGMA user_version;" ) || !query.next() )
+        {
+            qDebug() << "SchemaMigrator::version: " + query.lastError().text();
+            return -1;
+        }
+        return query.value( 0 ).toInt();
+    }
+
+    bool SchemaMigrator::setVersion( int version ) noexcept
+    {
+        QSqlQuery query( m_db );
+        if( !query.exec( QString( "PRAGMA user_version = %1;" ).arg( version ) ) )
+        {
+            qDebug() << "SchemaMigrator::setVersion: " + query.lastError().text();
+            return false;
+        }
+        return true;
+    }
+
+    bool SchemaMigrator::migrate() noexcept
+    {
+        const int currentVersion = version();
+        if( currentVersion < 0 )
+            return false;
+
+        if( currentVersion > latestVersion() )
+        {
+            qDebug() << QString( "SchemaMigrator::migrate: the schema version %1 is newer than the supported %2" )
+                        .arg( currentVersion )
+                        .arg( latestVersion() );
+            return false;
+        }
+
+        if( currentVersion == latestVersion() )
+            return true;
+
+        QSqlQuery query( m_db );
+        if( !query.exec( "CREATE TABLE IF NOT EXISTS " + PROGRESS_TABLE_NAME + " ("
+                         "'Step'	TEXT NOT NULL PRIMARY KEY,"
+                         "'LastRowId'	INTEGER NOT NULL );" ) )
+        {
+            qDebug() << "SchemaMigrator::migrate: " + query.lastError().text();
+            return false;
+        }
+
+        for( const auto& migration : m_migrations )
+        {
+            if( migration.version <= currentVersion )
+                continue;
+
+            QElapsedTimer timer;
+            timer.start();
+
+            m_currentVersion = migration.version;
+            if( !migration.apply() || !setVersion( migration.version ) )
+            {
+                qDebug() << QString( "SchemaMigrator::migrate: migration %1 (%2) failed" )
+                            .arg( migration.version )
+                            .arg( migration.description );
+                return false;
+            }
+
+            qDebug() << QString( "SchemaMigrator: migration %1 (%2) applied in %3 ms" )
+                        .arg( migration.version )
+                        .arg( migration.description )
+                        .arg( timer.elapsed() );
+        }
+
+        dropProgress();
+        return true;
+    }
+
+    bool SchemaMigrator::runInChunks( const QString& step, const ChunkFunction& chunk ) noexcept
+    {
+        QElapsedTimer totalTimer;
+        totalTimer.start();
+
+        const QString progressStep = QString( "%1: %2" ).arg( m_currentVersion ).arg( step );
+
+        int chunkSize = INITIAL_CHUNK_ROWS;
+        qint64 totalRows = 0;
+        forever
+        {
+            QElapsedTimer timer;
+            timer.start();
+
+            int processedRows = 0;
+            if( !runChunk( progressStep, chunk, chunkSize, processedRows ) )
+                return false;
+
+            totalRows += processedRows;
+            if( processedRows < chunkSize )
+                break;
+
+            // Keep every transaction close to the time budget whatever the row size is
+            const auto elapsed = timer.elapsed();
+            if( elapsed < CHUNK_TIME_BUDGET_MS / 2 )
+                chunkSize = qMin( chunkSize * 2, MAX_CHUNK_ROWS );
+            else if( elapsed > CHUNK_TIME_BUDGET_MS )
+                chunkSize = qMax( chunkSize / 2, 1 );
+
+            QThread::msleep( CHUNK_PAUSE_MS );
+        }
+
+        qDebug() << QString( "SchemaMigrator: %1: %2 rows in %3 ms" )
+                    .arg( progressStep )
+                    .arg( totalRows )
+                    .arg( totalTimer.elapsed() );
+        return true;
+    }
+
+    bool SchemaMigrator::runChunk( const QString& step, const ChunkFunction& chunk, int chunkSize, int& processedRows ) noexcept
+    {
+        // IMMEDIATE takes the write lock up front, so the cursor read below cannot
+        // be outdated by another connection migrating the same file
+        QSqlQuery query( m_db );
+        if( !query.exec( "BEGIN IMMEDIATE;" ) )
+        {
+            qDebug() << "SchemaMigrator::runChunk: " + query.lastError().text();
+            return false;
+        }
+
+        auto rollback = [&]( const QString& error )
+        {
+            qDebug() << QString( "SchemaMigrator::runChunk: %1: %2" ).arg( step ).arg( error );
+            query.exec( "ROLLBACK;" );
+            return false;
+        };
+
+        qint64 lastRowId = std::numeric_limits<qint64>::min();
+        query.prepare( "SELECT LastRowId FROM " + PROGRESS_TABLE_NAME + " WHERE Step = ?;" );
+        query.bindValue( 0, step );
+        if( !query.exec() )
+            return rollback( query.lastError().text() );
+        if( query.next() )
+            lastRowId = query.value( 0 ).toLongLong();
+        query.finish();
+
+        processedRows = 0;
+        if( !chunk( lastRowId, chunkSize, processedRows ) )
+            return rollback( "the chunk was not processed" );
+
+        if( processedRows > 0 )
+        {
+            query.prepare( "INSERT OR REPLACE INTO " + PROGRESS_TABLE_NAME + " ( Step, LastRowId ) VALUES ( ?, ? );" );
+            query.bindValue( 0, step );
+            query.bindValue( 1, lastRowId );
+            if( !query.exec() )
+                return rollback( query.lastError().text() );
+        }
+
+        if( !query.exec( "COMMIT;" ) )
+            return rollback( query.lastError().text() );
+
+        return true;
+    }
+
+    bool SchemaMigrator::copyInChunks( const QString& step, const QString& sourceTable,
+                                       const QString& keyColumn, const QString& copyStatement ) noexcept
+    {
+        const auto& key = keyColumn;
+
+        QSqlQuery selectRange( m_db );
+        QSqlQuery copyRange( m_db );
+        selectRange.setForwardOnly( true );
+        if( !selectRange.prepare( "SELECT MAX( " + key + " ), COUNT(*) FROM "
+                                  "( SELECT " + key + " FROM " + sourceTable + " WHERE " + key + " > ? ORDER BY " + key + " LIMIT ? );" ) ||
+            !copyRange.prepare( copyStatement ) )
+        {
+            qDebug() << "SchemaMigrator::copyInChunks: " + selectRange.lastError().text() + copyRange.lastError().text();
+            return false;
+        }
+
+        return runInChunks( step, [&]( qint64& lastRowId, int chunkSize, int& processedRows )
+        {
+            selectRange.bindValue( 0, lastRowId );
+            selectRange.bindValue( 1, chunkSize );
+            if( !selectRange.exec() || !selectRange.next() )
+                return false;
+
+            processedRows = selectRange.value( 1 ).toInt();
+            const auto upperRowId = selectRange.value( 0 ).toLongLong();
+            selectRange.finish();
+
+            if( processedRows == 0 )
+                return true;
+
+            copyRange.bindValue( 0, lastRowId );
+            copyRange.bindValue( 1, upperRowId );
+            if( !copyRange.exec() )
+            {
+                qDebug() << "SchemaMigrator::copyInChunks: " + copyRange.lastError().text();
+                return false;
+            }
+
+            lastRowId = upperRowId;
+            return true;
+        } );
+    }
+
+    bool SchemaMigrator::rewriteTable( const TableRewrite& rewrite ) noexcept
+    {
+        const auto& table = rewrite.tableName;
+        const auto& key = rewrite.keyColumn;
+        const QString newTable = table + "_new";
+
+        // The shadow table and the mirroring triggers survive an interruption
+        // and are reused when the rewrite resumes
+        const QStringList triggers{
+            "CREATE TRIGGER IF NOT EXISTS " + table + "_Rewrite_Insert AFTER INSERT ON " + table + " "
+            "BEGIN "
+                "INSERT OR REPLACE INTO " + newTable + " ( " + rewrite.columns + " ) "
+                "SELECT " + rewrite.selectList + " FROM " + table + " WHERE " + key + " = NEW." + key + "; "
+            "END;",
+
+            "CREATE TRIGGER IF NOT EXISTS " + table + "_Rewrite_Update AFTER UPDATE ON " + table + " "
+            "BEGIN "
+                "DELETE FROM " + newTable + " WHERE " + key + " = OLD." + key + " AND OLD." + key + " <> NEW." + key + "; "
+                "INSERT OR REPLACE INTO " + newTable + " ( " + rewrite.columns + " ) "
+                "SELECT " + rewrite.selectList + " FROM " + table + " WHERE " + key + " = NEW." + key + "; "
+            "END;",
+
+            "CREATE TRIGGER IF NOT EXISTS " + table + "_Rewrite_Delete AFTER DELETE ON " + table + " "
+            "BEGIN "
+                "DELETE FROM " + newTable + " WHERE " + key + " = OLD." + key + "; "
+            "END;" };
+
+        const bool prepared = changeSchema( "SchemaMigrator::rewriteTable", [&]( QSqlQuery& query )
+        {
+            if( !m_db.tables().contains( newTable ) && !rewrite.createTable( newTable ) )
+                return false;
+
+            for( const auto& trigger : triggers )
+            {
+                if( !query.exec( trigger ) )
+                    return false;
+            }
+            return true;
+        } );
+        if( !prepared )
+            return false;
+
+        const bool copied = copyInChunks( "rewrite " + table, table, key,
+                                          "INSERT OR REPLACE INTO " + newTable + " ( " + rewrite.columns + " ) "
+                                          "SELECT " + rewrite.selectList + " FROM " + table + " "
+                                          "WHERE " + key + " > ? AND " + key + " <= ?;" );
+        if( !copied )
+            return false;
+
+        // Dropping the old table drops the mirroring triggers with it
+        return changeSchema( "SchemaMigrator::rewriteTable", [&]( QSqlQuery& query )
+        {
+            // another connection may have completed the same rewrite meanwhile
+            if( !m_db.tables().contains( newTable ) )
+                return true;
+
+            return query.exec( "DROP TABLE " + table + ";" ) &&
+                   query.exec( "ALTER TABLE " + newTable + " RENAME TO " + table + ";" ) &&
+                   rewrite.finish();
+        } );
+    }
+
+    bool SchemaMigrator::changeSchema( const QString& caller, const std::function<bool( QSqlQuery& )>& change ) noexcept
+    {
+        // Foreign keys have to be off while tables are swapped,
+        // and the pragma is a no-op inside a transaction
+        QSqlQuery query( m_db );
+        if( !setForeignKeys( false ) || !query.exec( "BEGIN IMMEDIATE;" ) )
+        {
+            qDebug() << caller + ": " + query.lastError().text();
+            return false;
+        }
+
+        bool changed = change( query );
+        if( changed )
+            changed = query.exec( "COMMIT;" );
+
+        if( !changed )
+        {
+            qDebug() << caller + ": " + query.lastError().text();
+            query.exec( "ROLLBACK;" );
+        }
+
+        return setForeignKeys( true ) && changed;
+    }
+
+    bool SchemaMigrator::setForeignKeys( bool enable ) noexcept
+    {
+        QSqlQuery query( m_db );
+        if( !query.exec( QString( "PRAGMA foreign_keys = %1;" ).arg( enable ? "ON" : "OFF" ) ) )
+        {
+            qDebug() << "SchemaMigrator::setForeignKeys: " + query.lastError().text();
+            return false;
+        }
+        return true;
+    }
+
+    QString SchemaMigrator::columnType( const QString& tableName, const QString& columnName ) const noexcept
+    {
+        QSqlQuery query( m_db );
+        if( !query.exec( "PRAGMA table_info( " + tableName + " );" ) )
+            return QString();
+
+        while( query.next() )
+        {
+            if( query.value( "name" ).toString() == columnName )
+                return query.value( "type" ).toString().toUpper();
+        }
+        return QString();
+    }
+
+    void SchemaMigrator::dropProgress() noexcept
+    {
+        QSqlQuery query( m_db );
+        if( !query.exec( "DROP TABLE IF EXISTS " + PROGRESS_TABLE_NAME + ";" ) )
+            qDebug() << "SchemaMigrator::dropProgress: " + query.lastError().text();
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef SCHEMAMIGRATOR_H
+#define SCHEMAMIGRATOR_H
+
+#include <functional>
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+
+namespace PatientsDBManager
+{
+    // Brings a database file up to the current schema, the applied version is kept in
+    // PRAGMA user_version. Migrations run in version order and must be idempotent:
+    // a migration interrupted before its version was stored runs again.
+    //
+    // Large tables are rewritten in chunked transactions sized to stay within
+    // CHUNK_TIME_BUDGET_MS, so other connections never wait long for the write lock.
+    // The chunk cursor is committed together with the chunk, an interrupted
+    // rewrite resumes from the last committed chunk.
+    class SchemaMigrator
+    {
+    public:
+        // Processes the rows following lastRowId, at most chunkSize of them, and moves
+        // lastRowId past them. Runs inside the chunk transaction.
+        using ChunkFunction = std::function<bool( qint64& lastRowId, int chunkSize, int& processedRows )>;
+
+        // Table rewrite through a shadow copy. Writes to the table made by other
+        // connections while the copy is in progress are mirrored by triggers.
+        struct TableRewrite
+        {
+            QString tableName;
+            QString keyColumn;          // INTEGER PRIMARY KEY of the table
+            QString columns;            // column list of the new table
+            QString selectList;         // expressions over the old row producing 'columns'
+
+            std::function<bool( const QString& tableName )> createTable;
+            std::function<bool()> finish;   // recreates indexes and triggers after the swap
+        };
+
+        static constexpr int CHUNK_TIME_BUDGET_MS = 200;
+
+        explicit SchemaMigrator( const QSqlDatabase& db ) noexcept;
+
+        void addMigration( int version, const QString& description, const std::function<bool()>& apply );
+
+        int latestVersion() const noexcept;
+        int version() const noexcept;
+        bool setVersion( int version ) noexcept;
+
+        bool migrate() noexcept;
+
+        // The step name identifies the cursor within the running migration
+        bool runInChunks( const QString& step, const ChunkFunction& chunk ) noexcept;
+        // Runs copyStatement over consecutive key ranges of sourceTable. Its two bind
+        // values are the exclusive lower and the inclusive upper key of the chunk.
+        bool copyInChunks( const QString& step, const QString& sourceTable,
+                           const QString& keyColumn, const QString& copyStatement ) noexcept;
+        bool rewriteTable( const TableRewrite& rewrite ) noexcept;
+
+        // Runs a schema change that swaps tables: foreign keys are disabled around
+        // a single immediate transaction.
+        bool changeSchema( const QString& caller, const std::function<bool( QSqlQuery& query )>& change ) noexcept;
+
+        bool setForeignKeys( bool enable ) noexcept;
+
+        QString columnType( const QString& tableName, const QString& columnName ) const noexcept;
+
+    private:
+        struct Migration
+        {
+            int     version;
+            QString description;
+            std::function<bool()> apply;
+        };
+
+        static constexpr int INITIAL_CHUNK_ROWS = 64;
+        static constexpr int MAX_CHUNK_ROWS = 16384;
+
+        QSqlDatabase       m_db;
+        QVector<Migration> m_migrations;
+        int                m_currentVersion{ 0 };
+
+        bool runChunk( const QString& step, const ChunkFunction& chunk, int chunkSize, int& processedRows ) noexcept;
+        void dropProgress() noexcept;
+    };
+}
+
+#endif // SCHEMAMIGRATOR_H
@@ -0,0 +1,218 @@
+#include "sqlite_connection.h"
+
+#include <atomic>
+#include <memory>
+
+#include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+
+#include <sqlite3.h>
+
+namespace PatientsDBManager
+{
+    namespace
+    {
+        // Shared by the busy handler running on the thread of the connection and
+        // the readers of the statistics
+        struct BusyState
+        {
+            std::atomic<int>    timeoutMs{ 0 };
+            std::atomic<qint64> busyEvents{ 0 };
+            std::atomic<qint64> retries{ 0 };
+            std::atomic<qint64> waitMs{ 0 };
+            std::atomic<qint64> timeouts{ 0 };
+
+            LockStatistics statistics() const noexcept
+            {
+                return LockStatistics{ busyEvents.load(), retries.load(), waitMs.load(), timeouts.load() };
+            }
+        };
+
+        QMutex& registryMutex()
+        {
+            static QMutex mutex;
+            return mutex;
+        }
+
+        // States are never removed, a handler may still point to one while its
+        // connection is being closed
+        QHash<QString, std::shared_ptr<BusyState>>& registry()
+        {
+            static QHash<QString, std::shared_ptr<BusyState>> states;
+            return states;
+        }
+
+        // Same back-off as the handler SQLite installs for busy_timeout, with counting
+        int BusyHandler( void* data, int count )
+        {
+            static constexpr int DELAYS_MS[] = { 1, 2, 5, 10, 15, 20, 25, 25, 25, 50, 50, 100 };
+            static constexpr int DELAY_COUNT = sizeof( DELAYS_MS ) / sizeof( DELAYS_MS[0] );
+
+            auto state = static_cast<BusyState*>( data );
+            if( count == 0 )
+                ++state->busyEvents;
+
+            int waited = 0;
+            for( int i = 0; i < count; ++i )
+                waited += DELAYS_MS[qMin( i, DELAY_COUNT - 1 )];
+
+            int delay = DELAYS_MS[qMin( count, DELAY_COUNT - 1 )];
+            const int timeout = state->timeoutMs;
+            if( waited + delay > timeout )
+            {
+                delay = timeout - waited;
+                if( delay <= 0 )
+                {
+                    ++state->timeouts;
+                    return 0;
+                }
+            }
+
+            sqlite3_sleep( delay );
+            ++state->retries;
+            state->waitMs += delay;
+            return 1;
+        }
+    }
+
+    ConnectionOptions ConnectionOptions::concurrent() noexcept
+    {
+        ConnectionOptions options;
+        options.walMode = true;
+        options.relaxedSync = true;
+        options.mmapSize = 256 * 1024 * 1024;
+        options.cacheSizeKiB = 16 * 1024;
+        options.checkpointIntervalMs = 30000;
+        return options;
+    }
+
+    LockStatistics& LockStatistics::operator+=( const LockStatistics& other ) noexcept
+    {
+        busyEvents += other.busyEvents;
+        retries += other.retries;
+        waitMs += other.waitMs;
+        timeouts += other.timeouts;
+        return *this;
+    }
+
+    bool SqliteConnection::configure( const QSqlDatabase& db, const ConnectionOptions& options ) noexcept
+    {
+        auto handle = SqliteConnection::handle( db );
+        if( !handle )
+            return false;
+
+        BusyState* state = nullptr;
+        {
+            QMutexLocker locker( &registryMutex() );
+            auto& registered = registry()[db.connectionName()];
+            if( !registered )
+                registered = std::make_shared<BusyState>();
+            state = registered.get();
+        }
+        state->timeoutMs = options.busyTimeoutMs;
+
+        // set before the journal mode, switching to WAL waits for the other connections
+        sqlite3_busy_handler( handle, BusyHandler, state );
+
+        QStringList pragmas;
+        if( options.cacheSizeKiB > 0 )
+            pragmas << QString( "PRAGMA cache_size = -%1;" ).arg( options.cacheSizeKiB );
+        if( options.mmapSize > 0 )
+            pragmas << QString( "PRAGMA mmap_size = %1;" ).arg( options.mmapSize );
+
+        QSqlQuery query( db );
+        if( options.walMode )
+        {
+            // an in-memory or a read-only database keeps its journal mode
+            if( !query.exec( "PRAGMA journal_mode = WAL;" ) || !query.next() ||
+                query.value( 0 ).toString().compare( "wal", Qt::CaseInsensitive ) != 0 )
+            {
+                qDebug() << "SqliteConnection::configure: WAL mode is not available " + query.lastError().text();
+                return false;
+            }
+            query.finish();
+
+            if( options.relaxedSync )
+                pragmas << "PRAGMA synchronous = NORMAL;";
+            pragmas << QString( "PRAGMA wal_autocheckpoint = %1;" ).arg( options.autoCheckpointPages );
+        }
+
+        for( const auto& pragma : pragmas )
+        {
+            if( !query.exec( pragma ) )
+            {
+                qDebug() << "SqliteConnection::configure: " + query.lastError().text();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SqliteConnection::checkpoint( const QSqlDatabase& db, ECheckpointMode mode ) noexcept
+    {
+        auto handle = SqliteConnection::handle( db );
+        if( !handle )
+            return false;
+
+        int sqliteMode = SQLITE_CHECKPOINT_PASSIVE;
+        switch( mode )
+        {
+            case ECheckpointMode::PASSIVE:
+                sqliteMode = SQLITE_CHECKPOINT_PASSIVE;
+                break;
+            case ECheckpointMode::FULL:
+                sqliteMode = SQLITE_CHECKPOINT_FULL;
+                break;
+            case ECheckpointMode::RESTART:
+                sqliteMode = SQLITE_CHECKPOINT_RESTART;
+                break;
+            case ECheckpointMode::TRUNCATE:
+                sqliteMode = SQLITE_CHECKPOINT_TRUNCATE;
+                break;
+        }
+
+        // a no-op outside WAL mode
+        int logFrames = 0;
+        int checkpointedFrames = 0;
+        const int result = sqlite3_wal_checkpoint_v2( handle, nullptr, sqliteMode, &logFrames, &checkpointedFrames );
+        if( result != SQLITE_OK )
+        {
+            qDebug() << "SqliteConnection::checkpoint: " + QString( sqlite3_errmsg( handle ) );
+            return false;
+        }
+        return true;
+    }
+
+    LockStatistics SqliteConnection::lockStatistics( const QString& connectionName ) noexcept
+    {
+        QMutexLocker locker( &registryMutex() );
+        const auto state = registry().value( connectionName );
+        return state ? state->statistics() : LockStatistics();
+    }
+
+    LockStatistics SqliteConnection::totalLockStatistics() noexcept
+    {
+        QMutexLocker locker( &registryMutex() );
+        LockStatistics total;
+        for( const auto& state : registry() )
+            total += state->statistics();
+        return total;
+    }
+
+    sqlite3* SqliteConnection::handle( const QSqlDatabase& db ) noexcept
+    {
+        const auto& handle = db.driver()->handle();
+        if( handle.isValid() && qstrcmp( handle.typeName(), "sqlite3*" ) == 0 )
+            return *static_cast<sqlite3* const*>( handle.constData() );
+
+        qDebug() << "SqliteConnection::handle: the connection is not backed by SQLite";
+        return nullptr;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef SQLITECONNECTION_H
+#define SQLITECONNECTION_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QtGlobal>
+
+struct sqlite3;
+
+namespace PatientsDBManager
+{
+    // How the connections of this process use the database file. The defaults keep
+    // the rollback journal and the 5 s busy timeout of the QSQLITE driver;
+    // concurrent() is the opt-in mode for several instances sharing one file.
+    struct ConnectionOptions
+    {
+        // WAL lets readers run while one writer commits. The journal mode is stored
+        // in the file, so it stays in WAL for every later connection.
+        bool   walMode{ false };
+        // synchronous = NORMAL in WAL mode: commits do not wait for fsync, the last
+        // of them may be lost on a power loss but the file is never corrupted
+        bool   relaxedSync{ false };
+        int    busyTimeoutMs{ 5000 };   // the busy handler replaces the driver's timeout
+        qint64 mmapSize{ 0 };           // bytes, 0 keeps the SQLite default
+        int    cacheSizeKiB{ 0 };       // 0 keeps the SQLite default
+
+        // Checkpoint policy: SQLite checkpoints after autoCheckpointPages pages were
+        // written to the WAL (0 turns it off), the main connection runs a PASSIVE
+        // checkpoint every checkpointIntervalMs (0 turns it off) and truncates the
+        // WAL when it closes
+        int  autoCheckpointPages{ 1000 };
+        int  checkpointIntervalMs{ 0 };
+        bool truncateOnClose{ true };
+
+        static ConnectionOptions concurrent() noexcept;
+    };
+
+    // Lock contention seen by one connection, updated by its busy handler
+    struct LockStatistics
+    {
+        qint64 busyEvents{ 0 };     // statements that found the database locked
+        qint64 retries{ 0 };
+        qint64 waitMs{ 0 };
+        qint64 timeouts{ 0 };       // statements that gave up with SQLITE_BUSY
+
+        LockStatistics& operator+=( const LockStatistics& other ) noexcept;
+    };
+
+    class SqliteConnection
+    {
+    public:
+        enum class ECheckpointMode : char { PASSIVE, FULL, RESTART, TRUNCATE };
+
+        // Sets the pragmas of the options and a busy handler that counts lock waits
+        static bool configure( const QSqlDatabase& db, const ConnectionOptions& options ) noexcept;
+
+        static bool checkpoint( const QSqlDatabase& db, ECheckpointMode mode ) noexcept;
+
+        // Statistics of a configured connection; they are kept after it is closed
+        static LockStatistics lockStatistics( const QString& connectionName ) noexcept;
+        static LockStatistics totalLockStatistics() noexcept;
+
+        static sqlite3* handle( const QSqlDatabase& db ) noexcept;
+    };
+}
+
+#endif // SQLITECONNECTION_H
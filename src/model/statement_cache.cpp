@@ -0,0 +1,56 @@
+#include "statement_cache.h"
+
+#include <memory>
+#include <new>
+
+#include <QCache>
+#include <QDebug>
+#include <QHash>
+
+namespace PatientsDBManager
+{
+    namespace
+    {
+        using Statements = QCache<QString, QSqlQuery>;
+
+        QHash<QString, std::shared_ptr<Statements>>& connections() noexcept
+        {
+            thread_local QHash<QString, std::shared_ptr<Statements>> statements;
+            return statements;
+        }
+    }
+
+    QSqlQuery* StatementCache::statement( const QSqlDatabase& db, const QString& sql, QSqlError& error ) noexcept
+    {
+        auto& statements = connections()[db.connectionName()];
+        if( !statements )
+            statements = std::make_shared<Statements>( MAX_STATEMENTS );
+
+        if( auto cached = statements->object( sql ) )
+            return cached;
+
+        auto query = new (std::nothrow) QSqlQuery( db );
+        if( !query )
+        {
+            error = QSqlError( "Not enough memory to prepare a statement", QString(), QSqlError::UnknownError );
+            return nullptr;
+        }
+
+        query->setForwardOnly( true );
+        if( !query->prepare( sql ) )
+        {
+            error = query->lastError();
+            qDebug() << "StatementCache::statement: " + error.text();
+            delete query;
+            return nullptr;
+        }
+
+        statements->insert( sql, query );
+        return query;
+    }
+
+    void StatementCache::release( const QString& connectionName ) noexcept
+    {
+        connections().remove( connectionName );
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef STATEMENTCACHE_H
+#define STATEMENTCACHE_H
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+
+namespace PatientsDBManager
+{
+    // Prepared statements of the connections used by the calling thread. A statement
+    // is compiled the first time its text is asked for and kept, later calls only
+    // rebind it. A connection belongs to one thread, so the caches are thread local
+    // and need no locking.
+    //
+    // The least recently used statement is finalized when a connection holds
+    // MAX_STATEMENTS of them, so a returned statement stays valid while fewer
+    // other statements are asked for.
+    class StatementCache
+    {
+    public:
+        static constexpr int MAX_STATEMENTS = 64;
+
+        // Forward only statement of the connection, nullptr with the error set when
+        // it does not compile
+        static QSqlQuery* statement( const QSqlDatabase& db, const QString& sql, QSqlError& error ) noexcept;
+
+        // Finalizes the statements of the connection, has to be called on its thread
+        // before the connection is closed or removed
+        static void release( const QString& connectionName ) noexcept;
+    };
+}
+
+#endif // STATEMENTCACHE_H
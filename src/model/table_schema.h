@@ -0,0 +1,280 @@
+#ifndef TABLESCHEMA_H
+#define TABLESCHEMA_H
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+#include <QByteArray>
+#include <QDate>
+#include <QDateTime>
+#include <QLatin1String>
+#include <QSqlQuery>
+#include <QString>
+#include <QVariant>
+
+#include "utility/utility.h"
+
+// Compile-time descriptors of the tables. The column enums are the positions of
+// the columns in SELECT_LIST<Table> and in the CREATE statement, so models, views
+// and queries index columns by these constants. Adding, removing or reordering
+// a column here changes every statement and accessor built from the descriptor.
+namespace PatientsDBManager::Schema
+{
+    // How a column is stored and which C++ type it is read as
+    enum class EValueKind : char { INTEGER, TEXT, DATE, DATE_TIME, BLOB };
+
+    struct Column
+    {
+        std::string_view name;
+        std::string_view definition;
+        EValueKind       kind;
+    };
+
+    struct Patients
+    {
+        enum EColumn : int { ID, NAME, ADDRESS, BIRTH_DATE, ADMISSION_DATE, DISCARGE_DATE, COLUMN_COUNT };
+
+        static constexpr std::string_view TABLE_NAME = "Patients";
+
+        // Dates are Julian day numbers, NULL when not set
+        static constexpr std::array<Column, COLUMN_COUNT> COLUMNS{ {
+            { "Id",            "INTEGER NOT NULL UNIQUE", EValueKind::INTEGER },
+            { "Name",          "TEXT",                    EValueKind::TEXT },
+            { "Address",       "TEXT",                    EValueKind::TEXT },
+            { "BirthDate",     "INTEGER",                 EValueKind::DATE },
+            { "AdmissionDate", "INTEGER NOT NULL",        EValueKind::DATE },
+            { "DiscargeDate",  "INTEGER",                 EValueKind::DATE } } };
+
+        static constexpr std::string_view CONSTRAINTS = "PRIMARY KEY( Id AUTOINCREMENT )";
+    };
+
+    struct PhotoSets
+    {
+        enum EColumn : int { ID, DATE, FILENAME, PATIENT_ID, CONTENT_ID, COLUMN_COUNT };
+
+        static constexpr std::string_view TABLE_NAME = "PhotoSets";
+
+        // Date is Unix time in seconds
+        static constexpr std::array<Column, COLUMN_COUNT> COLUMNS{ {
+            { "Id",         "INTEGER NOT NULL UNIQUE", EValueKind::INTEGER },
+            { "Date",       "INTEGER NOT NULL",        EValueKind::DATE_TIME },
+            { "Filename",   "TEXT NOT NULL",           EValueKind::TEXT },
+            { "Patient_Id", "INTEGER NOT NULL",        EValueKind::INTEGER },
+            { "Content_Id", "INTEGER NOT NULL",        EValueKind::INTEGER } } };
+
+        static constexpr std::string_view CONSTRAINTS =
+            "PRIMARY KEY( Id AUTOINCREMENT ), "
+            "FOREIGN KEY( Patient_Id ) REFERENCES Patients ( Id ) ON DELETE CASCADE ON UPDATE CASCADE, "
+            "FOREIGN KEY( Content_Id ) REFERENCES PhotoContents ( Id )";
+    };
+
+    // Image payloads are stored once per distinct content and shared by all the
+    // PhotoSets rows that reference them. Hash is the cheap sample key used to
+    // nominate duplicates, Sha256 confirms them.
+    struct PhotoContents
+    {
+        enum EColumn : int { ID, HASH, SHA256, REF_COUNT, PHOTO, COLUMN_COUNT };
+
+        static constexpr std::string_view TABLE_NAME = "PhotoContents";
+
+        static constexpr std::array<Column, COLUMN_COUNT> COLUMNS{ {
+            { "Id",       "INTEGER NOT NULL UNIQUE",   EValueKind::INTEGER },
+            { "Hash",     "INTEGER NOT NULL",          EValueKind::INTEGER },
+            { "Sha256",   "BLOB NOT NULL UNIQUE",      EValueKind::BLOB },
+            { "RefCount", "INTEGER NOT NULL DEFAULT 0", EValueKind::INTEGER },
+            { "Photo",    "BLOB NOT NULL",             EValueKind::BLOB } } };
+
+        static constexpr std::string_view CONSTRAINTS = "PRIMARY KEY( Id AUTOINCREMENT )";
+    };
+
+    struct PhotoThumbnails
+    {
+        enum EColumn : int { CONTENT_ID, THUMBNAIL, COLUMN_COUNT };
+
+        static constexpr std::string_view TABLE_NAME = "PhotoThumbnails";
+
+        static constexpr std::array<Column, COLUMN_COUNT> COLUMNS{ {
+            { "Content_Id", "INTEGER NOT NULL", EValueKind::INTEGER },
+            { "Thumbnail",  "BLOB NOT NULL",    EValueKind::BLOB } } };
+
+        static constexpr std::string_view CONSTRAINTS =
+            "PRIMARY KEY( Content_Id ), "
+            "FOREIGN KEY( Content_Id ) REFERENCES PhotoContents ( Id ) ON DELETE CASCADE ON UPDATE CASCADE";
+    };
+
+    // Null terminated string built at compile time
+    template<std::size_t N>
+    struct FixedString
+    {
+        char data[N + 1]{};
+
+        constexpr std::size_t size() const noexcept { return N; }
+        constexpr const char* c_str() const noexcept { return data; }
+        operator QLatin1String() const noexcept { return QLatin1String( data, int( N ) ); }
+        QString toString() const { return QString::fromLatin1( data, int( N ) ); }
+    };
+
+    namespace Detail
+    {
+        constexpr std::string_view SEPARATOR = ", ";
+
+        template<typename Table>
+        constexpr std::size_t SelectListLength() noexcept
+        {
+            std::size_t length = 0;
+            for( std::size_t i = 0; i < Table::COLUMNS.size(); ++i )
+                length += ( i ? SEPARATOR.size() : 0 ) + Table::COLUMNS[i].name.size();
+            return length;
+        }
+
+        template<typename Table>
+        constexpr std::size_t ColumnDefinitionsLength() noexcept
+        {
+            std::size_t length = 0;
+            for( std::size_t i = 0; i < Table::COLUMNS.size(); ++i )
+                length += ( i ? SEPARATOR.size() : 0 ) + Table::COLUMNS[i].name.size() + 1 + Table::COLUMNS[i].definition.size();
+            if( !Table::CONSTRAINTS.empty() )
+                length += SEPARATOR.size() + Table::CONSTRAINTS.size();
+            return length;
+        }
+
+        template<std::size_t N>
+        constexpr void Append( FixedString<N>& string, std::size_t& position, std::string_view part ) noexcept
+        {
+            for( const auto c : part )
+                string.data[position++] = c;
+        }
+
+        template<typename Table>
+        constexpr auto MakeSelectList() noexcept
+        {
+            FixedString<SelectListLength<Table>()> list;
+            std::size_t position = 0;
+            for( std::size_t i = 0; i < Table::COLUMNS.size(); ++i )
+            {
+                if( i )
+                    Append( list, position, SEPARATOR );
+                Append( list, position, Table::COLUMNS[i].name );
+            }
+            return list;
+        }
+
+        template<typename Table>
+        constexpr auto MakeColumnDefinitions() noexcept
+        {
+            FixedString<ColumnDefinitionsLength<Table>()> definitions;
+            std::size_t position = 0;
+            for( std::size_t i = 0; i < Table::COLUMNS.size(); ++i )
+            {
+                if( i )
+                    Append( definitions, position, SEPARATOR );
+                Append( definitions, position, Table::COLUMNS[i].name );
+                Append( definitions, position, " " );
+                Append( definitions, position, Table::COLUMNS[i].definition );
+            }
+            if( !Table::CONSTRAINTS.empty() )
+            {
+                Append( definitions, position, SEPARATOR );
+                Append( definitions, position, Table::CONSTRAINTS );
+            }
+            return definitions;
+        }
+    }
+
+    // "Id, Name, ..." in the order of the column enum
+    template<typename Table>
+    inline constexpr auto SELECT_LIST = Detail::MakeSelectList<Table>();
+
+    // Body of the CREATE TABLE statement: the column definitions and the table constraints
+    template<typename Table>
+    inline constexpr auto COLUMN_DEFINITIONS = Detail::MakeColumnDefinitions<Table>();
+
+    template<typename Table>
+    QString TableName()
+    {
+        return QString::fromLatin1( Table::TABLE_NAME.data(), int( Table::TABLE_NAME.size() ) );
+    }
+
+    // The table may be created under another name while it is rebuilt by a migration
+    template<typename Table>
+    QString CreateStatement( const QString& tableName )
+    {
+        return "CREATE TABLE " + tableName + " ( " + COLUMN_DEFINITIONS<Table>.toString() + " );";
+    }
+
+    template<typename Table>
+    QString ColumnName( int column )
+    {
+        if( column < 0 || column >= int( Table::COLUMNS.size() ) )
+            return QString();
+
+        const auto name = Table::COLUMNS[column].name;
+        return QString::fromLatin1( name.data(), int( name.size() ) );
+    }
+
+    template<EValueKind Kind>
+    struct ValueTraits;
+
+    template<>
+    struct ValueTraits<EValueKind::INTEGER>
+    {
+        using Type = qint64;
+        static Type fromDb( const QVariant& value ) { return value.toLongLong(); }
+        static QVariant toDb( Type value ) { return static_cast<qlonglong>( value ); }
+    };
+
+    template<>
+    struct ValueTraits<EValueKind::TEXT>
+    {
+        using Type = QString;
+        static Type fromDb( const QVariant& value ) { return value.toString(); }
+        static QVariant toDb( const Type& value ) { return value; }
+    };
+
+    template<>
+    struct ValueTraits<EValueKind::DATE>
+    {
+        using Type = QDate;
+        static Type fromDb( const QVariant& value ) { return Utility::DateFromDbValue( value ); }
+        static QVariant toDb( const Type& value ) { return Utility::DateToDbValue( value ); }
+    };
+
+    template<>
+    struct ValueTraits<EValueKind::DATE_TIME>
+    {
+        using Type = QDateTime;
+        static Type fromDb( const QVariant& value ) { return Utility::DateTimeFromDbValue( value ); }
+        static QVariant toDb( const Type& value ) { return Utility::DateTimeToDbValue( value ); }
+    };
+
+    template<>
+    struct ValueTraits<EValueKind::BLOB>
+    {
+        using Type = QByteArray;
+        static Type fromDb( const QVariant& value ) { return value.toByteArray(); }
+        static QVariant toDb( const Type& value ) { return value; }
+    };
+
+    template<typename Table, int Column>
+    using Traits = ValueTraits<Table::COLUMNS[Column].kind>;
+
+    template<typename Table, int Column>
+    using ValueType = typename Traits<Table, Column>::Type;
+
+    // Typed value of a column of a query that selects SELECT_LIST<Table>
+    template<typename Table, int Column>
+    ValueType<Table, Column> Value( const QSqlQuery& query )
+    {
+        static_assert( Column >= 0 && Column < int( Table::COLUMNS.size() ), "no such column" );
+        return Traits<Table, Column>::fromDb( query.value( Column ) );
+    }
+
+    template<typename Table, int Column>
+    QVariant DbValue( const ValueType<Table, Column>& value )
+    {
+        return Traits<Table, Column>::toDb( value );
+    }
+}
+
+#endif // TABLESCHEMA_H
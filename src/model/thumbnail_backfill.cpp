@@ -0,0 +1,139 @@
+#include "thumbnail_backfill.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QPair>
+#include <QSqlQuery>
+
+#include "model/blob_device.h"
+#include "model/connection_manager.h"
+#include "model/database.h"
+#include "utility/global.h"
+#include "utility/utility.h"
+
+namespace PatientsDBManager
+{
+    ThumbnailBackfill::ThumbnailBackfill( const Database& db, QObject* parent ) noexcept
+        : QObject( parent )
+        , m_dbFileName( db.getFileName() )
+    {}
+
+    ThumbnailBackfill::~ThumbnailBackfill()
+    {
+        stop();
+    }
+
+    void ThumbnailBackfill::start() noexcept
+    {
+        if( m_thread )
+            return;
+
+        m_thread = QThread::create( [this]{ run(); } );
+        m_thread->setParent( this );
+        m_thread->start( QThread::LowPriority );
+    }
+
+    void ThumbnailBackfill::stop() noexcept
+    {
+        m_stopped = true;
+        if( m_thread )
+            m_thread->wait();
+    }
+
+    void ThumbnailBackfill::run() noexcept
+    {
+        int created = 0;
+        {
+            auto db = ConnectionManager::writer( m_dbFileName );
+
+            QSqlQuery selectMissing( db );
+            selectMissing.setForwardOnly( true );
+            QSqlQuery insertThumbnail( db );
+
+            const bool prepared =
+                    db.isOpen() &&
+                    selectMissing.prepare( "SELECT c.Id FROM " + PHOTO_CONTENTS_TABLE_NAME + " c "
+                                           "LEFT JOIN " + PHOTO_THUMBNAILS_TABLE_NAME + " t ON t.Content_Id = c.Id "
+                                           "WHERE t.Content_Id IS NULL AND c.Id > ? ORDER BY c.Id LIMIT ?;" ) &&
+                    insertThumbnail.prepare( "INSERT OR IGNORE INTO " + PHOTO_THUMBNAILS_TABLE_NAME +
+                                             " ( Content_Id, Thumbnail ) VALUES ( ?, ? );" );
+
+            if( !prepared )
+                qDebug() << "ThumbnailBackfill::run: " + selectMissing.lastError().text();
+
+            const auto handle = Database::getHandle( db );
+
+            // Keyset over the content ids, so photos that cannot be decoded are skipped
+            // instead of being picked up again by the next chunk.
+            qlonglong lastId = 0;
+            while( prepared && !m_stopped )
+            {
+                QVector<qint64> missingIds;
+
+                selectMissing.bindValue( 0, lastId );
+                selectMissing.bindValue( 1, CHUNK_SIZE );
+                if( !selectMissing.exec() )
+                {
+                    qDebug() << "ThumbnailBackfill::run: " + selectMissing.lastError().text();
+                    break;
+                }
+                while( selectMissing.next() )
+                    missingIds.append( selectMissing.value( 0 ).toLongLong() );
+                selectMissing.finish();
+
+                if( missingIds.isEmpty() )
+                    break;
+
+                lastId = missingIds.last();
+
+                QVector<QPair<qint64, QByteArray>> thumbnails;
+                for( const auto contentId : missingIds )
+                {
+                    if( m_stopped )
+                        break;
+
+                    BlobDevice photo( handle, PHOTO_CONTENTS_TABLE_NAME, "Photo", contentId );
+                    if( !photo.open( QIODevice::ReadOnly ) )
+                        continue;
+
+                    QString errorString;
+                    auto thumbnail = Utility::CreateThumbnail( photo, Global::THUMBNAIL_SIZE, &errorString );
+                    photo.close();
+
+                    if( thumbnail.isEmpty() )
+                        qDebug() << QString( "ThumbnailBackfill::run: photo %1: %2" ).arg( contentId ).arg( errorString );
+                    else
+                        thumbnails.append( qMakePair( contentId, std::move( thumbnail ) ) );
+                }
+
+                if( thumbnails.isEmpty() )
+                    continue;
+
+                QMutexLocker writeLocker( ConnectionManager::writeMutex( m_dbFileName ) );
+                if( !db.transaction() )
+                    break;
+
+                QVector<qint64> createdIds;
+                for( const auto& thumbnail : thumbnails )
+                {
+                    insertThumbnail.bindValue( 0, thumbnail.first );
+                    insertThumbnail.bindValue( 1, thumbnail.second );
+                    if( insertThumbnail.exec() )
+                        createdIds.append( thumbnail.first );
+                }
+
+                if( !db.commit() )
+                {
+                    qDebug() << "ThumbnailBackfill::run: " + db.lastError().text();
+                    db.rollback();
+                    break;
+                }
+
+                created += createdIds.size();
+                emit thumbnailsCreated( createdIds );
+            }
+        }
+
+        emit finished( created );
+    }
+}
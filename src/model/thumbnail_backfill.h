@@ -0,0 +1,43 @@
+#ifndef THUMBNAILBACKFILL_H
+#define THUMBNAILBACKFILL_H
+
+#include <atomic>
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+
+namespace PatientsDBManager
+{
+    class Database;
+
+    // Background job that creates the missing thumbnails of photos imported
+    // before thumbnails existed. It works in small chunks on its own connection,
+    // so it never holds the write lock for long.
+    class ThumbnailBackfill : public QObject
+    {
+        Q_OBJECT
+    public:
+        explicit ThumbnailBackfill( const Database& db, QObject* parent = nullptr ) noexcept;
+        ~ThumbnailBackfill() override;
+
+        void start() noexcept;
+        void stop() noexcept;
+
+    signals:
+        void thumbnailsCreated( const QVector<qint64>& contentIds );
+        void finished( int created );
+
+    private:
+        static constexpr int CHUNK_SIZE = 16;
+
+        QString  m_dbFileName;
+        QThread* m_thread{ nullptr };
+
+        std::atomic_bool m_stopped{ false };
+
+        void run() noexcept;
+    };
+}
+
+#endif // THUMBNAILBACKFILL_H
@@ -0,0 +1,145 @@
+// Checks that every downscale path the CPU supports gives exactly the pixels of
+// the scalar one, then times them against QImage::scaled(). Without image files
+// a noisy 6000x4000 gradient is used. Exits with 1 on any difference:
+//
+//     PatiensDBDownscaleBench --iterations 20
+//     PatiensDBDownscaleBench --sizes 256,1920 scan1.jpg scan2.png
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QVector>
+
+#include "utility/downscale.h"
+
+using namespace PatientsDBManager::Utility;
+
+namespace
+{
+    QImage syntheticImage()
+    {
+        QImage image( 6000, 4000, QImage::Format_RGB32 );
+        QRandomGenerator random( 1 );
+        for( int y = 0; y < image.height(); ++y )
+        {
+            auto line = reinterpret_cast<QRgb*>( image.scanLine( y ) );
+            for( int x = 0; x < image.width(); ++x )
+            {
+                const int noise = random.bounded( 32 );
+                line[x] = qRgb( ( x * 255 / image.width() + noise ) & 0xff, ( y * 255 / image.height() + noise ) & 0xff,
+                                ( ( x + y ) & 0xff ) ^ noise );
+            }
+        }
+        return image;
+    }
+
+    QVector<ESimd> supportedPaths()
+    {
+        QVector<ESimd> paths{ ESimd::SCALAR };
+        if( SupportedSimd() >= ESimd::SSE41 )
+            paths.append( ESimd::SSE41 );
+        if( SupportedSimd() >= ESimd::AVX2 )
+            paths.append( ESimd::AVX2 );
+        return paths;
+    }
+
+    template<typename Function>
+    double averageMs( int iterations, Function function )
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for( int i = 0; i < iterations; ++i )
+            function();
+        return timer.nsecsElapsed() / 1e6 / iterations;
+    }
+
+    // Returns false when a path differs from the scalar one
+    bool run( QTextStream& out, const QString& name, const QImage& image, const QVector<int>& sides, int iterations )
+    {
+        bool identical = true;
+        out << QString( "%1: %2x%3\n" ).arg( name ).arg( image.width() ).arg( image.height() );
+
+        QVector<QSize> sizes;
+        for( const int side : sides )
+            sizes.append( image.size().scaled( side, side, Qt::KeepAspectRatio ) );
+
+        for( const auto& size : sizes )
+        {
+            const auto reference = Downscale( image, size, ESimd::SCALAR );
+            for( const auto simd : supportedPaths() )
+            {
+                const auto result = Downscale( image, size, simd );
+                identical = identical && result == reference;
+                const auto ms = averageMs( iterations, [&]{ Downscale( image, size, simd ); } );
+                out << QString( "  downscale to %1x%2 %3: %4 ms%5\n" ).arg( size.width() ).arg( size.height() )
+                                                                      .arg( SimdName( simd ) ).arg( ms, 0, 'f', 2 )
+                                                                      .arg( result == reference ? "" : " DIFFERS" );
+            }
+            const auto ms = averageMs( iterations, [&]{ image.scaled( size, Qt::IgnoreAspectRatio,
+                                                                      Qt::SmoothTransformation ); } );
+            out << QString( "  downscale to %1x%2 QImage::scaled: %3 ms\n" ).arg( size.width() ).arg( size.height() )
+                                                                            .arg( ms, 0, 'f', 2 );
+        }
+
+        const auto reference = HalfSize( image, ESimd::SCALAR );
+        for( const auto simd : supportedPaths() )
+        {
+            const auto result = HalfSize( image, simd );
+            identical = identical && result == reference;
+            const auto ms = averageMs( iterations, [&]{ HalfSize( image, simd ); } );
+            out << QString( "  half size %1: %2 ms%3\n" ).arg( SimdName( simd ) ).arg( ms, 0, 'f', 2 )
+                                                          .arg( result == reference ? "" : " DIFFERS" );
+        }
+        const auto ms = averageMs( iterations, [&]{ image.scaled( reference.size(), Qt::IgnoreAspectRatio,
+                                                                  Qt::SmoothTransformation ); } );
+        out << QString( "  half size QImage::scaled: %1 ms\n" ).arg( ms, 0, 'f', 2 );
+        out.flush();
+        return identical;
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    QCoreApplication a( argc, argv );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Bit-exactness check and benchmark of the downscale kernels." );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "images", "Image files to reduce, a synthetic image when none is given.", "[images...]" );
+    QCommandLineOption iterationsOption( "iterations", "Runs of each path that are timed.", "count", "10" );
+    QCommandLineOption sizesOption( "sizes", "Longest sides of the reduced images.", "pixels", "256,1920" );
+    parser.addOptions( { iterationsOption, sizesOption } );
+    parser.process( a );
+
+    const int iterations = qMax( 1, parser.value( iterationsOption ).toInt() );
+    QVector<int> sides;
+    for( const auto& side : parser.value( sizesOption ).split( ',' ) )
+    {
+        if( side.toInt() > 0 )
+            sides.append( side.toInt() );
+    }
+
+    QTextStream out( stdout );
+    out << QString( "supported: %1\n" ).arg( SimdName( SupportedSimd() ) );
+
+    bool identical = true;
+    if( parser.positionalArguments().isEmpty() )
+        identical = run( out, "synthetic", syntheticImage(), sides, iterations );
+    for( const auto& fileName : parser.positionalArguments() )
+    {
+        const QImage image( fileName );
+        if( image.isNull() )
+        {
+            out << fileName << ": can not be read\n";
+            continue;
+        }
+        identical = run( out, fileName, image, sides, iterations ) && identical;
+    }
+
+    out << ( identical ? "all paths identical\n" : "paths differ\n" );
+    return identical ? 0 : 1;
+}
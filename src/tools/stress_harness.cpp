@@ -0,0 +1,328 @@
+// Runs several processes of random reads and writes against one database file
+// and reports their latency percentiles and lock waits. The same options the
+// application takes select the journal mode and busy handling, so both modes
+// can be compared on the same machine:
+//
+//     PatiensDBStress --processes 8 --seconds 20 --write-ratio 10 stress.db
+//     PatiensDBStress --processes 8 --seconds 20 --write-ratio 10 --concurrent stress.db
+
+#include <numeric>
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QVector>
+
+#include "model/sqlite_connection.h"
+
+using namespace PatientsDBManager;
+
+namespace
+{
+    const QString CONNECTION_NAME = "Stress";
+    const QString TABLE_NAME = "StressRows";
+
+    struct Settings
+    {
+        QString           fileName;
+        int               processes{ 4 };
+        int               seconds{ 10 };
+        int               writePercent{ 10 };
+        int               rows{ 10000 };
+        ConnectionOptions options;
+    };
+
+    // Microseconds to the number of statements that took them
+    using Histogram = QMap<qint64, qint64>;
+
+    struct Latencies
+    {
+        Histogram      reads;
+        Histogram      writes;
+        qint64         errors{ 0 };
+        LockStatistics locks;
+    };
+
+    // Latencies are kept exact below 128 us and with their six most significant
+    // bits above, about 3 % precision, so a histogram stays a few hundred entries
+    qint64 bucket( qint64 us )
+    {
+        int shift = 0;
+        while( ( us >> shift ) >= 128 )
+            ++shift;
+        return shift == 0 ? us : ( us >> ( shift + 1 ) ) << ( shift + 1 );
+    }
+
+    QSqlDatabase openConnection( const Settings& settings )
+    {
+        auto db = QSqlDatabase::addDatabase( "QSQLITE", CONNECTION_NAME );
+        db.setDatabaseName( settings.fileName );
+        if( !db.open() )
+        {
+            qDebug() << "openConnection: " + db.lastError().text();
+            return db;
+        }
+
+        if( !SqliteConnection::configure( db, settings.options ) )
+            qDebug() << "openConnection: the connection options were not applied";
+        return db;
+    }
+
+    bool seed( const Settings& settings )
+    {
+        bool seeded = false;
+        {
+            auto db = openConnection( settings );
+            if( !db.isOpen() )
+                return false;
+
+            QSqlQuery query( db );
+            seeded = query.exec( "CREATE TABLE IF NOT EXISTS " + TABLE_NAME + " ( "
+                                 "Id INTEGER PRIMARY KEY, "
+                                 "Payload TEXT NOT NULL, "
+                                 "Counter INTEGER NOT NULL DEFAULT 0 );" ) &&
+                     query.exec( "SELECT COUNT(*) FROM " + TABLE_NAME + ";" ) && query.next();
+
+            if( seeded )
+            {
+                const int existing = query.value( 0 ).toInt();
+                query.finish();
+
+                seeded = db.transaction() &&
+                         query.prepare( "INSERT INTO " + TABLE_NAME + " ( Payload ) VALUES ( ? );" );
+                for( int i = existing; seeded && i < settings.rows; ++i )
+                {
+                    query.bindValue( 0, QString( "row %1" ).arg( i ) );
+                    seeded = query.exec();
+                }
+                seeded = seeded && db.commit();
+            }
+
+            if( !seeded )
+                qDebug() << "seed: " + query.lastError().text();
+            db.close();
+        }
+        QSqlDatabase::removeDatabase( CONNECTION_NAME );
+        return seeded;
+    }
+
+    // Prints its histograms when it is done, "R <us> <count>" and "W <us> <count>"
+    // lines, then "E <count>" and "L <busy events> <retries> <wait ms> <timeouts>".
+    // Nothing is written while it runs: the harness reads the workers one after
+    // another, a worker blocked on a full pipe would not load the file.
+    int runWorker( const Settings& settings )
+    {
+        {
+            auto db = openConnection( settings );
+            if( !db.isOpen() )
+                return 1;
+
+            QSqlQuery read( db );
+            read.setForwardOnly( true );
+            read.prepare( "SELECT Payload, Counter FROM " + TABLE_NAME + " WHERE Id = ?;" );
+
+            QSqlQuery write( db );
+            write.prepare( "UPDATE " + TABLE_NAME + " SET Counter = Counter + 1, Payload = ? WHERE Id = ?;" );
+
+            QSqlQuery transaction( db );
+            Latencies latencies;
+            auto random = QRandomGenerator::global();
+
+            QElapsedTimer deadline;
+            deadline.start();
+            QElapsedTimer timer;
+            while( deadline.elapsed() < settings.seconds * 1000 )
+            {
+                const qlonglong id = random->bounded( 1, settings.rows + 1 );
+                const bool isWrite = static_cast<int>( random->bounded( 100 ) ) < settings.writePercent;
+
+                bool done = false;
+                timer.start();
+                if( isWrite )
+                {
+                    // IMMEDIATE takes the write lock up front, a deferred transaction
+                    // would fail on the upgrade instead of waiting in the busy handler
+                    if( transaction.exec( "BEGIN IMMEDIATE;" ) )
+                    {
+                        write.bindValue( 0, QString( "written by %1" ).arg( QCoreApplication::applicationPid() ) );
+                        write.bindValue( 1, id );
+                        done = write.exec() && transaction.exec( "COMMIT;" );
+                        if( !done )
+                            transaction.exec( "ROLLBACK;" );
+                    }
+                }
+                else
+                {
+                    read.bindValue( 0, id );
+                    done = read.exec() && read.next();
+                    read.finish();
+                }
+                const qint64 elapsed = timer.nsecsElapsed() / 1000;
+
+                if( !done )
+                    ++latencies.errors;
+                else
+                    ++( isWrite ? latencies.writes : latencies.reads )[bucket( elapsed )];
+            }
+
+            QTextStream out( stdout );
+            for( auto value = latencies.reads.constBegin(); value != latencies.reads.constEnd(); ++value )
+                out << "R " << value.key() << ' ' << value.value() << '\n';
+            for( auto value = latencies.writes.constBegin(); value != latencies.writes.constEnd(); ++value )
+                out << "W " << value.key() << ' ' << value.value() << '\n';
+            out << "E " << latencies.errors << '\n';
+
+            const auto locks = SqliteConnection::lockStatistics( CONNECTION_NAME );
+            out << "L " << locks.busyEvents << ' ' << locks.retries << ' ' << locks.waitMs << ' ' << locks.timeouts << '\n';
+            out.flush();
+            db.close();
+        }
+        QSqlDatabase::removeDatabase( CONNECTION_NAME );
+        return 0;
+    }
+
+    void readWorkerOutput( const QByteArray& output, Latencies& latencies )
+    {
+        for( const auto& line : output.split( '\n' ) )
+        {
+            const auto fields = line.split( ' ' );
+            if( fields.size() == 3 && fields[0] == "R" )
+                latencies.reads[fields[1].toLongLong()] += fields[2].toLongLong();
+            else if( fields.size() == 3 && fields[0] == "W" )
+                latencies.writes[fields[1].toLongLong()] += fields[2].toLongLong();
+            else if( fields.size() == 2 && fields[0] == "E" )
+                latencies.errors += fields[1].toLongLong();
+            else if( fields.size() == 5 && fields[0] == "L" )
+                latencies.locks += LockStatistics{ fields[1].toLongLong(), fields[2].toLongLong(),
+                                                   fields[3].toLongLong(), fields[4].toLongLong() };
+        }
+    }
+
+    qint64 total( const Histogram& values )
+    {
+        return std::accumulate( values.constBegin(), values.constEnd(), qint64( 0 ) );
+    }
+
+    // Nearest rank percentile of the histogram
+    qint64 percentile( const Histogram& values, double rank )
+    {
+        const qint64 index = qMax( qint64( 1 ), static_cast<qint64>( rank / 100.0 * total( values ) + 0.5 ) );
+        qint64 counted = 0;
+        for( auto value = values.constBegin(); value != values.constEnd(); ++value )
+        {
+            counted += value.value();
+            if( counted >= index )
+                return value.key();
+        }
+        return values.isEmpty() ? 0 : values.lastKey();
+    }
+
+    void report( QTextStream& out, const QString& name, const Histogram& values, int seconds )
+    {
+        out << QString( "%1: %2 ops, %3 ops/s, us p50 %4 p90 %5 p99 %6 p99.9 %7 max %8\n" )
+               .arg( name )
+               .arg( total( values ) )
+               .arg( total( values ) / qMax( seconds, 1 ) )
+               .arg( percentile( values, 50 ) )
+               .arg( percentile( values, 90 ) )
+               .arg( percentile( values, 99 ) )
+               .arg( percentile( values, 99.9 ) )
+               .arg( values.isEmpty() ? 0 : values.lastKey() );
+    }
+
+    int runHarness( const Settings& settings, const QStringList& workerArguments )
+    {
+        if( !seed( settings ) )
+            return 1;
+
+        QVector<QProcess*> workers;
+        for( int i = 0; i < settings.processes; ++i )
+        {
+            auto worker = new QProcess( QCoreApplication::instance() );
+            worker->setProcessChannelMode( QProcess::ForwardedErrorChannel );
+            worker->start( QCoreApplication::applicationFilePath(), workerArguments );
+            workers.append( worker );
+        }
+
+        Latencies latencies;
+        int failed = 0;
+        for( auto worker : workers )
+        {
+            if( !worker->waitForFinished( -1 ) || worker->exitCode() != 0 )
+                ++failed;
+            readWorkerOutput( worker->readAllStandardOutput(), latencies );
+        }
+
+        QTextStream out( stdout );
+        out << QString( "%1 processes, %2 s, %3% writes, %4\n" )
+               .arg( settings.processes )
+               .arg( settings.seconds )
+               .arg( settings.writePercent )
+               .arg( settings.options.walMode ? "WAL" : "rollback journal" );
+        report( out, "reads", latencies.reads, settings.seconds );
+        report( out, "writes", latencies.writes, settings.seconds );
+        out << QString( "errors: %1, failed processes: %2\n" ).arg( latencies.errors ).arg( failed );
+        out << QString( "locks: %1 busy events, %2 retries, %3 ms waited, %4 timeouts\n" )
+               .arg( latencies.locks.busyEvents )
+               .arg( latencies.locks.retries )
+               .arg( latencies.locks.waitMs )
+               .arg( latencies.locks.timeouts );
+        return failed == 0 ? 0 : 1;
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    QCoreApplication a( argc, argv );
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Multi-process read/write stress test of a SQLite database file." );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "database", "Path to the database file, the StressRows table is created in it." );
+    QCommandLineOption processesOption( "processes", "Number of worker processes.", "count", "4" );
+    QCommandLineOption secondsOption( "seconds", "How long the workers run.", "seconds", "10" );
+    QCommandLineOption writeRatioOption( "write-ratio", "Percent of the statements that write.", "percent", "10" );
+    QCommandLineOption rowsOption( "rows", "Rows in the table.", "count", "10000" );
+    QCommandLineOption concurrentOption( "concurrent", "WAL journal, busy timeout and periodic checkpoints." );
+    QCommandLineOption busyTimeoutOption( "busy-timeout", "How long a statement waits for a locked database.", "ms" );
+    QCommandLineOption mmapSizeOption( "mmap-size", "How much of the file is memory mapped.", "bytes" );
+    QCommandLineOption cacheSizeOption( "cache-size", "Page cache size of each connection.", "KiB" );
+    QCommandLineOption workerOption( "worker", "Runs as one of the worker processes." );
+    parser.addOptions( { processesOption, secondsOption, writeRatioOption, rowsOption, concurrentOption,
+                         busyTimeoutOption, mmapSizeOption, cacheSizeOption, workerOption } );
+    parser.process( a );
+
+    if( parser.positionalArguments().size() != 1 )
+        parser.showHelp( 1 );
+
+    Settings settings;
+    settings.fileName = parser.positionalArguments().first();
+    settings.processes = qMax( 1, parser.value( processesOption ).toInt() );
+    settings.seconds = qMax( 1, parser.value( secondsOption ).toInt() );
+    settings.writePercent = qBound( 0, parser.value( writeRatioOption ).toInt(), 100 );
+    settings.rows = qMax( 1, parser.value( rowsOption ).toInt() );
+    if( parser.isSet( concurrentOption ) )
+        settings.options = ConnectionOptions::concurrent();
+    if( parser.isSet( busyTimeoutOption ) )
+        settings.options.busyTimeoutMs = parser.value( busyTimeoutOption ).toInt();
+    if( parser.isSet( mmapSizeOption ) )
+        settings.options.mmapSize = parser.value( mmapSizeOption ).toLongLong();
+    if( parser.isSet( cacheSizeOption ) )
+        settings.options.cacheSizeKiB = parser.value( cacheSizeOption ).toInt();
+
+    if( parser.isSet( workerOption ) )
+        return runWorker( settings );
+
+    auto workerArguments = a.arguments().mid( 1 );
+    workerArguments.prepend( "--worker" );
+    return runHarness( settings, workerArguments );
+}
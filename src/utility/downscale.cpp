@@ -0,0 +1,514 @@
+#include "downscale.h"
+
+#include <QVector>
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#define DOWNSCALE_X86
+#include <immintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile a function for an instruction set only when asked to;
+// MSVC always accepts the intrinsics and leaves the check to the caller
+#if defined( DOWNSCALE_X86 ) && defined( __GNUC__ )
+#define TARGET_SSE41 __attribute__(( target( "sse4.1" ) ))
+#define TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+namespace PatientsDBManager::Utility
+{
+    namespace
+    {
+        // Weights of one axis sum up to 1 << WEIGHT_BITS. The horizontal pass keeps
+        // 7 bits of fraction in 16 bits, the vertical one sums in 32 bits, where
+        // 255 << 7 << 14 still fits.
+        constexpr int WEIGHT_BITS = 14;
+        constexpr int WEIGHT_ONE = 1 << WEIGHT_BITS;
+        constexpr int HORIZONTAL_SHIFT = WEIGHT_BITS - 7;
+        constexpr int VERTICAL_SHIFT = WEIGHT_BITS + 7;
+
+        // The source pixels an output pixel covers and how much of each
+        struct Contributions
+        {
+            QVector<int>    first;
+            QVector<int>    count;
+            QVector<qint16> weights;    // count weights per output pixel, from offset[]
+            QVector<int>    offset;
+            int             maxCount{ 0 };
+        };
+
+        // Output pixel i covers [ i * source, ( i + 1 ) * source ) and source
+        // pixel j covers [ j * target, ( j + 1 ) * target ), in 1 / target units
+        Contributions areaContributions( int source, int target )
+        {
+            Contributions contributions;
+            contributions.first.resize( target );
+            contributions.count.resize( target );
+            contributions.offset.resize( target );
+
+            for( int i = 0; i < target; ++i )
+            {
+                const qint64 begin = qint64( i ) * source;
+                const qint64 end = begin + source;
+                const int first = static_cast<int>( begin / target );
+                const int last = static_cast<int>( ( end - 1 ) / target );
+
+                contributions.first[i] = first;
+                contributions.count[i] = last - first + 1;
+                contributions.offset[i] = contributions.weights.size();
+                contributions.maxCount = qMax( contributions.maxCount, last - first + 1 );
+
+                int sum = 0;
+                int largest = contributions.weights.size();
+                for( int j = first; j <= last; ++j )
+                {
+                    const qint64 overlap = qMin( end, qint64( j + 1 ) * target ) - qMax( begin, qint64( j ) * target );
+                    const auto weight = static_cast<qint16>( ( overlap * WEIGHT_ONE + source / 2 ) / source );
+                    if( j > first && weight > contributions.weights[largest] )
+                        largest = contributions.weights.size();
+                    contributions.weights.append( weight );
+                    sum += weight;
+                }
+                // the rounding error goes to the largest weight, so a flat area stays flat
+                contributions.weights[largest] += WEIGHT_ONE - sum;
+            }
+            return contributions;
+        }
+
+        using HorizontalKernel = void ( * )( const quint32* source, quint16* out, const Contributions& columns );
+        using VerticalKernel = void ( * )( const quint16* const* rows, const qint16* weights, int count, quint8* out,
+                                           int length );
+        using HalfKernel = void ( * )( const quint32* top, const quint32* bottom, quint32* out, int sourceWidth );
+
+        inline quint16 horizontalValue( qint32 sum ) noexcept
+        {
+            return static_cast<quint16>( ( sum + ( 1 << ( HORIZONTAL_SHIFT - 1 ) ) ) >> HORIZONTAL_SHIFT );
+        }
+
+        inline quint8 verticalValue( qint32 sum ) noexcept
+        {
+            return static_cast<quint8>( ( sum + ( 1 << ( VERTICAL_SHIFT - 1 ) ) ) >> VERTICAL_SHIFT );
+        }
+
+        void horizontalScalar( const quint32* source, quint16* out, const Contributions& columns )
+        {
+            for( int x = 0; x < columns.first.size(); ++x )
+            {
+                auto pixels = reinterpret_cast<const quint8*>( source + columns.first[x] );
+                auto weights = columns.weights.constData() + columns.offset[x];
+
+                qint32 sums[4] = { 0, 0, 0, 0 };
+                for( int i = 0; i < columns.count[x]; ++i )
+                {
+                    for( int channel = 0; channel < 4; ++channel )
+                        sums[channel] += weights[i] * pixels[4 * i + channel];
+                }
+                for( int channel = 0; channel < 4; ++channel )
+                    out[4 * x + channel] = horizontalValue( sums[channel] );
+            }
+        }
+
+        // Output values from first on
+        void verticalScalar( const quint16* const* rows, const qint16* weights, int count, quint8* out, int length,
+                             int first )
+        {
+            for( int i = first; i < length; ++i )
+            {
+                qint32 sum = 0;
+                for( int row = 0; row < count; ++row )
+                    sum += weights[row] * rows[row][i];
+                out[i] = verticalValue( sum );
+            }
+        }
+
+        void verticalScalar( const quint16* const* rows, const qint16* weights, int count, quint8* out, int length )
+        {
+            verticalScalar( rows, weights, count, out, length, 0 );
+        }
+
+        inline quint32 halfPixel( quint32 a, quint32 b, quint32 c, quint32 d ) noexcept
+        {
+            quint32 result = 0;
+            for( int shift = 0; shift < 32; shift += 8 )
+            {
+                const quint32 sum = ( ( a >> shift ) & 0xff ) + ( ( b >> shift ) & 0xff ) +
+                                    ( ( c >> shift ) & 0xff ) + ( ( d >> shift ) & 0xff ) + 2;
+                result |= ( sum >> 2 ) << shift;
+            }
+            return result;
+        }
+
+        // Output pixels from first on, the last one may have an odd right edge
+        void halfScalar( const quint32* top, const quint32* bottom, quint32* out, int sourceWidth, int first )
+        {
+            const int width = ( sourceWidth + 1 ) / 2;
+            for( int x = first; x < width; ++x )
+            {
+                const int left = 2 * x;
+                const int right = qMin( left + 1, sourceWidth - 1 );
+                out[x] = halfPixel( top[left], top[right], bottom[left], bottom[right] );
+            }
+        }
+
+        void halfScalar( const quint32* top, const quint32* bottom, quint32* out, int sourceWidth )
+        {
+            halfScalar( top, bottom, out, sourceWidth, 0 );
+        }
+
+#if defined( DOWNSCALE_X86 )
+        // Two weights as the int16 pair _mm_madd_epi16() multiplies with two interleaved pixels
+        inline int weightPair( const qint16* weights ) noexcept
+        {
+            return static_cast<quint16>( weights[0] ) | ( static_cast<int>( weights[1] ) << 16 );
+        }
+
+        // The channels of two pixels interleaved as int16: c0 of a, c0 of b, c1 of a, ...
+        TARGET_SSE41 inline __m128i interleave( quint32 a, quint32 b ) noexcept
+        {
+            return _mm_cvtepu8_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( static_cast<int>( a ) ),
+                                                         _mm_cvtsi32_si128( static_cast<int>( b ) ) ) );
+        }
+
+        // The weighted channel sums of the taps of one output pixel from i on
+        TARGET_SSE41 inline __m128i horizontalTaps( const quint32* pixels, const qint16* weights, int i, int count,
+                                                    __m128i sum ) noexcept
+        {
+            for( ; i + 2 <= count; i += 2 )
+            {
+                const __m128i pair = interleave( pixels[i], pixels[i + 1] );
+                sum = _mm_add_epi32( sum, _mm_madd_epi16( pair, _mm_set1_epi32( weightPair( weights + i ) ) ) );
+            }
+            if( i < count )
+            {
+                const __m128i pixel = interleave( pixels[i], 0 );
+                sum = _mm_add_epi32( sum, _mm_madd_epi16( pixel, _mm_set1_epi32( static_cast<quint16>( weights[i] ) ) ) );
+            }
+            return sum;
+        }
+
+        TARGET_SSE41 inline void storeHorizontal( quint16* out, __m128i sum ) noexcept
+        {
+            sum = _mm_srli_epi32( _mm_add_epi32( sum, _mm_set1_epi32( 1 << ( HORIZONTAL_SHIFT - 1 ) ) ), HORIZONTAL_SHIFT );
+            _mm_storel_epi64( reinterpret_cast<__m128i*>( out ), _mm_packus_epi32( sum, sum ) );
+        }
+
+        TARGET_SSE41 void horizontalSse41( const quint32* source, quint16* out, const Contributions& columns )
+        {
+            for( int x = 0; x < columns.first.size(); ++x )
+            {
+                const auto sum = horizontalTaps( source + columns.first[x], columns.weights.constData() + columns.offset[x],
+                                                 0, columns.count[x], _mm_setzero_si128() );
+                storeHorizontal( out + 4 * x, sum );
+            }
+        }
+
+        // Rows are taken in pairs, their values interleaved for _mm_madd_epi16(); the
+        // horizontal pass keeps them below 1 << 15, so they fit in int16
+        TARGET_SSE41 void verticalSse41( const quint16* const* rows, const qint16* weights, int count, quint8* out,
+                                         int length )
+        {
+            const __m128i round = _mm_set1_epi32( 1 << ( VERTICAL_SHIFT - 1 ) );
+            const __m128i zero = _mm_setzero_si128();
+            int i = 0;
+            for( ; i + 8 <= length; i += 8 )
+            {
+                __m128i low = zero;
+                __m128i high = zero;
+                for( int row = 0; row < count; row += 2 )
+                {
+                    const bool single = row + 1 == count;
+                    const __m128i upper = _mm_loadu_si128( reinterpret_cast<const __m128i*>( rows[row] + i ) );
+                    const __m128i lower = single ? zero
+                                                 : _mm_loadu_si128( reinterpret_cast<const __m128i*>( rows[row + 1] + i ) );
+                    const __m128i weight = _mm_set1_epi32( single ? static_cast<quint16>( weights[row] )
+                                                                  : weightPair( weights + row ) );
+                    low = _mm_add_epi32( low, _mm_madd_epi16( _mm_unpacklo_epi16( upper, lower ), weight ) );
+                    high = _mm_add_epi32( high, _mm_madd_epi16( _mm_unpackhi_epi16( upper, lower ), weight ) );
+                }
+                low = _mm_srli_epi32( _mm_add_epi32( low, round ), VERTICAL_SHIFT );
+                high = _mm_srli_epi32( _mm_add_epi32( high, round ), VERTICAL_SHIFT );
+                const __m128i words = _mm_packus_epi32( low, high );
+                _mm_storel_epi64( reinterpret_cast<__m128i*>( out + i ), _mm_packus_epi16( words, words ) );
+            }
+            verticalScalar( rows, weights, count, out, length, i );
+        }
+
+        // The sums of two horizontally adjacent pixels, 16 bits per channel, in the low half
+        TARGET_SSE41 inline __m128i pairSums( __m128i words ) noexcept
+        {
+            return _mm_add_epi16( words, _mm_srli_si128( words, 8 ) );
+        }
+
+        TARGET_SSE41 void halfSse41( const quint32* top, const quint32* bottom, quint32* out, int sourceWidth )
+        {
+            const __m128i round = _mm_set1_epi16( 2 );
+            const __m128i zero = _mm_setzero_si128();
+
+            // two output pixels from four source pixels of each row
+            int x = 0;
+            for( ; 2 * x + 4 <= sourceWidth; x += 2 )
+            {
+                const __m128i upper = _mm_loadu_si128( reinterpret_cast<const __m128i*>( top + 2 * x ) );
+                const __m128i lower = _mm_loadu_si128( reinterpret_cast<const __m128i*>( bottom + 2 * x ) );
+                const __m128i left = _mm_add_epi16( _mm_cvtepu8_epi16( upper ), _mm_cvtepu8_epi16( lower ) );
+                const __m128i right = _mm_add_epi16( _mm_unpackhi_epi8( upper, zero ), _mm_unpackhi_epi8( lower, zero ) );
+
+                __m128i sums = _mm_unpacklo_epi64( pairSums( left ), pairSums( right ) );
+                sums = _mm_srli_epi16( _mm_add_epi16( sums, round ), 2 );
+                _mm_storel_epi64( reinterpret_cast<__m128i*>( out + x ), _mm_packus_epi16( sums, sums ) );
+            }
+            halfScalar( top, bottom, out, sourceWidth, x );
+        }
+
+        TARGET_AVX2 void horizontalAvx2( const quint32* source, quint16* out, const Contributions& columns )
+        {
+            // two output pixels at a time, one in each lane, as long as both have taps left
+            int x = 0;
+            for( ; x + 2 <= columns.first.size(); x += 2 )
+            {
+                const quint32* pixels[] = { source + columns.first[x], source + columns.first[x + 1] };
+                const qint16* weights[] = { columns.weights.constData() + columns.offset[x],
+                                            columns.weights.constData() + columns.offset[x + 1] };
+                const int counts[] = { columns.count[x], columns.count[x + 1] };
+                const int common = qMin( counts[0], counts[1] ) & ~1;
+
+                __m256i sums = _mm256_setzero_si256();
+                for( int i = 0; i < common; i += 2 )
+                {
+                    const __m256i pairs = _mm256_inserti128_si256(
+                            _mm256_castsi128_si256( interleave( pixels[0][i], pixels[0][i + 1] ) ),
+                            interleave( pixels[1][i], pixels[1][i + 1] ), 1 );
+                    const __m256i weightPairs = _mm256_inserti128_si256(
+                            _mm256_set1_epi32( weightPair( weights[0] + i ) ),
+                            _mm_set1_epi32( weightPair( weights[1] + i ) ), 1 );
+                    sums = _mm256_add_epi32( sums, _mm256_madd_epi16( pairs, weightPairs ) );
+                }
+
+                storeHorizontal( out + 4 * x, horizontalTaps( pixels[0], weights[0], common, counts[0],
+                                                              _mm256_castsi256_si128( sums ) ) );
+                storeHorizontal( out + 4 * x + 4, horizontalTaps( pixels[1], weights[1], common, counts[1],
+                                                                  _mm256_extracti128_si256( sums, 1 ) ) );
+            }
+
+            for( ; x < columns.first.size(); ++x )
+            {
+                const auto sum = horizontalTaps( source + columns.first[x], columns.weights.constData() + columns.offset[x],
+                                                 0, columns.count[x], _mm_setzero_si128() );
+                storeHorizontal( out + 4 * x, sum );
+            }
+        }
+
+        TARGET_AVX2 void verticalAvx2( const quint16* const* rows, const qint16* weights, int count, quint8* out,
+                                       int length )
+        {
+            const __m256i round = _mm256_set1_epi32( 1 << ( VERTICAL_SHIFT - 1 ) );
+            const __m256i zero = _mm256_setzero_si256();
+            int i = 0;
+            for( ; i + 16 <= length; i += 16 )
+            {
+                // per lane: low holds values 0-3 and 8-11, high 4-7 and 12-15
+                __m256i low = zero;
+                __m256i high = zero;
+                for( int row = 0; row < count; row += 2 )
+                {
+                    const bool single = row + 1 == count;
+                    const __m256i upper = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( rows[row] + i ) );
+                    const __m256i lower = single ? zero
+                                                 : _mm256_loadu_si256( reinterpret_cast<const __m256i*>( rows[row + 1] + i ) );
+                    const __m256i weight = _mm256_set1_epi32( single ? static_cast<quint16>( weights[row] )
+                                                                     : weightPair( weights + row ) );
+                    low = _mm256_add_epi32( low, _mm256_madd_epi16( _mm256_unpacklo_epi16( upper, lower ), weight ) );
+                    high = _mm256_add_epi32( high, _mm256_madd_epi16( _mm256_unpackhi_epi16( upper, lower ), weight ) );
+                }
+                low = _mm256_srli_epi32( _mm256_add_epi32( low, round ), VERTICAL_SHIFT );
+                high = _mm256_srli_epi32( _mm256_add_epi32( high, round ), VERTICAL_SHIFT );
+
+                // the per lane pack puts the values back in order
+                const __m256i words = _mm256_packus_epi32( low, high );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ),
+                                  _mm_packus_epi16( _mm256_castsi256_si128( words ), _mm256_extracti128_si256( words, 1 ) ) );
+            }
+            verticalScalar( rows, weights, count, out, length, i );
+        }
+
+        TARGET_AVX2 void halfAvx2( const quint32* top, const quint32* bottom, quint32* out, int sourceWidth )
+        {
+            const __m256i round = _mm256_set1_epi16( 2 );
+
+            // four output pixels from eight source pixels of each row
+            int x = 0;
+            for( ; 2 * x + 8 <= sourceWidth; x += 4 )
+            {
+                auto upper = reinterpret_cast<const __m128i*>( top + 2 * x );
+                auto lower = reinterpret_cast<const __m128i*>( bottom + 2 * x );
+                const __m256i left = _mm256_add_epi16( _mm256_cvtepu8_epi16( _mm_loadu_si128( upper ) ),
+                                                       _mm256_cvtepu8_epi16( _mm_loadu_si128( lower ) ) );
+                const __m256i right = _mm256_add_epi16( _mm256_cvtepu8_epi16( _mm_loadu_si128( upper + 1 ) ),
+                                                        _mm256_cvtepu8_epi16( _mm_loadu_si128( lower + 1 ) ) );
+
+                // per lane: outputs 0 and 2 in the low lane, 1 and 3 in the high one
+                __m256i sums = _mm256_unpacklo_epi64( _mm256_add_epi16( left, _mm256_srli_si256( left, 8 ) ),
+                                                      _mm256_add_epi16( right, _mm256_srli_si256( right, 8 ) ) );
+                sums = _mm256_srli_epi16( _mm256_add_epi16( sums, round ), 2 );
+                sums = _mm256_permute4x64_epi64( sums, 0xd8 );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + x ),
+                                  _mm_packus_epi16( _mm256_castsi256_si128( sums ), _mm256_extracti128_si256( sums, 1 ) ) );
+            }
+            halfScalar( top, bottom, out, sourceWidth, x );
+        }
+#endif
+
+        ESimd detectSimd() noexcept
+        {
+#if defined( DOWNSCALE_X86 ) && defined( __GNUC__ )
+            __builtin_cpu_init();
+            if( __builtin_cpu_supports( "avx2" ) )
+                return ESimd::AVX2;
+            if( __builtin_cpu_supports( "sse4.1" ) )
+                return ESimd::SSE41;
+#elif defined( DOWNSCALE_X86 ) && defined( _MSC_VER )
+            int info[4];
+            __cpuid( info, 0 );
+            const int maxLeaf = info[0];
+
+            __cpuid( info, 1 );
+            const bool sse41 = ( info[2] & ( 1 << 19 ) ) != 0;
+            // AVX registers are usable only when the OS saves them
+            const bool osAvx = ( info[2] & ( 1 << 27 ) ) != 0 && ( info[2] & ( 1 << 28 ) ) != 0 &&
+                               ( _xgetbv( 0 ) & 0x6 ) == 0x6;
+            if( osAvx && maxLeaf >= 7 )
+            {
+                __cpuidex( info, 7, 0 );
+                if( info[1] & ( 1 << 5 ) )
+                    return ESimd::AVX2;
+            }
+            if( sse41 )
+                return ESimd::SSE41;
+#endif
+            return ESimd::SCALAR;
+        }
+
+        QImage to32Bit( const QImage& image )
+        {
+            // averaging straight alpha would bleed the colour of transparent pixels
+            if( image.hasAlphaChannel() )
+                return image.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+            return image.format() == QImage::Format_RGB32 ? image : image.convertToFormat( QImage::Format_RGB32 );
+        }
+    }
+
+    ESimd SupportedSimd() noexcept
+    {
+        static const ESimd simd = detectSimd();
+        return simd;
+    }
+
+    const char* SimdName( ESimd simd ) noexcept
+    {
+        switch( simd )
+        {
+            case ESimd::SSE41:
+                return "SSE4.1";
+            case ESimd::AVX2:
+                return "AVX2";
+            default:
+                return "scalar";
+        }
+    }
+
+    QImage Downscale( const QImage& image, const QSize& size, ESimd simd ) noexcept
+    {
+        if( image.isNull() || size.isEmpty() )
+            return QImage();
+        if( size.width() > image.width() || size.height() > image.height() )
+            return image.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+
+        const auto source = to32Bit( image );
+        QImage result( size, source.format() );
+        if( source.isNull() || result.isNull() )
+            return QImage();
+
+        HorizontalKernel horizontal = horizontalScalar;
+        VerticalKernel vertical = verticalScalar;
+#if defined( DOWNSCALE_X86 )
+        simd = qMin( simd, SupportedSimd() );
+        if( simd == ESimd::AVX2 )
+        {
+            horizontal = horizontalAvx2;
+            vertical = verticalAvx2;
+        }
+        else if( simd == ESimd::SSE41 )
+        {
+            horizontal = horizontalSse41;
+            vertical = verticalSse41;
+        }
+#else
+        Q_UNUSED( simd );
+#endif
+
+        const auto columns = areaContributions( source.width(), size.width() );
+        const auto rows = areaContributions( source.height(), size.height() );
+
+        // Source rows are reduced horizontally once, into a ring of the rows the
+        // current output row can cover; the next output row starts at the last
+        // row of this one at the earliest.
+        const int length = 4 * size.width();
+        const int ringSize = rows.maxCount;
+        QVector<quint16> ring( ringSize * length );
+        QVector<const quint16*> rowPointers( ringSize );
+        int reduced = 0;
+
+        for( int y = 0; y < size.height(); ++y )
+        {
+            const int first = rows.first[y];
+            const int count = rows.count[y];
+            for( ; reduced < first + count; ++reduced )
+            {
+                horizontal( reinterpret_cast<const quint32*>( source.constScanLine( reduced ) ),
+                            ring.data() + ( reduced % ringSize ) * length, columns );
+            }
+
+            for( int row = 0; row < count; ++row )
+                rowPointers[row] = ring.constData() + ( ( first + row ) % ringSize ) * length;
+            vertical( rowPointers.constData(), rows.weights.constData() + rows.offset[y], count, result.scanLine( y ),
+                      length );
+        }
+        return result;
+    }
+
+    QImage HalfSize( const QImage& image, ESimd simd ) noexcept
+    {
+        if( image.isNull() )
+            return QImage();
+
+        const auto source = to32Bit( image );
+        QImage result( ( source.width() + 1 ) / 2, ( source.height() + 1 ) / 2, source.format() );
+        if( source.isNull() || result.isNull() )
+            return QImage();
+
+        HalfKernel half = halfScalar;
+#if defined( DOWNSCALE_X86 )
+        simd = qMin( simd, SupportedSimd() );
+        if( simd == ESimd::AVX2 )
+            half = halfAvx2;
+        else if( simd == ESimd::SSE41 )
+            half = halfSse41;
+#else
+        Q_UNUSED( simd );
+#endif
+
+        const int height = source.height();
+        for( int y = 0; y < result.height(); ++y )
+        {
+            half( reinterpret_cast<const quint32*>( source.constScanLine( 2 * y ) ),
+                  reinterpret_cast<const quint32*>( source.constScanLine( qMin( 2 * y + 1, height - 1 ) ) ),
+                  reinterpret_cast<quint32*>( result.scanLine( y ) ), source.width() );
+        }
+        return result;
+    }
+}
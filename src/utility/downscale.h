@@ -0,0 +1,29 @@
+#ifndef DOWNSCALE_H
+#define DOWNSCALE_H
+
+#include <QImage>
+#include <QSize>
+
+namespace PatientsDBManager::Utility
+{
+    // Instruction sets of the downscale kernels. Every path gives exactly the same
+    // pixels, they are all integer fixed point.
+    enum class ESimd : char { SCALAR, SSE41, AVX2 };
+
+    // The fastest path the CPU supports, detected once
+    ESimd SupportedSimd() noexcept;
+    const char* SimdName( ESimd simd ) noexcept;
+
+    // Reduces the image to size, every output pixel the average of the source area
+    // it covers, weighted by coverage. Images are processed as RGB32, or as
+    // ARGB32_Premultiplied when they have alpha. A size larger than the image in
+    // either direction falls back to QImage::scaled(). A path the CPU does not
+    // support is replaced by the best one it does.
+    QImage Downscale( const QImage& image, const QSize& size, ESimd simd = SupportedSimd() ) noexcept;
+
+    // Half the size rounded up, every pixel the average of the 2x2 block it covers;
+    // an odd last column or row is averaged with itself
+    QImage HalfSize( const QImage& image, ESimd simd = SupportedSimd() ) noexcept;
+}
+
+#endif // DOWNSCALE_H
@@ -7,6 +7,7 @@ namespace PatientsDBManager::Global
     constexpr auto DATE_FORMAT = "dd.MM.yyyy";
     constexpr auto NOT_EMPTY_REGEX_PATTERN = "^(?!\\s*$).+";
     constexpr auto EMPTY_CELL_DEFAULT_VALUE = "Not set";
+    constexpr auto THUMBNAIL_SIZE = 256;
 }
 
 #endif // GLOBAL_H
@@ -0,0 +1,150 @@
+#include "hash.h"
+
+#include <cstring>
+
+#include <QCryptographicHash>
+#include <QtEndian>
+
+namespace PatientsDBManager::Utility
+{
+    namespace
+    {
+        constexpr quint64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+        constexpr quint64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr quint64 PRIME64_3 = 0x165667B19E3779F9ULL;
+        constexpr quint64 PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+        constexpr quint64 PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+        constexpr qint64 SAMPLE_SIZE = 64 * 1024;
+
+        inline quint64 rotateLeft( quint64 value, int bits ) noexcept
+        {
+            return ( value << bits ) | ( value >> ( 64 - bits ) );
+        }
+
+        // xxHash is specified on little-endian input
+        inline quint64 read64( const char* data ) noexcept
+        {
+            quint64 value;
+            std::memcpy( &value, data, sizeof( value ) );
+            return qFromLittleEndian( value );
+        }
+
+        inline quint32 read32( const char* data ) noexcept
+        {
+            quint32 value;
+            std::memcpy( &value, data, sizeof( value ) );
+            return qFromLittleEndian( value );
+        }
+
+        inline quint64 round( quint64 accumulator, quint64 input ) noexcept
+        {
+            accumulator += input * PRIME64_2;
+            accumulator = rotateLeft( accumulator, 31 );
+            return accumulator * PRIME64_1;
+        }
+
+        inline quint64 mergeRound( quint64 accumulator, quint64 value ) noexcept
+        {
+            accumulator ^= round( 0, value );
+            return accumulator * PRIME64_1 + PRIME64_4;
+        }
+    }
+
+    quint64 XXHash64( const char* data, qint64 length, quint64 seed ) noexcept
+    {
+        const char* p = data;
+        const char* const end = data + length;
+        quint64 hash;
+
+        if( length >= 32 )
+        {
+            const char* const limit = end - 32;
+            quint64 v1 = seed + PRIME64_1 + PRIME64_2;
+            quint64 v2 = seed + PRIME64_2;
+            quint64 v3 = seed;
+            quint64 v4 = seed - PRIME64_1;
+
+            do
+            {
+                v1 = round( v1, read64( p ) );
+                v2 = round( v2, read64( p + 8 ) );
+                v3 = round( v3, read64( p + 16 ) );
+                v4 = round( v4, read64( p + 24 ) );
+                p += 32;
+            }
+            while( p <= limit );
+
+            hash = rotateLeft( v1, 1 ) + rotateLeft( v2, 7 ) + rotateLeft( v3, 12 ) + rotateLeft( v4, 18 );
+            hash = mergeRound( hash, v1 );
+            hash = mergeRound( hash, v2 );
+            hash = mergeRound( hash, v3 );
+            hash = mergeRound( hash, v4 );
+        }
+        else
+        {
+            hash = seed + PRIME64_5;
+        }
+
+        hash += static_cast<quint64>( length );
+
+        for( ; p + 8 <= end; p += 8 )
+        {
+            hash ^= round( 0, read64( p ) );
+            hash = rotateLeft( hash, 27 ) * PRIME64_1 + PRIME64_4;
+        }
+
+        if( p + 4 <= end )
+        {
+            hash ^= static_cast<quint64>( read32( p ) ) * PRIME64_1;
+            hash = rotateLeft( hash, 23 ) * PRIME64_2 + PRIME64_3;
+            p += 4;
+        }
+
+        for( ; p < end; ++p )
+        {
+            hash ^= static_cast<quint64>( static_cast<unsigned char>( *p ) ) * PRIME64_5;
+            hash = rotateLeft( hash, 11 ) * PRIME64_1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= PRIME64_2;
+        hash ^= hash >> 29;
+        hash *= PRIME64_3;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+
+    std::optional<quint64> SampleKey( QIODevice& device ) noexcept
+    {
+        if( !device.isOpen() || device.isSequential() )
+            return std::nullopt;
+
+        const auto size = device.size();
+        const auto headSize = qMin( size, SAMPLE_SIZE );
+        const auto tailSize = qMin( size - headSize, SAMPLE_SIZE );
+
+        QByteArray sample( static_cast<int>( sizeof( quint64 ) + headSize + tailSize ), Qt::Uninitialized );
+        qToLittleEndian( static_cast<quint64>( size ), sample.data() );
+
+        auto buffer = sample.data() + sizeof( quint64 );
+        if( !device.seek( 0 ) ||
+            device.read( buffer, headSize ) != headSize ||
+            !device.seek( size - tailSize ) ||
+            device.read( buffer + headSize, tailSize ) != tailSize )
+        {
+            return std::nullopt;
+        }
+
+        return XXHash64( sample.constData(), sample.size() );
+    }
+
+    QByteArray Sha256( QIODevice& device ) noexcept
+    {
+        QCryptographicHash hash( QCryptographicHash::Sha256 );
+        if( !device.seek( 0 ) || !hash.addData( &device ) )
+            return QByteArray();
+        return hash.result();
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <optional>
+
+#include <QByteArray>
+#include <QIODevice>
+
+namespace PatientsDBManager::Utility
+{
+    // 64-bit xxHash (XXH64) of a memory block
+    quint64 XXHash64( const char* data, qint64 length, quint64 seed = 0 ) noexcept;
+
+    // Cheap content key of a random-access device: XXH64 over the size and the first and
+    // last 64 KiB. Equal content always gives equal keys, so a key that is not known yet
+    // proves the content is new without reading it all. Equal keys only nominate
+    // candidates that have to be confirmed with Sha256().
+    std::optional<quint64> SampleKey( QIODevice& device ) noexcept;
+
+    // SHA-256 of the whole device content, read in chunks from the start
+    QByteArray Sha256( QIODevice& device ) noexcept;
+}
+
+#endif // HASH_H
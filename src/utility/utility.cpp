@@ -1,31 +1,143 @@
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <optional>
 #include <utility>
 
 #include <QAbstractButton>
+#include <QBuffer>
 #include <QByteArray>
+#include <QDate>
+#include <QDateTime>
 #include <QFile>
 #include <QFileDialog>
+#include <QImage>
+#include <QImageIOHandler>
+#include <QImageReader>
 #include <QStandardPaths>
+#include <QStringList>
 #include <QSqlTableModel>
 #include <QTableView>
 #include <QVector>
 
+#include "utility/downscale.h"
+
 namespace PatientsDBManager::Utility
 {
-    QByteArray* LoadImage( const QString& fileName )
+    QByteArray MapFile( QFile& file )
     {
-        QFile file( fileName );
-        if( file.open( QIODevice::ReadOnly ) )
+        const auto size = file.size();
+        if( size <= 0 || size > std::numeric_limits<int>::max() )
+            return QByteArray();
+
+        if( const auto data = file.map( 0, size ) )
+            return QByteArray::fromRawData( reinterpret_cast<const char*>( data ), static_cast<int>( size ) );
+
+        // Some file systems, e.g. network shares, can not be mapped
+        if( !file.seek( 0 ) )
+            return QByteArray();
+        auto content = file.readAll();
+        return content.size() == size ? content : QByteArray();
+    }
+
+    QByteArray CreateThumbnail( QIODevice& imageDevice, int maxSide, QString* errorString )
+    {
+        const auto& image = DecodeImage( imageDevice, QSize( maxSide, maxSide ), nullptr, errorString );
+        if( image.isNull() )
+            return QByteArray();
+
+        QByteArray thumbnail;
+        QBuffer buffer( &thumbnail );
+        buffer.open( QIODevice::WriteOnly );
+        if( !image.save( &buffer, "JPG", 80 ) )
+        {
+            if( errorString )
+                *errorString = "Thumbnail encoding failed";
+            return QByteArray();
+        }
+        return thumbnail;
+    }
+
+    QImage DecodeImage( QIODevice& imageDevice, const QSize& boundingSize, QSize* fullSize, QString* errorString )
+    {
+        QImageReader reader( &imageDevice );
+        if( !reader.canRead() )
+        {
+            if( errorString )
+                *errorString = "Unsupported image format";
+            return QImage();
+        }
+
+        const auto& imageSize = reader.size();
+        if( fullSize )
+            *fullSize = imageSize;
+
+        const bool reduce = imageSize.isValid() && boundingSize.isValid() &&
+                            ( imageSize.width() > boundingSize.width() || imageSize.height() > boundingSize.height() );
+        const auto targetSize = reduce ? imageSize.scaled( boundingSize, Qt::KeepAspectRatio ) : QSize();
+
+        // The JPEG reader shrinks by 1/2, 1/4 or 1/8 in the DCT domain only when the quality
+        // is below 50, at its default of 75 it decodes the full frame and scales that. So
+        // the quality is lowered, which also picks the fast IDCT, and the reader is asked
+        // only for such a power of two, anything in between is left to Downscale().
+        if( reduce && reader.supportsOption( QImageIOHandler::ScaledSize ) )
+        {
+            int denominator = 1;
+            while( denominator < 8 && imageSize.width() / ( 2 * denominator ) >= targetSize.width() &&
+                   imageSize.height() / ( 2 * denominator ) >= targetSize.height() )
+            {
+                denominator *= 2;
+            }
+
+            if( denominator > 1 )
+            {
+                reader.setQuality( 49 );
+                reader.setScaledSize( QSize( imageSize.width() / denominator, imageSize.height() / denominator ) );
+            }
+        }
+
+        auto image = reader.read();
+        if( image.isNull() )
         {
-            QByteArray* binaryImage = new QByteArray( file.readAll() );
-            if( binaryImage->isNull() || binaryImage->isEmpty()  )
+            if( errorString )
+                *errorString = reader.errorString();
+            return QImage();
+        }
+
+        if( reduce && image.size() != targetSize )
+        {
+            image = Downscale( image, targetSize );
+            if( image.isNull() )
             {
-                delete binaryImage;
-                return nullptr;
+                if( errorString )
+                    *errorString = "The image can not be reduced";
+                return QImage();
             }
-            return binaryImage;
         }
-        return nullptr;
+
+        if( fullSize && !fullSize->isValid() )
+            *fullSize = image.size();
+        return image;
+    }
+
+    QVariant DateToDbValue( const QDate& date )
+    {
+        return date.isValid() ? QVariant( date.toJulianDay() ) : QVariant( QVariant::LongLong );
+    }
+
+    QDate DateFromDbValue( const QVariant& value )
+    {
+        return value.isNull() ? QDate() : QDate::fromJulianDay( value.toLongLong() );
+    }
+
+    QVariant DateTimeToDbValue( const QDateTime& dateTime )
+    {
+        return dateTime.isValid() ? QVariant( dateTime.toSecsSinceEpoch() ) : QVariant( QVariant::LongLong );
+    }
+
+    QDateTime DateTimeFromDbValue( const QVariant& value )
+    {
+        return value.isNull() ? QDateTime() : QDateTime::fromSecsSinceEpoch( value.toLongLong() );
     }
 
     void InitImageFileDialog( QFileDialog& dialog, QFileDialog::AcceptMode acceptMode, QFileDialog::FileMode fileMode )
@@ -41,4 +153,29 @@ namespace PatientsDBManager::Utility
             dialog.setDefaultSuffix( "jpg" );
     }
 
+    QVector<QPair<int, int>> RowRanges( QVector<int> rows )
+    {
+        std::sort( rows.begin(), rows.end(), std::greater<int>() );
+        rows.erase( std::unique( rows.begin(), rows.end() ), rows.end() );
+
+        QVector<QPair<int, int>> ranges;
+        for( const auto row : rows )
+        {
+            if( !ranges.isEmpty() && ranges.last().first == row + 1 )
+                ranges.last().first = row;
+            else
+                ranges.append( qMakePair( row, row ) );
+        }
+        return ranges;
+    }
+
+    QString IdList( const QVector<qint64>& ids )
+    {
+        QStringList list;
+        list.reserve( ids.size() );
+        for( const auto id : ids )
+            list.append( QString::number( id ) );
+        return list.join( ',' );
+    }
+
 }
@@ -6,17 +6,52 @@
 
 #include <QAbstractButton>
 #include <QByteArray>
+#include <QDate>
+#include <QDateTime>
+#include <QFile>
 #include <QFileDialog>
+#include <QImage>
+#include <QIODevice>
+#include <QPair>
 #include <QSqlTableModel>
 #include <QTableView>
 #include <QVector>
 
 namespace PatientsDBManager::Utility
 {
-    QByteArray* LoadImage( const QString& fileName );
+    // The content of an open file without copying it: a raw view of the file mapped
+    // into memory, valid while the file stays open, or the content read into memory
+    // when the file can not be mapped. A null array means the file can not be read.
+    QByteArray MapFile( QFile& file );
+
+    // Decodes the image reduced by DecodeImage() to fit into maxSide x maxSide and returns
+    // it JPEG encoded. The whole compressed stream is decoded, so an empty result also
+    // means that the image is corrupted.
+    QByteArray CreateThumbnail( QIODevice& imageDevice, int maxSide, QString* errorString = nullptr );
+
+    // Decodes the image reduced to fit into boundingSize. A JPEG is shrunk by 1/2, 1/4 or
+    // 1/8 in the DCT domain while it is decoded, the rest of the reduction is done on the
+    // decoded frame. An invalid boundingSize decodes at full resolution. fullSize is set
+    // to the stored size of the image.
+    QImage DecodeImage( QIODevice& imageDevice, const QSize& boundingSize, QSize* fullSize = nullptr,
+                        QString* errorString = nullptr );
+
+    // Dates are stored as Julian day numbers and timestamps as Unix time in seconds,
+    // so they sort and compare as integers. A missing value is stored as NULL.
+    QVariant  DateToDbValue( const QDate& date );
+    QDate     DateFromDbValue( const QVariant& value );
+    QVariant  DateTimeToDbValue( const QDateTime& dateTime );
+    QDateTime DateTimeFromDbValue( const QVariant& value );
 
     void InitImageFileDialog( QFileDialog& dialog, QFileDialog::AcceptMode acceptMode, QFileDialog::FileMode fileMode );
 
+    // Groups rows into ( first, last ) ranges, the bottom range first, so removing
+    // them in this order keeps the numbers of the ranges still to remove valid
+    QVector<QPair<int, int>> RowRanges( QVector<int> rows );
+
+    // Ids as the comma separated list of an IN ( ... ) clause
+    QString IdList( const QVector<qint64>& ids );
+
 }
 
 #endif // UTILITY_H
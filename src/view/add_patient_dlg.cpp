@@ -73,12 +73,12 @@ namespace PatientsDBManager
                 return;
             }
 
-            using namespace Global;
+            const auto discargeDateField = m_patientInfo.getDiscargeDateField();
             m_patient = Patient( m_patientInfo.getNameField()->text(),
                                   m_patientInfo.getAddressField()->text(),
-                                  m_patientInfo.getBirthDateField()->date().toString( DATE_FORMAT ),
-                                  m_patientInfo.getAdmissionDateField()->date().toString( DATE_FORMAT ),
-                                  m_patientInfo.getDiscargeDateField()->date().toString( DATE_FORMAT ) ) ;
+                                  m_patientInfo.getBirthDateField()->date(),
+                                  m_patientInfo.getAdmissionDateField()->date(),
+                                  discargeDateField->isEmpty() ? QDate() : discargeDateField->date() ) ;
 
             emit confirmed( m_patient );
             accept();
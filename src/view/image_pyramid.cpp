@@ -0,0 +1,190 @@
+#include "image_pyramid.h"
+
+#include <atomic>
+#include <new>
+
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "utility/downscale.h"
+
+namespace PatientsDBManager
+{
+    // Shared by the pyramid and its build task. The pyramid detaches itself under
+    // the mutex, so the task never posts to a deleted pyramid.
+    struct ImagePyramid::BuildState
+    {
+        QMutex            mutex;
+        ImagePyramid*     owner{ nullptr };
+        std::atomic<bool> canceled{ false };
+    };
+
+    class PyramidBuildTask : public QRunnable
+    {
+    public:
+        PyramidBuildTask( std::shared_ptr<ImagePyramid::BuildState> build, const QImage& image ) noexcept
+            : m_build( std::move( build ) )
+            , m_image( image )
+        {}
+
+        void run() override
+        {
+            // The levels are small next to the image, all of them are computed
+            // before any is cut, then they are published coarsest first
+            const auto format = m_image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+            QVector<QImage> levels{ m_image.convertToFormat( format ) };
+            m_image = QImage();
+
+            while( qMax( levels.last().width(), levels.last().height() ) > ImagePyramid::TILE_SIZE )
+            {
+                if( m_build->canceled )
+                    return;
+                levels.append( Utility::HalfSize( levels.last() ) );
+            }
+
+            for( int level = levels.size() - 1; level >= 0; --level )
+            {
+                if( m_build->canceled )
+                    return;
+
+                auto tiles = cut( levels[level] );
+                levels[level] = QImage();
+
+                QMutexLocker locker( &m_build->mutex );
+                if( auto owner = m_build->owner )
+                {
+                    QMetaObject::invokeMethod( owner, [owner, build = m_build, level, tiles]
+                    {
+                        owner->setTiles( build, level, tiles );
+                    }, Qt::QueuedConnection );
+                }
+            }
+        }
+
+    private:
+        std::shared_ptr<ImagePyramid::BuildState> m_build;
+        QImage                                    m_image;
+
+        static QVector<QImage> cut( const QImage& image ) noexcept
+        {
+            constexpr int TILE_SIZE = ImagePyramid::TILE_SIZE;
+
+            const int columns = ( image.width() + TILE_SIZE - 1 ) / TILE_SIZE;
+            const int rows = ( image.height() + TILE_SIZE - 1 ) / TILE_SIZE;
+
+            QVector<QImage> tiles;
+            tiles.reserve( columns * rows );
+            for( int y = 0; y < image.height(); y += TILE_SIZE )
+            {
+                for( int x = 0; x < image.width(); x += TILE_SIZE )
+                {
+                    tiles.append( image.copy( x, y, qMin( TILE_SIZE, image.width() - x ),
+                                              qMin( TILE_SIZE, image.height() - y ) ) );
+                }
+            }
+            return tiles;
+        }
+    };
+
+
+//==========================================================================================
+
+
+    ImagePyramid::ImagePyramid( QObject* parent ) noexcept
+        : QObject( parent )
+    {}
+
+    ImagePyramid::~ImagePyramid()
+    {
+        cancelBuild();
+    }
+
+    void ImagePyramid::build( const QImage& image, const QSize& imageSize ) noexcept
+    {
+        cancelBuild();
+        m_levels.clear();
+        m_imageSize = QSize();
+
+        if( !image.isNull() )
+        {
+            QSize size = image.size();
+            m_levels.append( Level{ size, {} } );
+            while( qMax( size.width(), size.height() ) > TILE_SIZE )
+            {
+                size = QSize( ( size.width() + 1 ) / 2, ( size.height() + 1 ) / 2 );
+                m_levels.append( Level{ size, {} } );
+            }
+
+            m_imageSize = imageSize.isValid() ? imageSize : image.size();
+            m_build = std::make_shared<BuildState>();
+            m_build->owner = this;
+
+            auto task = new ( std::nothrow ) PyramidBuildTask( m_build, image );
+            if( task )
+            {
+                QThreadPool::globalInstance()->start( task );
+            }
+            else
+            {
+                cancelBuild();
+                m_levels.clear();
+                m_imageSize = QSize();
+            }
+        }
+
+        emit reset();
+    }
+
+    QSize ImagePyramid::levelSize( int level ) const noexcept
+    {
+        return level >= 0 && level < m_levels.size() ? m_levels[level].size : QSize();
+    }
+
+    bool ImagePyramid::isLevelReady( int level ) const noexcept
+    {
+        return level >= 0 && level < m_levels.size() && !m_levels[level].tiles.isEmpty();
+    }
+
+    int ImagePyramid::columnCount( int level ) const noexcept
+    {
+        return ( levelSize( level ).width() + TILE_SIZE - 1 ) / TILE_SIZE;
+    }
+
+    int ImagePyramid::rowCount( int level ) const noexcept
+    {
+        return ( levelSize( level ).height() + TILE_SIZE - 1 ) / TILE_SIZE;
+    }
+
+    QImage ImagePyramid::tile( int level, int column, int row ) const noexcept
+    {
+        if( !isLevelReady( level ) || column < 0 || row < 0 || column >= columnCount( level ) || row >= rowCount( level ) )
+            return QImage();
+
+        return m_levels[level].tiles[row * columnCount( level ) + column];
+    }
+
+    void ImagePyramid::cancelBuild() noexcept
+    {
+        if( !m_build )
+            return;
+
+        m_build->canceled = true;
+        QMutexLocker locker( &m_build->mutex );
+        m_build->owner = nullptr;
+        locker.unlock();
+        m_build.reset();
+    }
+
+    void ImagePyramid::setTiles( const std::shared_ptr<BuildState>& build, int level, const QVector<QImage>& tiles ) noexcept
+    {
+        // posted by a build that was replaced in the meantime
+        if( build != m_build || level >= m_levels.size() )
+            return;
+
+        m_levels[level].tiles = tiles;
+        emit levelReady( level );
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <memory>
+
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QVector>
+
+namespace PatientsDBManager
+{
+    // Levels of an image, each half the size of the one before, cut into tiles of
+    // TILE_SIZE. Level 0 is the image itself, the last level fits into one tile.
+    // The levels are built on the global thread pool and become ready coarsest
+    // first, so a view can show the whole image before the full resolution
+    // tiles exist. The tiles are only accessed on the thread of the pyramid.
+    class ImagePyramid : public QObject
+    {
+        Q_OBJECT
+    public:
+        static constexpr int TILE_SIZE = 256;
+
+        explicit ImagePyramid( QObject* parent = nullptr ) noexcept;
+        ~ImagePyramid() override;
+
+        // Drops the levels of the previous image, reset() is emitted before it returns.
+        // imageSize is the size of the photo when the image is a reduced copy of it.
+        void build( const QImage& image, const QSize& imageSize = QSize() ) noexcept;
+
+        bool isNull() const noexcept { return m_levels.isEmpty(); }
+        // The size of the photo, level 0 is smaller when the pyramid was built from a reduced copy
+        QSize size() const noexcept { return m_imageSize; }
+        bool isReduced() const noexcept { return !isNull() && levelSize( 0 ) != m_imageSize; }
+        int levelCount() const noexcept { return m_levels.size(); }
+        QSize levelSize( int level ) const noexcept;
+        bool isLevelReady( int level ) const noexcept;
+
+        int columnCount( int level ) const noexcept;
+        int rowCount( int level ) const noexcept;
+        // A tile of a ready level, smaller than TILE_SIZE at the right and bottom edges
+        QImage tile( int level, int column, int row ) const noexcept;
+
+    signals:
+        void reset();
+        void levelReady( int level );
+
+    private:
+        struct Level
+        {
+            QSize           size;
+            QVector<QImage> tiles;  // row major, empty until the level is ready
+        };
+
+        struct BuildState;
+
+        QVector<Level>              m_levels;
+        QSize                       m_imageSize;
+        std::shared_ptr<BuildState> m_build;
+
+        void cancelBuild() noexcept;
+        void setTiles( const std::shared_ptr<BuildState>& build, int level, const QVector<QImage>& tiles ) noexcept;
+
+        friend class PyramidBuildTask;
+    };
+}
+
+#endif // IMAGEPYRAMID_H
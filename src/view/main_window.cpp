@@ -1,20 +1,27 @@
 #include "main_window.h"
 
+#include <memory>
+
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QFileDialog>
 #include <QGridLayout>
 #include <QGroupBox>
 #include <QMessageBox>
+#include <QProgressDialog>
 #include <QSpacerItem>
-#include <QSqlRecord>
+#include <QStatusBar>
 #include <QHBoxLayout>
 #include <QHeaderView>
+#include <QIcon>
 #include <QVBoxLayout>
 
 #include "add_patient_dlg.h"
 #include "photo_viewer.h"
 #include "model/horizontal_proxy_model.h"
+#include "model/photo_importer.h"
+#include "model/thumbnail_backfill.h"
 #include "model/delegates.h"
 #include "utility/global.h"
 #include "utility/utility.h"
@@ -26,35 +33,58 @@ namespace PatientsDBManager
         : QMainWindow( parent )
         , m_db( databasePath )
     {
+        m_startupTimer.start();
+
         bool initFailed = false;
 
-        QSqlTableModel* patientsModel = nullptr;
-        QSqlTableModel* photoSetsModel = nullptr;
+        PatientsModel* patientsModel = nullptr;
 
         auto connectionResult = Database::EConnectionResult::CONNECTED;
         if( !initFailed &&
             ( connectionResult = m_db.connect() ) == Database::EConnectionResult::CONNECTED )
         {
+            logStartupPhase( "Database::connect" );
+
+            // Only the patients list is queried before the first paint; the patient
+            // page and its photo set model are built when a patient is opened.
             patientsModel = m_db.createPatientsModel( this );
-            photoSetsModel = m_db.createPhotoSetModel( this );
 
-            if( patientsModel &&
-                photoSetsModel )
+            if( patientsModel )
             {
-                patientsModel->setEditStrategy( QSqlTableModel::OnFieldChange );
-                photoSetsModel->setEditStrategy( QSqlTableModel::OnFieldChange );
-
                 patientsModel->select();
-                photoSetsModel->select();
+                logStartupPhase( "patients model" );
 
                 if( !setupPatientsView( patientsModel ) ||
-                   !setupPatientInfoView( patientsModel ) ||
-                   !setupPhotoSetView( photoSetsModel ) ||
                    !setupControls() ||
                    !setupLayout() )
                 {
                    initFailed = true;
                 }
+                else
+                {
+                    logStartupPhase( "main page layout" );
+                    m_patientsView->viewport()->installEventFilter( this );
+
+                    m_thumbnailBackfill = new ( std::nothrow ) ThumbnailBackfill( m_db, this );
+
+                    // Changes committed by other processes are pulled in instead of re-selecting
+                    m_changeWatcher = new ( std::nothrow ) ChangeWatcher( m_db, this );
+                    if( m_changeWatcher && m_changeWatcher->start() )
+                    {
+                        connect( m_changeWatcher, &ChangeWatcher::patientsChanged, patientsModel, &PatientsModel::applyChanges );
+                        connect( m_changeWatcher, &ChangeWatcher::resyncRequired, this, &MainWindow::resync );
+                    }
+
+                    // Staged edits that could not be written are still shown, so the rows are read again
+                    if( auto editBuffer = m_db.getEditBuffer() )
+                    {
+                        connect( editBuffer, &EditBuffer::flushFailed, this, [this]( const QSqlError& error )
+                        {
+                            showQueryError( error );
+                            resync();
+                        } );
+                    }
+                }
             }
             else
                 initFailed = true;
@@ -65,7 +95,6 @@ namespace PatientsDBManager
         if( initFailed )
         {
             delete patientsModel;
-            delete photoSetsModel;
 
             QString errorMsg;
             if( connectionResult != Database::EConnectionResult::CONNECTED )
@@ -82,6 +111,22 @@ namespace PatientsDBManager
         }
     }
 
+    bool MainWindow::eventFilter( QObject* watched, QEvent* event )
+    {
+        if( m_patientsView &&
+            watched == m_patientsView->viewport() &&
+            event->type() == QEvent::Paint )
+        {
+            logStartupPhase( "first paint" );
+            watched->removeEventFilter( this );
+
+            // thumbnails of older photos are generated once the window is up
+            if( m_thumbnailBackfill )
+                m_thumbnailBackfill->start();
+        }
+        return QMainWindow::eventFilter( watched, event );
+    }
+
     void MainWindow::switchPage( int index ) noexcept
     {
         if( m_winPages )
@@ -94,6 +139,16 @@ namespace PatientsDBManager
         }
     }
 
+    void MainWindow::logStartupPhase( const QString& phase ) noexcept
+    {
+        const auto elapsed = m_startupTimer.elapsed();
+        qDebug() << QString( "Startup: %1 took %2 ms (%3 ms since start)" )
+                    .arg( phase )
+                    .arg( elapsed - m_lastStartupPhaseTime )
+                    .arg( elapsed );
+        m_lastStartupPhaseTime = elapsed;
+    }
+
     bool MainWindow::setupLayout() noexcept
     {
         delete m_winPages;
@@ -102,19 +157,51 @@ namespace PatientsDBManager
             return false;
 
         auto mainPage = createMainPage();
-        auto patientPage = createPatientPage();
 
-        if( !mainPage || !patientPage )
+        if( !mainPage )
+            return false;
+
+        m_winPages->addWidget( mainPage );
+        setCentralWidget( m_winPages );
+
+        return true;
+    }
+
+    bool MainWindow::setupPatientPage() noexcept
+    {
+        if( m_winPages && m_winPages->count() > 1 )
+            return true;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        auto patientsModel = dynamic_cast<PatientsModel*>( m_patientsView->model() );
+        auto photoSetsModel = m_db.createPhotoSetModel( this );
+
+        if( !patientsModel ||
+            !photoSetsModel ||
+            !setupPatientInfoView( patientsModel ) ||
+            !setupPhotoSetView( photoSetsModel ) ||
+            !setupPatientPageControls() )
         {
-            delete mainPage;
-            delete patientPage;
+            delete photoSetsModel;
             return false;
         }
 
-        m_winPages->addWidget( mainPage );
+        if( m_thumbnailBackfill )
+            connect( m_thumbnailBackfill, &ThumbnailBackfill::thumbnailsCreated,
+                     photoSetsModel, &PhotoSetModel::refreshThumbnails );
+
+        if( m_changeWatcher )
+            connect( m_changeWatcher, &ChangeWatcher::photosChanged, photoSetsModel, &PhotoSetModel::applyChanges );
+
+        auto patientPage = createPatientPage();
+        if( !patientPage )
+            return false;
+
         m_winPages->addWidget( patientPage );
-        setCentralWidget( m_winPages );
 
+        qDebug() << QString( "MainWindow: patient page built in %1 ms" ).arg( timer.elapsed() );
         return true;
     }
 
@@ -122,16 +209,45 @@ namespace PatientsDBManager
     {
         auto deleteAllControls = [&]
         {
-            delete m_updatePatientBtn;
+            delete m_patientSearchEdit;
             delete m_addPatientBtn;
             delete m_removePatientBtn;
+        };
+
+        deleteAllControls();
+
+        m_patientSearchEdit = new ( std::nothrow ) QLineEdit( this );
+        m_addPatientBtn =     new ( std::nothrow ) QPushButton( "Add", this );
+        m_removePatientBtn =  new ( std::nothrow ) QPushButton( "Remove", this );
+
+        if( !m_patientSearchEdit ||
+            !m_addPatientBtn ||
+            !m_removePatientBtn )
+        {
+            deleteAllControls();
+            return false;
+        }
+
+        m_patientSearchEdit->setPlaceholderText( "Search by name or address" );
+        m_patientSearchEdit->setClearButtonEnabled( true );
+
+        connect( m_patientSearchEdit, &QLineEdit::textChanged, this, &MainWindow::searchPatients );
+
+        connect( m_addPatientBtn, &QPushButton::clicked, this, &MainWindow::addPatient );
+        connect( m_removePatientBtn, &QPushButton::clicked, this, &MainWindow::removePatients );
+
+        return true;
+    }
+
+    bool MainWindow::setupPatientPageControls() noexcept
+    {
+        auto deleteAllControls = [&]
+        {
+            delete m_patientInfoLbl;
 
-            delete m_updatePhotoBtn;
             delete m_addPhotoBtn;
             delete m_removePhotoBtn;
 
-            delete m_updateInfoBtn;
-
             delete m_returnBtn;
         };
 
@@ -139,25 +255,13 @@ namespace PatientsDBManager
 
         m_patientInfoLbl = new ( std::nothrow ) QLabel( this );
 
-        m_updatePatientBtn = new ( std::nothrow ) QPushButton( "Update", this );
-        m_addPatientBtn =    new ( std::nothrow ) QPushButton( "Add", this );
-        m_removePatientBtn = new ( std::nothrow ) QPushButton( "Remove", this );
-
-        m_updatePhotoBtn = new ( std::nothrow ) QPushButton( "Update", this );
         m_addPhotoBtn =    new ( std::nothrow ) QPushButton( "Add", this );
         m_removePhotoBtn = new ( std::nothrow ) QPushButton( "Remove", this );
 
-        m_updateInfoBtn = new ( std::nothrow ) QPushButton( "Update", this );
-
         m_returnBtn = new ( std::nothrow ) QPushButton( "←", this );
 
         if( !m_patientInfoLbl ||
-            !m_updatePatientBtn ||
-            !m_updatePhotoBtn ||                
-            !m_updateInfoBtn ||
-            !m_addPatientBtn ||
             !m_addPhotoBtn ||
-            !m_removePatientBtn ||
             !m_removePhotoBtn ||
             !m_returnBtn )
         {
@@ -174,22 +278,15 @@ namespace PatientsDBManager
         m_returnBtn->setFlat( true );
         m_returnBtn->setStyleSheet( "QPushButton:hover:!pressed{ border: 1px solid grey; }" );
 
-        connect( m_updatePatientBtn, &QPushButton::clicked, this, &MainWindow::updatePatients );
-        connect( m_addPatientBtn, &QPushButton::clicked, this, &MainWindow::addPatient );
-        connect( m_removePatientBtn, &QPushButton::clicked, this, &MainWindow::removePatients );
-
-        connect( m_updatePhotoBtn, &QPushButton::clicked, this, &MainWindow::updatePhotoSet );
         connect( m_addPhotoBtn, &QPushButton::clicked, this, &MainWindow::addPhotos );
         connect( m_removePhotoBtn, &QPushButton::clicked, this, &MainWindow::removePhotos );
 
-        connect( m_updateInfoBtn, &QPushButton::clicked, this, &MainWindow::updatePatientInfo );
-
         connect( m_returnBtn, &QPushButton::clicked, this, &MainWindow::returnToMainPage );
 
         return true;
     }
 
-    bool MainWindow::setupPatientsView( QSqlTableModel* model ) noexcept
+    bool MainWindow::setupPatientsView( PatientsModel* model ) noexcept
     {
         if( m_patientsView )
             delete m_patientsView;
@@ -198,8 +295,11 @@ namespace PatientsDBManager
             return false;
 
         m_patientsView->setModel( model );
+        // the edits of a row are written when another row becomes current
+        if( auto editBuffer = m_db.getEditBuffer() )
+            connect( m_patientsView->selectionModel(), &QItemSelectionModel::currentRowChanged, editBuffer, &EditBuffer::flush );
 
-        m_patientsView->hideColumn( 0 ); // don't show the ID
+        m_patientsView->hideColumn( PatientsModel::ID ); // don't show the ID
         m_patientsView->setHorizontalScrollMode( QAbstractItemView::ScrollPerPixel );
         m_patientsView->setSelectionBehavior( QAbstractItemView::SelectRows );
         m_patientsView->setSelectionMode( QAbstractItemView::ExtendedSelection );
@@ -208,37 +308,40 @@ namespace PatientsDBManager
         {
             auto nameDelagate = new RegexItemDelegate( Global::NOT_EMPTY_REGEX_PATTERN, this );
             nameDelagate->setToolTip( "'Name' can't be empty" );
-            m_patientsView->setItemDelegateForColumn( 1, nameDelagate );
+            m_patientsView->setItemDelegateForColumn( PatientsModel::NAME, nameDelagate );
         }
 
         {
             auto addressDelagate = new RegexItemDelegate( Global::NOT_EMPTY_REGEX_PATTERN, this );
             addressDelagate->setToolTip( "'Address' can't be empty" );
-            m_patientsView->setItemDelegateForColumn( 2, addressDelagate );
+            m_patientsView->setItemDelegateForColumn( PatientsModel::ADDRESS, addressDelagate );
         }
 
-        m_patientsView->setItemDelegateForColumn( 3, new DateItemDelegate( this ) );
+        m_patientsView->setItemDelegateForColumn( PatientsModel::BIRTH_DATE, new DateItemDelegate( this ) );
 
         {
             auto admissionDateDelegate = new DateItemDelegate( this );
-            admissionDateDelegate->connectMinimalDateToColumn( 5 );
+            admissionDateDelegate->connectMinimalDateToColumn( PatientsModel::DISCARGE_DATE );
             admissionDateDelegate->setMinimalDate( true );
-            m_patientsView->setItemDelegateForColumn( 4, admissionDateDelegate );
+            m_patientsView->setItemDelegateForColumn( PatientsModel::ADMISSION_DATE, admissionDateDelegate );
         }
 
         {
             auto discargeDateDelegate = new DateItemDelegate( this );
             discargeDateDelegate->setNullable( true );
-            m_patientsView->setItemDelegateForColumn( 5, discargeDateDelegate );
+            m_patientsView->setItemDelegateForColumn( PatientsModel::DISCARGE_DATE, discargeDateDelegate );
         }
 
+        connect( model, &PatientsModel::busyChanged, this, [this]( bool busy ){ showBusy( m_patientsView, busy ); } );
+        connect( model, &PatientsModel::queryFailed, this, [this]( const QSqlError& error ){ showQueryError( error ); } );
+
         connect( m_patientsView, &TableViewEx::activated, this, &MainWindow::showPatientPage );
         connect( m_patientsView, &TableViewEx::rightDoubleClicked, this, &MainWindow::showPatientPage );
 
         return true;
     }
 
-    bool MainWindow::setupPatientInfoView( QSqlTableModel* model ) noexcept
+    bool MainWindow::setupPatientInfoView( PatientsModel* model ) noexcept
     {
         if( m_patientInfoView )
             delete m_patientInfoView;
@@ -246,9 +349,6 @@ namespace PatientsDBManager
         if( m_patientInfoView = new ( std::nothrow ) QTableView( this ); !m_patientInfoView )
             return false;
 
-        model->setEditStrategy( QSqlTableModel::OnFieldChange );
-        model->select();
-
         m_patientInfoView->horizontalHeader()->hide();
 
         auto proxyModel = new HorizontalProxyModel;
@@ -268,34 +368,34 @@ namespace PatientsDBManager
         {
             auto nameDelagate = new RegexItemDelegate( Global::NOT_EMPTY_REGEX_PATTERN, this );
             nameDelagate->setToolTip( "'Name' can't be empty" );
-            m_patientInfoView->setItemDelegateForRow( 1, nameDelagate );
+            m_patientInfoView->setItemDelegateForRow( PatientsModel::NAME, nameDelagate );
         }
 
         {
             auto addressDelagate = new RegexItemDelegate( Global::NOT_EMPTY_REGEX_PATTERN, this );
             addressDelagate->setToolTip( "'Address' can't be empty" );
-            m_patientInfoView->setItemDelegateForRow( 2, addressDelagate );
+            m_patientInfoView->setItemDelegateForRow( PatientsModel::ADDRESS, addressDelagate );
         }
 
-        m_patientInfoView->setItemDelegateForRow( 3, new DateItemDelegate( this ) );
+        m_patientInfoView->setItemDelegateForRow( PatientsModel::BIRTH_DATE, new DateItemDelegate( this ) );
 
         {
             auto admissionDateDelegate = new DateItemDelegate( this );
-            admissionDateDelegate->connectMinimalDateToRow( 5 );
+            admissionDateDelegate->connectMinimalDateToRow( PatientsModel::DISCARGE_DATE );
             admissionDateDelegate->setMinimalDate( true );
-            m_patientInfoView->setItemDelegateForRow( 4, admissionDateDelegate );
+            m_patientInfoView->setItemDelegateForRow( PatientsModel::ADMISSION_DATE, admissionDateDelegate );
         }
 
         {
             auto discargeDateDelegate = new DateItemDelegate( this );
             discargeDateDelegate->setNullable( true );
-            m_patientInfoView->setItemDelegateForRow( 5, discargeDateDelegate );
+            m_patientInfoView->setItemDelegateForRow( PatientsModel::DISCARGE_DATE, discargeDateDelegate );
         }
 
         return true;
     }
 
-    bool MainWindow::setupPhotoSetView( QSqlTableModel* model ) noexcept
+    bool MainWindow::setupPhotoSetView( PhotoSetModel* model ) noexcept
     {
         if( m_photoSetView )
             delete m_photoSetView;
@@ -304,23 +404,29 @@ namespace PatientsDBManager
             return false;
 
         m_photoSetView->setModel( model );
-        m_photoSetView->hideColumn( 0 ); // don't show the ID
-        m_photoSetView->hideColumn( 3 ); // don't show the binary data
-        m_photoSetView->hideColumn( 4 ); // don't show the Patient_Id
+        if( auto editBuffer = m_db.getEditBuffer() )
+            connect( m_photoSetView->selectionModel(), &QItemSelectionModel::currentRowChanged, editBuffer, &EditBuffer::flush );
+        m_photoSetView->hideColumn( PhotoSetModel::ID ); // don't show the ID
+        m_photoSetView->hideColumn( PhotoSetModel::PATIENT_ID ); // don't show the Patient_Id
         m_photoSetView->setHorizontalScrollMode( QAbstractItemView::ScrollPerPixel );
         m_photoSetView->setSelectionBehavior( QAbstractItemView::SelectRows );
         m_photoSetView->setSelectionMode( QAbstractItemView::ExtendedSelection );
+        m_photoSetView->setIconSize( QSize( 64, 64 ) );
+        m_photoSetView->verticalHeader()->setDefaultSectionSize( 68 );
         m_photoSetView->resizeColumnsToContents();
         m_photoSetView->horizontalHeader()->setStretchLastSection( true );
 
-        m_photoSetView->setItemDelegateForColumn( 1, new DateTimeItemDelegate( this ) );
+        m_photoSetView->setItemDelegateForColumn( PhotoSetModel::DATE, new DateTimeItemDelegate( this ) );
 
         {
             auto photoNameDelegate = new RegexItemDelegate( Global::NOT_EMPTY_REGEX_PATTERN, this );
             photoNameDelegate->setToolTip( "'Photo name' cannot be empty" );
-            m_photoSetView->setItemDelegateForColumn( 2, photoNameDelegate );
+            m_photoSetView->setItemDelegateForColumn( PhotoSetModel::FILENAME, photoNameDelegate );
         }
 
+        connect( model, &PhotoSetModel::busyChanged, this, [this]( bool busy ){ showBusy( m_photoSetView, busy ); } );
+        connect( model, &PhotoSetModel::queryFailed, this, [this]( const QSqlError& error ){ showQueryError( error ); } );
+
         connect( m_photoSetView, &TableViewEx::rightDoubleClicked, this, &MainWindow::openPhotos );
 
         return true;
@@ -367,11 +473,11 @@ namespace PatientsDBManager
         auto verticalSpacer = new ( std::nothrow ) QSpacerItem( 0, 0, QSizePolicy::Fixed, QSizePolicy::Minimum );
         tableCommandPanelLayout->addItem( verticalSpacer, 0, 2, 0, 2 );
 
-        tableCommandPanelLayout->addWidget( m_updatePatientBtn, 1, 2, Qt::AlignCenter );
         tableCommandPanelLayout->addWidget( m_addPatientBtn, 1, 3, Qt::AlignCenter );
         tableCommandPanelLayout->addWidget( m_removePatientBtn, 1, 4, Qt::AlignCenter );
 
         pageLayout->addLayout( tableCommandPanelLayout );
+        pageLayout->addWidget( m_patientSearchEdit );
         pageLayout->addWidget( m_patientsView );
 
         mainPage->setLayout( pageLayout );
@@ -382,23 +488,23 @@ namespace PatientsDBManager
     QWidget* MainWindow::createPatientPage() const noexcept
     {
         auto infoLayout =               new ( std::nothrow ) QVBoxLayout;
-        auto infoLabelUpdateLayout =    new ( std::nothrow ) QHBoxLayout;
-        auto updateAddRemoveLayout =    new ( std::nothrow ) QHBoxLayout;
+        auto infoLabelLayout =          new ( std::nothrow ) QHBoxLayout;
+        auto addRemoveLayout =          new ( std::nothrow ) QHBoxLayout;
         auto photosLayout =             new ( std::nothrow ) QVBoxLayout;
         auto pageLayout =               new ( std::nothrow ) QHBoxLayout;
         auto pageMainLayout =           new ( std::nothrow ) QHBoxLayout;
         auto patientPage =              new ( std::nothrow ) QWidget;
 
         if( !infoLayout ||
-            !infoLabelUpdateLayout ||
-            !updateAddRemoveLayout ||
+            !infoLabelLayout ||
+            !addRemoveLayout ||
             !photosLayout ||
             !pageLayout ||
             !pageMainLayout ||
             !patientPage )
         {
             delete infoLayout;
-            delete updateAddRemoveLayout;
+            delete addRemoveLayout;
             delete photosLayout;
             delete pageLayout;
             delete pageMainLayout;
@@ -406,21 +512,19 @@ namespace PatientsDBManager
             return  nullptr;
         }
 
-        updateAddRemoveLayout->addSpacerItem(
+        addRemoveLayout->addSpacerItem(
                     new ( std::nothrow ) QSpacerItem( 0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed ) );
-        updateAddRemoveLayout->addWidget( m_updatePhotoBtn );
-        updateAddRemoveLayout->addWidget( m_addPhotoBtn );
-        updateAddRemoveLayout->addWidget( m_removePhotoBtn );
+        addRemoveLayout->addWidget( m_addPhotoBtn );
+        addRemoveLayout->addWidget( m_removePhotoBtn );
 
-        photosLayout->addLayout( updateAddRemoveLayout );
+        photosLayout->addLayout( addRemoveLayout );
         photosLayout->addWidget( m_photoSetView );
 
-        infoLabelUpdateLayout->addWidget( m_patientInfoLbl );
-        infoLabelUpdateLayout->addSpacerItem(
+        infoLabelLayout->addWidget( m_patientInfoLbl );
+        infoLabelLayout->addSpacerItem(
                     new ( std::nothrow ) QSpacerItem( 0, 0, QSizePolicy::Expanding, QSizePolicy::Fixed ) );
-        infoLabelUpdateLayout->addWidget( m_updateInfoBtn );
 
-        infoLayout->addLayout( infoLabelUpdateLayout );
+        infoLayout->addLayout( infoLabelLayout );
         infoLayout->addWidget( m_patientInfoView );
 
         pageLayout->addLayout( infoLayout );
@@ -436,58 +540,127 @@ namespace PatientsDBManager
         return patientPage;
     }
 
-    bool MainWindow::update( QTableView* view ) noexcept
+    void MainWindow::resync() noexcept
     {
-        QString errorMsg;
-        if( view )
+        if( auto model = dynamic_cast<PatientsModel*>( m_patientsView->model() ) )
+            model->select();
+
+        if( m_photoSetView )
         {
-            if( auto model = dynamic_cast<QSqlTableModel*>( view->model() ) )
-            {
-                if( !model->select() )
-                    errorMsg = model->lastError().text();
-                else
-                    return true;
-            }
+            if( auto model = dynamic_cast<PhotoSetModel*>( m_photoSetView->model() ) )
+                model->select();
         }
+    }
 
-        if( errorMsg.isEmpty() )
-            errorMsg = "Nullptr error";
+    void MainWindow::showBusy( QTableView* view, bool busy ) noexcept
+    {
+        if( !view )
+            return;
+
+        if( busy )
+            view->viewport()->setCursor( Qt::BusyCursor );
+        else
+            view->viewport()->unsetCursor();
+    }
 
+    void MainWindow::showQueryError( const QSqlError& error ) noexcept
+    {
         QMessageBox::warning( this,
                               "Update error",
-                              errorMsg,
+                              error.text(),
                               QMessageBox::Ok );
-
-        return false;
     }
 
     bool MainWindow::remove( QTableView* view ) noexcept
     {
-        if( view )
+        QString errorMsg;
+        if( view && view->selectionModel() )
         {
-            auto model = dynamic_cast<QSqlTableModel*>( view->model() );
-            if( model && view->selectionModel() )
+            QVector<int> rows;
+            for( const auto& row : view->selectionModel()->selectedRows() )
+                rows.append( row.row() );
+
+            if( auto model = dynamic_cast<PatientsModel*>( view->model() ) )
             {
-                const auto& selectedRows = view->selectionModel()->selectedRows();
-                for( const auto& row : selectedRows )
+                if( const auto removedPhotos = model->removePatients( rows ) )
                 {
-                    model->removeRow( row.row() );
+                    statusBar()->showMessage( QString( "%1 patients and %2 of their photos were removed" )
+                                              .arg( rows.size() )
+                                              .arg( *removedPhotos ) );
+                    return true;
                 }
-                model->select();
-                return true;
+                errorMsg = model->lastError().text();
+            }
+            else if( auto model = dynamic_cast<PhotoSetModel*>( view->model() ) )
+            {
+                if( model->removePhotos( rows ) )
+                {
+                    statusBar()->showMessage( QString( "%1 photos were removed" ).arg( rows.size() ) );
+                    return true;
+                }
+                errorMsg = model->lastError().text();
             }
         }
+
+        if( errorMsg.isEmpty() )
+            errorMsg = "Nullptr error";
+
         QMessageBox::warning( this,
                               "Remove error",
-                              "Nullptr error",
+                              errorMsg,
                               QMessageBox::Ok );
         return false;
     }
 
 
-    void MainWindow::updatePatients() noexcept
+    void MainWindow::searchPatients( const QString& text ) noexcept
+    {
+        // The search connection and its thread are started with the first keystroke
+        if( !m_patientSearch )
+        {
+            if( m_patientSearch = new ( std::nothrow ) PatientSearch( m_db, this ); !m_patientSearch )
+                return;
+
+            connect( m_patientSearch, &PatientSearch::resultsReady, this, &MainWindow::showSearchResults );
+            connect( m_patientSearch, &PatientSearch::searchCleared, this, [this]{
+                setPatientsFilter( QString() );
+                statusBar()->clearMessage();
+            } );
+        }
+
+        m_patientSearch->search( text );
+    }
+
+    void MainWindow::showSearchResults( const QString& text, const QVector<qint64>& patientIds, bool truncated ) noexcept
+    {
+        // a newer search is on the way
+        if( text != m_patientSearchEdit->text().simplified() )
+            return;
+
+        QStringList ids;
+        ids.reserve( patientIds.size() );
+        for( const auto id : patientIds )
+            ids.append( QString::number( id ) );
+
+        setPatientsFilter( ids.isEmpty() ? "0" : "Id IN (" + ids.join( ',' ) + ")" );
+
+        if( truncated )
+            statusBar()->showMessage( QString( "Only the first %1 matches are shown, refine the search" )
+                                      .arg( PatientSearch::RESULT_LIMIT ) );
+        else
+            statusBar()->showMessage( QString( "%1 patients found" ).arg( patientIds.size() ) );
+    }
+
+    void MainWindow::setPatientsFilter( const QString& filter ) noexcept
     {
-        update( m_patientsView );
+        m_patientsFilter = filter;
+
+        // the patient page keeps its own filter until it returns to the list
+        if( m_winPages && m_winPages->currentIndex() != 0 )
+            return;
+
+        if( auto model = dynamic_cast<PatientsModel*>( m_patientsView->model() ) )
+            model->setFilter( m_patientsFilter );
     }
 
     void MainWindow::addPatient() noexcept
@@ -495,31 +668,15 @@ namespace PatientsDBManager
         QString errorMsg;
         if( m_patientsView )
         {
-            if( auto model = dynamic_cast<QSqlTableModel*>( m_patientsView->model() ) )
+            if( auto model = dynamic_cast<PatientsModel*>( m_patientsView->model() ) )
             {
                 AddPatientDlg dialog( this );
                 if( dialog.exec() == QDialog::Accepted )
                 {
-                    const auto& p = dialog.getPatient();
-
-                    QSqlRecord newPatientRecord = model->record();
-                    newPatientRecord.setValue( "Name", p.name );
-                    newPatientRecord.setValue( "Address", p.address );
-                    newPatientRecord.setValue( "BirthDate", p.birthDate );
-                    newPatientRecord.setValue( "AdmissionDate", p.admissionDate );
-
-                    const auto& discargeDate = p.discargeDate.isEmpty()
-                                                            ? Global::EMPTY_CELL_DEFAULT_VALUE
-                                                            : p.discargeDate;
-                    newPatientRecord.setValue( "DiscargeDate", discargeDate );
-
-                    if( !model->insertRecord( -1, newPatientRecord ) )
+                    if( !model->addPatient( dialog.getPatient() ) )
                         errorMsg = model->lastError().text();
                     else
-                    {
-                        model->select();
                         return;
-                    }
                 }
                 else
                     return;
@@ -541,68 +698,75 @@ namespace PatientsDBManager
         remove( m_patientsView );
     }
 
-    void MainWindow::updatePatientInfo() noexcept
+    void MainWindow::addPhotos() noexcept
     {
-        update( m_patientsView );
-    }
+        if( !m_photoSetView || !dynamic_cast<PhotoSetModel*>( m_photoSetView->model() ) )
+        {
+            QMessageBox::warning( this,
+                                  "Add photos error",
+                                  "Nullptr error",
+                                  QMessageBox::Ok );
+            return;
+        }
 
-    void MainWindow::updatePhotoSet() noexcept
-    {
-        update( m_photoSetView );
-    }
+        QFileDialog dialog( this, "Open File" );
+        Utility::InitImageFileDialog( dialog, QFileDialog::AcceptOpen, QFileDialog::ExistingFiles );
+        if( dialog.exec() != QDialog::Accepted || dialog.selectedFiles().isEmpty() )
+            return;
 
-    void MainWindow::addPhotos() noexcept
-    {
-        QString errorMsg;
-        int failCount = 0;
-        if( m_photoSetView )
+        const auto& files = dialog.selectedFiles();
+
+        auto importer = new ( std::nothrow ) PhotoImporter( m_db, m_currentPatientId, files, this );
+        auto progressDlg = new ( std::nothrow ) QProgressDialog( "Importing photos...", "Cancel", 0, files.size(), this );
+        if( !importer || !progressDlg )
         {
-            if( auto model = dynamic_cast<QSqlTableModel*>( m_photoSetView->model() ) )
-            {
-                QFileDialog dialog( this, "Open File" );
-                Utility::InitImageFileDialog( dialog, QFileDialog::AcceptOpen, QFileDialog::ExistingFiles );
-                if( dialog.exec() == QDialog::Accepted )
-                {
-                    for( const auto& filePath : dialog.selectedFiles() )
-                    {
-                        if( auto binaryImage = Utility::LoadImage( filePath ) )
-                        {
-                            QSqlRecord newRecord = model->record();
-                            QFileInfo fileInfo( filePath );
-                            auto fileTime = fileInfo.fileTime( QFileDevice::FileBirthTime );
-                            if( !fileTime.isValid() )
-                                fileTime = QDateTime::currentDateTime();
-                            newRecord.setValue( "Date", fileTime.toString( Global::DATE_TIME_FORMAT ) );
-                            newRecord.setValue( "Filename", fileInfo.baseName() );
-                            newRecord.setValue( "Photo", *binaryImage );
-                            newRecord.setValue( "Patient_Id", m_currentPatientId );
-
-                            delete binaryImage;
-
-                            if( !model->insertRecord( -1, newRecord ) )
-                                ++failCount;                            
-                            else
-                                continue;
-                        }
-                    }
-                    model->select();
-                    if( failCount == 0 )
-                        return;
-                }
-                else
-                    return;
-            }
+            delete importer;
+            delete progressDlg;
+            return;
         }
 
-        if( failCount > 0 )
-            errorMsg = QString( "%1 photos were not added" ).arg( failCount );
-        else
-            errorMsg = "Nullptr error";
+        progressDlg->setWindowTitle( "Add photos" );
+        progressDlg->setWindowModality( Qt::WindowModal );
+        progressDlg->setMinimumDuration( 0 );
+        progressDlg->setValue( 0 );
 
-        QMessageBox::warning( this,
-                              "Add photos error",
-                              errorMsg,
-                              QMessageBox::Ok );
+        auto errors = std::make_shared<QStringList>();
+
+        connect( importer, &PhotoImporter::progressChanged, progressDlg, &QProgressDialog::setValue );
+        connect( importer, &PhotoImporter::photosAdded,
+                 dynamic_cast<PhotoSetModel*>( m_photoSetView->model() ), &PhotoSetModel::refreshPhotos );
+        connect( progressDlg, &QProgressDialog::canceled, importer, &PhotoImporter::cancel );
+        connect( importer, &PhotoImporter::fileFailed, this, [errors]( const QString& filePath, const QString& reason )
+        {
+            errors->append( QString( "%1: %2" ).arg( QFileInfo( filePath ).fileName() ).arg( reason ) );
+        } );
+        connect( importer, &PhotoImporter::finished, this, [=]( int imported, bool canceled )
+        {
+            progressDlg->deleteLater();
+            importer->deleteLater();
+            m_addPhotoBtn->setEnabled( true );
+
+            if( !errors->isEmpty() )
+            {
+                QMessageBox messageBox( QMessageBox::Warning,
+                                        "Add photos error",
+                                        QString( "%1 of %2 photos were not added" ).arg( errors->size() ).arg( files.size() ),
+                                        QMessageBox::Ok,
+                                        this );
+                messageBox.setDetailedText( errors->join( '\n' ) );
+                messageBox.exec();
+            }
+            else if( canceled )
+            {
+                QMessageBox::information( this,
+                                          "Add photos",
+                                          QString( "Import canceled, %1 of %2 photos were added" ).arg( imported ).arg( files.size() ),
+                                          QMessageBox::Ok );
+            }
+        } );
+
+        m_addPhotoBtn->setEnabled( false );
+        importer->start();
     }
 
     void MainWindow::removePhotos() noexcept
@@ -612,29 +776,42 @@ namespace PatientsDBManager
 
     void MainWindow::returnToMainPage() noexcept
     {
-        if( auto model = dynamic_cast<QSqlTableModel*>( m_patientsView->model() ) )
+        // the patient shown on the info page loses the focus
+        if( auto editBuffer = m_db.getEditBuffer() )
+            editBuffer->flush();
+
+        if( auto model = dynamic_cast<PatientsModel*>( m_patientsView->model() ) )
         {
-            model->setFilter( "" );
+            model->setFilter( m_patientsFilter );
         }
         switchPage( 0 );
     }
 
     void MainWindow::showPatientPage()
     {
-        if( auto model = dynamic_cast<QSqlTableModel*>( m_patientsView->model() ) )
+        if( auto model = dynamic_cast<PatientsModel*>( m_patientsView->model() ) )
         {
             const auto& selectedRows = m_patientsView->selectionModel()->selectedRows();
 
             if( selectedRows.isEmpty() || !selectedRows.first().isValid() )
                 return;
 
+            if( !setupPatientPage() )
+            {
+                QMessageBox::warning( this,
+                                      "Error",
+                                      "Patient page initialization failed",
+                                      QMessageBox::Ok );
+                return;
+            }
+
             const auto row = selectedRows.first().row();
-            m_currentPatientId = model->index( row, 0 ).data().toLongLong();
+            m_currentPatientId = model->patientId( row );
 
             m_patientInfoLbl->setText( QString( "Patient #%1" ).arg( m_currentPatientId ) );
 
-            if( auto photoSetsModel = dynamic_cast<QSqlTableModel*>( m_photoSetView->model() ) )
-                photoSetsModel->setFilter( QString( "Patient_Id=%1" ).arg( m_currentPatientId ) );
+            if( auto photoSetsModel = dynamic_cast<PhotoSetModel*>( m_photoSetView->model() ) )
+                photoSetsModel->setPatientId( m_currentPatientId );
 
             model->setFilter( QString( "Id=%1" ).arg( m_currentPatientId ) );
 
@@ -644,16 +821,31 @@ namespace PatientsDBManager
 
     void MainWindow::openPhotos()
     {
-        if( auto model = dynamic_cast<QSqlTableModel*>( m_photoSetView->model() ) )
+        if( auto model = dynamic_cast<PhotoSetModel*>( m_photoSetView->model() ) )
         {
-            for( auto modelIndex : m_photoSetView->selectionModel()->selectedRows() )
-            {
-                const auto& title = model->index( modelIndex.row(), 2 ).data().toString();
-                const auto& binaryImage = model->index( modelIndex.row(), 3 ).data().toByteArray();
+            const auto selectedRows = m_photoSetView->selectionModel()->selectedRows();
+            if( selectedRows.isEmpty() )
+                return;
+
+            // One viewer steps through the whole set, starting at the selected photo
+            QVector<PhotoInfo> photos;
+            photos.reserve( model->rowCount() );
+            for( int row = 0; row < model->rowCount(); ++row )
+                photos.append( model->photo( row ) );
+
+            const int current = selectedRows.first().row();
 
-                // PhotoViewer will free up memory
-                ( new PhotoViewer( title, binaryImage, this ) )->show();
+            // the thumbnail is shown until the photo is decoded
+            QImage placeholder;
+            if( model->hasThumbnail( current ) )
+            {
+                const auto thumbnail = model->data( model->index( current, PhotoSetModel::FILENAME ),
+                                                    Qt::DecorationRole ).value<QIcon>();
+                placeholder = thumbnail.pixmap( Global::THUMBNAIL_SIZE ).toImage();
             }
+
+            // PhotoViewer will free up memory
+            ( new PhotoViewer( m_db.getFileName(), photos, current, placeholder, this ) )->show();
         }
     }
 }
@@ -3,16 +3,22 @@
 
 #include <memory>
 
+#include <QElapsedTimer>
+#include <QLineEdit>
 #include <QMainWindow>
 #include <QStackedWidget>
 #include <QStringListModel>
-#include <QSqlTableModel>
 #include <QTableView>
 #include <QPushButton>
 
 #include "table_view_ex.h"
+#include "model/change_watcher.h"
 #include "model/database.h"
 #include "model/data_types.h"
+#include "model/patient_search.h"
+#include "model/patients_model.h"
+#include "model/photo_set_model.h"
+#include "model/thumbnail_backfill.h"
 #include "patient_info_form.h"
 #include "photo_viewer.h"
 
@@ -28,10 +34,21 @@ namespace PatientsDBManager
     signals:
         void pageSwitched( int index );
 
+    protected:
+        bool eventFilter( QObject* watched, QEvent* event ) override;
+
     private:
         Database m_db;
         int64_t  m_currentPatientId{ 0 };
 
+        ThumbnailBackfill* m_thumbnailBackfill{ nullptr };
+        PatientSearch*     m_patientSearch{ nullptr };
+        ChangeWatcher*     m_changeWatcher{ nullptr };
+        QString            m_patientsFilter;
+
+        QElapsedTimer m_startupTimer;
+        qint64        m_lastStartupPhaseTime{ 0 };
+
         QLabel*         m_patientInfoLbl{ nullptr };
         QStackedWidget* m_winPages{ nullptr };
 
@@ -39,31 +56,33 @@ namespace PatientsDBManager
         QTableView*  m_patientInfoView{ nullptr };
         TableViewEx* m_photoSetView{ nullptr };
 
+        QLineEdit*   m_patientSearchEdit{ nullptr };
         QPushButton* m_addPatientBtn{ nullptr };
         QPushButton* m_removePatientBtn{ nullptr };
-        QPushButton* m_updatePatientBtn{ nullptr };
 
         QPushButton* m_addPhotoBtn{ nullptr };
         QPushButton* m_removePhotoBtn{ nullptr };
-        QPushButton* m_updatePhotoBtn{ nullptr };
-
-        QPushButton* m_updateInfoBtn{ nullptr };
 
         QPushButton* m_returnBtn{ nullptr };
 
         bool setupLayout() noexcept;
         bool setupControls() noexcept;
+        bool setupPatientPage() noexcept;
+        bool setupPatientPageControls() noexcept;
 
-        bool setupPatientsView( QSqlTableModel* model ) noexcept;
-        bool setupPatientInfoView( QSqlTableModel* model ) noexcept;
-        bool setupPhotoSetView( QSqlTableModel* model ) noexcept;
+        void logStartupPhase( const QString& phase ) noexcept;
+
+        bool setupPatientsView( PatientsModel* model ) noexcept;
+        bool setupPatientInfoView( PatientsModel* model ) noexcept;
+        bool setupPhotoSetView( PhotoSetModel* model ) noexcept;
 
         QTableView* getCurrentView() const noexcept;
 
         QWidget* createMainPage() const noexcept;
         QWidget* createPatientPage() const noexcept;
 
-        bool update( QTableView* view ) noexcept;
+        void showBusy( QTableView* view, bool busy ) noexcept;
+        void showQueryError( const QSqlError& error ) noexcept;
         bool remove( QTableView* view ) noexcept;
 
     private slots:
@@ -73,13 +92,14 @@ namespace PatientsDBManager
         void showPatientPage();
         void openPhotos();
 
-        void updatePatients() noexcept;
+        void searchPatients( const QString& text ) noexcept;
+        void showSearchResults( const QString& text, const QVector<qint64>& patientIds, bool truncated ) noexcept;
+        void setPatientsFilter( const QString& filter ) noexcept;
+        void resync() noexcept;
+
         void addPatient() noexcept;
         void removePatients() noexcept;
 
-        void updatePatientInfo() noexcept;
-
-        void updatePhotoSet() noexcept;
         void addPhotos() noexcept;
         void removePhotos() noexcept;
     };
@@ -1,93 +1,229 @@
 #include "photo_viewer.h"
 
-#include <QScrollBar>
+#include <QDebug>
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QScreen>
 #include <QVBoxLayout>
-#include <QWheelEvent>
+
+#include "model/photo_decoder.h"
+#include "view/image_pyramid.h"
+#include "view/tiled_image_view.h"
 
 namespace PatientsDBManager
 {
 
-    PhotoViewer::PhotoViewer( const QByteArray& binaryImage, QWidget* parent )
+    PhotoViewer::PhotoViewer( const QString& dbFileName, const QVector<PhotoInfo>& photos, int current,
+                              const QImage& placeholder, QWidget* parent )
         : QDialog( parent )
+        , m_photos( photos )
+        , m_current( qBound( 0, current, photos.size() - 1 ) )
+        , m_previews( 2 * DEFAULT_PREFETCH_COUNT + 1 )
+        , m_previewSize( previewSize() )
     {
-        if( !init( binaryImage ) )
+        if( m_photos.isEmpty() || !init( dbFileName, placeholder ) )
             close();
     }
 
-    PhotoViewer::PhotoViewer( const QString &title, const QByteArray &binaryImage, QWidget* parent )
-        : QDialog( parent )
+    void PhotoViewer::setPrefetchCount( int count ) noexcept
     {
-        if( !init( binaryImage ) )
-            close();
-
-        setWindowTitle( title );
-    }
+        m_prefetchCount = qMax( 0, count );
 
-    void PhotoViewer::setTitle( const QString& title ) noexcept
-    {
-        setWindowTitle( title );
+        // the previews still in the window move to their slots in the new ring
+        const auto previews = m_previews;
+        m_previews = QVector<Preview>( 2 * m_prefetchCount + 1 );
+        for( const auto& preview : previews )
+        {
+            if( preview.index >= 0 && qAbs( preview.index - m_current ) <= m_prefetchCount )
+                m_previews[preview.index % m_previews.size()] = preview;
+        }
+        prefetch();
     }
 
     void PhotoViewer::zoomIn() noexcept
     {
-        scaleImage( 1.25 );
+        m_view->zoomIn();
     }
 
     void PhotoViewer::zoomOut() noexcept
     {
-        scaleImage( 0.8 );
+        m_view->zoomOut();
     }
 
-    void PhotoViewer::wheelEvent( QWheelEvent* event )
+    void PhotoViewer::showPhoto( int index ) noexcept
     {
-        if( event->delta() > 0 )
-            zoomIn();
+        if( index < 0 || index >= m_photos.size() || index == m_current )
+            return;
+
+        // the full resolution decode of the photo shown so far is not needed any more
+        const auto shownId = m_photos[m_current].contentId;
+        if( m_fullResolutionRequested && !m_requested.contains( shownId ) )
+            m_decoder->cancel( shownId );
+
+        m_current = index;
+        m_previewShown = false;
+        m_fullResolutionRequested = false;
+        updateTitle();
+
+        // Decodes of photos that left the window are dropped, the queued ones
+        // do not even start. The ones still inside it keep running.
+        QSet<int64_t> window;
+        for( int i = qMax( 0, m_current - m_prefetchCount ); i <= qMin( m_photos.size() - 1, m_current + m_prefetchCount ); ++i )
+            window.insert( m_photos[i].contentId );
+
+        for( auto contentId = m_requested.begin(); contentId != m_requested.end(); )
+        {
+            if( window.contains( *contentId ) )
+            {
+                ++contentId;
+                continue;
+            }
+            m_decoder->cancel( *contentId );
+            contentId = m_requested.erase( contentId );
+        }
+
+        m_view->setPlaceholderText( "Loading..." );
+        m_view->fitToWindow();
+
+        const auto& preview = m_previews[index % m_previews.size()];
+        if( preview.index == index )
+        {
+            m_previewShown = true;
+            showImage( preview.image, preview.fullSize, true );
+        }
         else
-            zoomOut();
+        {
+            clearImage();
+        }
 
-        event->accept();
+        prefetch();
     }
 
-    bool PhotoViewer::eventFilter( QObject* o, QEvent* e)
+    void PhotoViewer::showNext() noexcept
     {
-        if( e->type() == QEvent::Wheel )
-            return true;
-        else
-            return QDialog::eventFilter( o, e ); ;
+        showPhoto( m_current + 1 );
     }
 
-    bool PhotoViewer::init( const QByteArray& binaryImage ) noexcept
+    void PhotoViewer::showPrevious() noexcept
     {
-        setAttribute( Qt::WA_DeleteOnClose );
-        auto image =   new ( std::nothrow ) QPixmap;
-        m_imageLabel = new ( std::nothrow ) QLabel( this );
-        m_scrollArea = new ( std::nothrow ) QScrollArea( this );
-
-        if( !m_imageLabel ||
-            !m_scrollArea ||
-            binaryImage.isNull() ||
-            binaryImage.isEmpty() )
+        showPhoto( m_current - 1 );
+    }
+
+    void PhotoViewer::keyPressEvent( QKeyEvent* event )
+    {
+        switch( event->key() )
         {
-            return false;
+            case Qt::Key_Right:
+            case Qt::Key_Down:
+            case Qt::Key_PageDown:
+            case Qt::Key_Space:
+                showNext();
+                break;
+            case Qt::Key_Left:
+            case Qt::Key_Up:
+            case Qt::Key_PageUp:
+            case Qt::Key_Backspace:
+                showPrevious();
+                break;
+            case Qt::Key_Home:
+                showPhoto( 0 );
+                break;
+            case Qt::Key_End:
+                showPhoto( m_photos.size() - 1 );
+                break;
+            case Qt::Key_Plus:
+                zoomIn();
+                break;
+            case Qt::Key_Minus:
+                zoomOut();
+                break;
+            default:
+                QDialog::keyPressEvent( event );
+                return;
+        }
+        event->accept();
+    }
+
+    void PhotoViewer::photoDecoded( int64_t contentId, const QImage& image, const QSize& fullSize ) noexcept
+    {
+        m_requested.remove( contentId );
+
+        // Full resolution decodes are not kept, one photo may be in several rows
+        const bool isPreview = image.width() <= m_previewSize.width() && image.height() <= m_previewSize.height();
+        for( int index = qMax( 0, m_current - m_prefetchCount );
+             isPreview && index <= qMin( m_photos.size() - 1, m_current + m_prefetchCount ); ++index )
+        {
+            if( m_photos[index].contentId == contentId )
+                m_previews[index % m_previews.size()] = Preview{ index, image, fullSize };
         }
 
-        if( !image->loadFromData( binaryImage ) )
+        if( contentId != m_photos[m_current].contentId )
+            return;
+
+        if( !m_resized )
         {
-            return false;
+            m_resized = true;
+
+            auto size = fullSize;
+            if( auto screen = QGuiApplication::primaryScreen() )
+                size = size.boundedTo( screen->availableSize() * 0.8 );
+            resize( size );
         }
 
-        m_imageLabel->setBackgroundRole( QPalette::Base );
-        m_imageLabel->setSizePolicy( QSizePolicy::Ignored, QSizePolicy::Ignored );
-        m_imageLabel->setScaledContents( true );
-        m_imageLabel->setPixmap( *image );
+        if( image.size() == fullSize )
+            m_fullResolutionRequested = true;
 
-        m_scrollArea->setBackgroundRole( QPalette::Dark );
-        m_scrollArea->setWidget( m_imageLabel );
-        m_scrollArea->verticalScrollBar()->installEventFilter( this );
-        m_scrollArea->horizontalScrollBar()->installEventFilter( this );
+        const bool replaceAtOnce = !m_previewShown;
+        m_previewShown = true;
+        showImage( image, fullSize, replaceAtOnce );
+    }
+
+    void PhotoViewer::decodingFailed( int64_t contentId, const QString& error ) noexcept
+    {
+        m_requested.remove( contentId );
+        if( contentId != m_photos[m_current].contentId )
+            return;
+
+        qDebug() << "PhotoViewer::decodingFailed: " + error;
+        m_view->setPlaceholderText( "The photo can not be shown: " + error );
+    }
 
-        resize( image->size() );
-        delete image;
+    void PhotoViewer::requestFullResolution() noexcept
+    {
+        // the placeholder is reduced too, the preview comes first anyway
+        if( !m_previewShown || m_fullResolutionRequested )
+            return;
+
+        m_fullResolutionRequested = true;
+        m_decoder->decode( m_photos[m_current].contentId, QSize() );
+    }
+
+    bool PhotoViewer::init( const QString& dbFileName, const QImage& placeholder ) noexcept
+    {
+        setAttribute( Qt::WA_DeleteOnClose );
+        m_decoder = new ( std::nothrow ) PhotoDecoder( dbFileName, this );
+        m_pyramid = new ( std::nothrow ) ImagePyramid( this );
+        m_view = new ( std::nothrow ) TiledImageView( this );
+
+        if( !m_decoder || !m_pyramid || !m_view )
+            return false;
+
+        connect( m_decoder, &PhotoDecoder::decoded, this, &PhotoViewer::photoDecoded );
+        connect( m_decoder, &PhotoDecoder::failed, this, &PhotoViewer::decodingFailed );
+        connect( m_view, &TiledImageView::detailNeeded, this, &PhotoViewer::requestFullResolution );
+
+        // the arrow keys step through the photos instead of scrolling
+        m_view->setFocusPolicy( Qt::NoFocus );
+        m_view->setPlaceholderText( "Loading..." );
+        m_view->setPyramid( m_pyramid );
+        if( !placeholder.isNull() )
+            m_pyramid->build( placeholder, placeholder.size().scaled( m_previewSize, Qt::KeepAspectRatio ) );
+
+        updateTitle();
+        prefetch();
+
+        if( auto screen = QGuiApplication::primaryScreen() )
+            resize( screen->availableSize() * 0.6 );
 
         return setupLayout();
     }
@@ -99,24 +235,81 @@ namespace PatientsDBManager
         if( !layout )
             return false;
 
-        layout->addWidget( m_scrollArea );
+        layout->addWidget( m_view );
 
         setLayout( layout );
         return true;
     }
 
-    void PhotoViewer::scaleImage( double factor ) noexcept
+    void PhotoViewer::showImage( const QImage& image, const QSize& fullSize, bool replaceAtOnce ) noexcept
     {
-        m_scaleFactor *= factor;
-        m_imageLabel->resize( m_scaleFactor * m_imageLabel->pixmap()->size() );
+        delete m_nextPyramid;
+        m_nextPyramid = new ( std::nothrow ) ImagePyramid( this );
+        if( !m_nextPyramid )
+            return;
+
+        // The coarser levels become ready first
+        connect( m_nextPyramid, &ImagePyramid::levelReady, this, [this, pyramid = m_nextPyramid, replaceAtOnce]( int level )
+        {
+            if( pyramid != m_nextPyramid )
+                return;
 
-        adjustScrollBar( m_scrollArea->horizontalScrollBar(), factor );
-        adjustScrollBar( m_scrollArea->verticalScrollBar(), factor );
+            const int shownWidth = m_pyramid->isNull() ? 0 : m_pyramid->levelSize( 0 ).width();
+            if( !replaceAtOnce && level > 0 && pyramid->levelSize( level ).width() < shownWidth )
+                return;
+
+            auto shown = m_pyramid;
+            m_pyramid = pyramid;
+            m_nextPyramid = nullptr;
+            m_view->setPyramid( m_pyramid );
+            delete shown;
+        } );
+
+        m_nextPyramid->build( image, fullSize );
+    }
+
+    void PhotoViewer::clearImage() noexcept
+    {
+        delete m_nextPyramid;
+        m_nextPyramid = nullptr;
+        m_pyramid->build( QImage() );
+    }
+
+    bool PhotoViewer::isPrefetched( int index ) const noexcept
+    {
+        return m_previews[index % m_previews.size()].index == index;
+    }
+
+    void PhotoViewer::prefetch() noexcept
+    {
+        // the shown photo first, then outwards from it
+        for( int distance = 0; distance <= m_prefetchCount; ++distance )
+        {
+            for( const int index : { m_current + distance, m_current - distance } )
+            {
+                if( index < 0 || index >= m_photos.size() || isPrefetched( index ) )
+                    continue;
+
+                const auto contentId = m_photos[index].contentId;
+                if( m_requested.contains( contentId ) )
+                    continue;
+
+                m_requested.insert( contentId );
+                m_decoder->decode( contentId, m_previewSize );
+            }
+        }
+    }
+
+    void PhotoViewer::updateTitle() noexcept
+    {
+        setWindowTitle( QString( "%1 (%2/%3)" ).arg( m_photos[m_current].fileName )
+                                                .arg( m_current + 1 )
+                                                .arg( m_photos.size() ) );
     }
 
-    void PhotoViewer::adjustScrollBar( QScrollBar* scrollBar, double factor ) noexcept
+    QSize PhotoViewer::previewSize() noexcept
     {
-        scrollBar->setValue( int( factor * scrollBar->value() +
-                                  ( ( factor - 1 ) * scrollBar->pageStep() / 2 ) ) );
+        auto screen = QGuiApplication::primaryScreen();
+        return screen ? screen->availableSize() * screen->devicePixelRatio() : QSize( 1920, 1080 );
     }
 }
@@ -1,43 +1,98 @@
 #ifndef PHOTOVIEWER_H
 #define PHOTOVIEWER_H
 
-#include <QByteArray>
 #include <QDialog>
-#include <QEvent>
-#include <QLabel>
-#include <QScrollArea>
 #include <QImage>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "model/data_types.h"
 
 namespace PatientsDBManager
 {
+    class ImagePyramid;
+    class PhotoDecoder;
+    class TiledImageView;
+
+    // Steps through the photos of a set with the arrow keys, PageUp/PageDown, Home
+    // and End. It opens at once with the placeholder, e.g. the stored thumbnail,
+    // while a copy of the photo near screen size is decoded in the background.
+    // The full resolution is decoded only when the zoom needs more pixels than
+    // that copy has.
+    //
+    // The copies of the prefetchCount() photos before and after the shown one are
+    // decoded ahead and kept in a ring buffer of 2 * prefetchCount() + 1 slots,
+    // photo i in slot i % size, so stepping to a neighbour needs no decode.
     class PhotoViewer : public QDialog
     {
         Q_OBJECT
     public:
-        PhotoViewer( const QByteArray& binaryImage, QWidget* parent = nullptr );
-        PhotoViewer( const QString& title, const QByteArray& binaryImage, QWidget* parent = nullptr );
+        static constexpr int DEFAULT_PREFETCH_COUNT = 2;
+
+        PhotoViewer( const QString& dbFileName, const QVector<PhotoInfo>& photos, int current,
+                     const QImage& placeholder = QImage(), QWidget* parent = nullptr );
 
-        void setTitle( const QString& title ) noexcept;
+        int currentIndex() const noexcept { return m_current; }
+
+        int prefetchCount() const noexcept { return m_prefetchCount; }
+        void setPrefetchCount( int count ) noexcept;
 
     public slots:
         void zoomIn() noexcept;
         void zoomOut() noexcept;
 
+        void showPhoto( int index ) noexcept;
+        void showNext() noexcept;
+        void showPrevious() noexcept;
+
     protected:
-        void wheelEvent( QWheelEvent* event ) override;
-        bool eventFilter( QObject* o, QEvent* e ) override;
+        void keyPressEvent( QKeyEvent* event ) override;
+
+    private slots:
+        void photoDecoded( int64_t contentId, const QImage& image, const QSize& fullSize ) noexcept;
+        void decodingFailed( int64_t contentId, const QString& error ) noexcept;
+        void requestFullResolution() noexcept;
 
     private:
-        QLabel*      m_imageLabel{ nullptr };
-        QScrollArea* m_scrollArea{ nullptr };
-        double       m_scaleFactor{ 1 };
+        struct Preview
+        {
+            int    index{ -1 };
+            QImage image;
+            QSize  fullSize;
+        };
+
+        PhotoDecoder*   m_decoder{ nullptr };
+        ImagePyramid*   m_pyramid{ nullptr };
+        ImagePyramid*   m_nextPyramid{ nullptr };
+        TiledImageView* m_view{ nullptr };
+
+        QVector<PhotoInfo> m_photos;
+        int                m_current{ -1 };
+        int                m_prefetchCount{ DEFAULT_PREFETCH_COUNT };
+        QVector<Preview>   m_previews;
+        QSet<int64_t>      m_requested;     // contents being decoded at preview size
+        QSize              m_previewSize;
 
-        bool init( const QByteArray& binaryImage ) noexcept;
+        bool m_resized{ false };
+        bool m_previewShown{ false };
+        bool m_fullResolutionRequested{ false };
+
+        bool init( const QString& dbFileName, const QImage& placeholder ) noexcept;
         bool setupLayout() noexcept;
 
-        void scaleImage( double factor ) noexcept;
-        void adjustScrollBar( QScrollBar* scrollBar, double factor ) noexcept;
+        // A new photo replaces the shown one at once, a sharper copy of the same
+        // photo when it has a level with at least as many pixels
+        void showImage( const QImage& image, const QSize& fullSize, bool replaceAtOnce ) noexcept;
+        void clearImage() noexcept;
+
+        bool isPrefetched( int index ) const noexcept;
+        void prefetch() noexcept;
+        void updateTitle() noexcept;
 
+        // The screen in device pixels
+        static QSize previewSize() noexcept;
     };
 }
 
@@ -0,0 +1,298 @@
+#include "tiled_image_view.h"
+
+#include <new>
+
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QtMath>
+#include <QWheelEvent>
+
+#include "view/image_pyramid.h"
+
+namespace PatientsDBManager
+{
+    TiledImageView::TiledImageView( QWidget* parent ) noexcept
+        : QAbstractScrollArea( parent )
+        , m_pixmaps( PIXMAP_CACHE_KIB )
+    {
+        viewport()->setBackgroundRole( QPalette::Dark );
+        viewport()->setAutoFillBackground( true );
+    }
+
+    void TiledImageView::setPyramid( ImagePyramid* pyramid ) noexcept
+    {
+        if( m_pyramid )
+        {
+            m_pyramid->disconnect( this );
+            m_pyramid->disconnect( viewport() );
+        }
+
+        m_pyramid = pyramid;
+        if( m_pyramid )
+        {
+            connect( m_pyramid, &ImagePyramid::reset, this, &TiledImageView::pyramidReset );
+            connect( m_pyramid, &ImagePyramid::levelReady, viewport(), qOverload<>( &QWidget::update ) );
+        }
+        pyramidReset();
+    }
+
+    void TiledImageView::setPlaceholderText( const QString& text ) noexcept
+    {
+        m_placeholderText = text;
+        viewport()->update();
+    }
+
+    void TiledImageView::setZoom( double zoom, const QPoint& anchor ) noexcept
+    {
+        zoom = qBound( MIN_ZOOM, zoom, MAX_ZOOM );
+        if( qFuzzyCompare( zoom, m_zoom ) )
+            return;
+
+        const QPointF imagePoint = QPointF( anchor - imageOrigin() ) / m_zoom;
+        m_zoom = zoom;
+        updateScrollBars();
+
+        horizontalScrollBar()->setValue( qRound( imagePoint.x() * m_zoom - anchor.x() ) );
+        verticalScrollBar()->setValue( qRound( imagePoint.y() * m_zoom - anchor.y() ) );
+
+        viewport()->update();
+        emit zoomChanged( m_zoom );
+        checkDetail();
+    }
+
+    void TiledImageView::zoomIn() noexcept
+    {
+        m_fitToWindow = false;
+        setZoom( m_zoom * ZOOM_STEP, viewport()->rect().center() );
+    }
+
+    void TiledImageView::zoomOut() noexcept
+    {
+        m_fitToWindow = false;
+        setZoom( m_zoom / ZOOM_STEP, viewport()->rect().center() );
+    }
+
+    void TiledImageView::fitToWindow() noexcept
+    {
+        m_fitToWindow = true;
+        if( !m_pyramid || m_pyramid->isNull() )
+            return;
+
+        const auto size = m_pyramid->size();
+        const auto viewportSize = viewport()->size();
+        const double zoom = qMin( 1.0, qMin( double( viewportSize.width() ) / size.width(),
+                                             double( viewportSize.height() ) / size.height() ) );
+        setZoom( zoom, viewport()->rect().center() );
+        updateScrollBars();
+    }
+
+    void TiledImageView::paintEvent( QPaintEvent* event )
+    {
+        const int level = m_pyramid && !m_pyramid->isNull() ? readyLevel( levelFor( m_zoom ) ) : -1;
+        if( level < 0 )
+        {
+            QPainter painter( viewport() );
+            painter.setPen( palette().color( QPalette::BrightText ) );
+            painter.drawText( viewport()->rect(), Qt::AlignCenter, m_placeholderText );
+            return;
+        }
+
+        // level pixels to viewport pixels
+        const auto size = m_pyramid->size();
+        const auto levelSize = m_pyramid->levelSize( level );
+        const double scaleX = m_zoom * size.width() / levelSize.width();
+        const double scaleY = m_zoom * size.height() / levelSize.height();
+
+        const auto origin = imageOrigin();
+        const QRect visible = event->rect().translated( -origin );
+        const int tileWidth = qCeil( ImagePyramid::TILE_SIZE * scaleX );
+        const int tileHeight = qCeil( ImagePyramid::TILE_SIZE * scaleY );
+        const int firstColumn = qMax( 0, visible.left() / qMax( tileWidth, 1 ) - 1 );
+        const int lastColumn = qMin( m_pyramid->columnCount( level ) - 1, visible.right() / qMax( tileWidth, 1 ) + 1 );
+        const int firstRow = qMax( 0, visible.top() / qMax( tileHeight, 1 ) - 1 );
+        const int lastRow = qMin( m_pyramid->rowCount( level ) - 1, visible.bottom() / qMax( tileHeight, 1 ) + 1 );
+
+        QPainter painter( viewport() );
+        // smooth when the level is reduced, single pixels stay visible above 100%
+        painter.setRenderHint( QPainter::SmoothPixmapTransform, scaleX < 1 );
+
+        for( int row = firstRow; row <= lastRow; ++row )
+        {
+            for( int column = firstColumn; column <= lastColumn; ++column )
+            {
+                const auto pixmap = tilePixmap( level, column, row );
+                if( pixmap.isNull() )
+                    continue;
+
+                // Edges are rounded once per tile boundary, so neighbouring tiles
+                // meet without gaps at any zoom
+                const int x = column * ImagePyramid::TILE_SIZE;
+                const int y = row * ImagePyramid::TILE_SIZE;
+                const int left = origin.x() + qRound( x * scaleX );
+                const int top = origin.y() + qRound( y * scaleY );
+                const int right = origin.x() + qRound( ( x + pixmap.width() ) * scaleX );
+                const int bottom = origin.y() + qRound( ( y + pixmap.height() ) * scaleY );
+
+                const QRect target( left, top, right - left, bottom - top );
+                if( target.intersects( event->rect() ) )
+                    painter.drawPixmap( target, pixmap, pixmap.rect() );
+            }
+        }
+    }
+
+    void TiledImageView::resizeEvent( QResizeEvent* event )
+    {
+        QAbstractScrollArea::resizeEvent( event );
+
+        if( m_fitToWindow )
+            fitToWindow();
+        else
+            updateScrollBars();
+    }
+
+    void TiledImageView::scrollContentsBy( int dx, int dy )
+    {
+        Q_UNUSED( dx )
+        Q_UNUSED( dy )
+        viewport()->update();
+    }
+
+    void TiledImageView::wheelEvent( QWheelEvent* event )
+    {
+        const int delta = event->angleDelta().y();
+        if( delta != 0 )
+        {
+            m_fitToWindow = false;
+            setZoom( delta > 0 ? m_zoom * ZOOM_STEP : m_zoom / ZOOM_STEP, event->pos() );
+        }
+        event->accept();
+    }
+
+    void TiledImageView::mousePressEvent( QMouseEvent* event )
+    {
+        if( event->button() == Qt::LeftButton )
+        {
+            m_panPosition = event->pos();
+            viewport()->setCursor( Qt::ClosedHandCursor );
+        }
+        QAbstractScrollArea::mousePressEvent( event );
+    }
+
+    void TiledImageView::mouseMoveEvent( QMouseEvent* event )
+    {
+        if( event->buttons() & Qt::LeftButton )
+        {
+            const auto delta = event->pos() - m_panPosition;
+            m_panPosition = event->pos();
+            horizontalScrollBar()->setValue( horizontalScrollBar()->value() - delta.x() );
+            verticalScrollBar()->setValue( verticalScrollBar()->value() - delta.y() );
+        }
+        QAbstractScrollArea::mouseMoveEvent( event );
+    }
+
+    void TiledImageView::mouseReleaseEvent( QMouseEvent* event )
+    {
+        if( event->button() == Qt::LeftButton )
+            viewport()->unsetCursor();
+        QAbstractScrollArea::mouseReleaseEvent( event );
+    }
+
+    void TiledImageView::pyramidReset() noexcept
+    {
+        m_pixmaps.clear();
+        if( m_fitToWindow )
+            fitToWindow();
+        updateScrollBars();
+        viewport()->update();
+        checkDetail();
+    }
+
+    QSize TiledImageView::scaledSize() const noexcept
+    {
+        if( !m_pyramid || m_pyramid->isNull() )
+            return QSize();
+
+        const auto size = m_pyramid->size();
+        return QSize( qRound( size.width() * m_zoom ), qRound( size.height() * m_zoom ) );
+    }
+
+    QPoint TiledImageView::imageOrigin() const noexcept
+    {
+        // an image smaller than the viewport is centered
+        const auto size = scaledSize();
+        const auto viewportSize = viewport()->size();
+        return QPoint( size.width() < viewportSize.width() ? ( viewportSize.width() - size.width() ) / 2
+                                                           : -horizontalScrollBar()->value(),
+                       size.height() < viewportSize.height() ? ( viewportSize.height() - size.height() ) / 2
+                                                             : -verticalScrollBar()->value() );
+    }
+
+    void TiledImageView::updateScrollBars() noexcept
+    {
+        const auto size = scaledSize();
+        const auto viewportSize = viewport()->size();
+
+        horizontalScrollBar()->setRange( 0, qMax( 0, size.width() - viewportSize.width() ) );
+        horizontalScrollBar()->setPageStep( viewportSize.width() );
+        horizontalScrollBar()->setSingleStep( ImagePyramid::TILE_SIZE / 4 );
+
+        verticalScrollBar()->setRange( 0, qMax( 0, size.height() - viewportSize.height() ) );
+        verticalScrollBar()->setPageStep( viewportSize.height() );
+        verticalScrollBar()->setSingleStep( ImagePyramid::TILE_SIZE / 4 );
+    }
+
+    void TiledImageView::checkDetail() noexcept
+    {
+        if( m_pyramid && m_pyramid->isReduced() &&
+            m_pyramid->size().width() * m_zoom * devicePixelRatioF() > m_pyramid->levelSize( 0 ).width() )
+        {
+            emit detailNeeded();
+        }
+    }
+
+    int TiledImageView::levelFor( double zoom ) const noexcept
+    {
+        // the smallest level that still has a pixel for every device pixel
+        const double displayedWidth = m_pyramid->size().width() * zoom * devicePixelRatioF();
+
+        int level = 0;
+        while( level + 1 < m_pyramid->levelCount() && m_pyramid->levelSize( level + 1 ).width() >= displayedWidth )
+            ++level;
+        return level;
+    }
+
+    int TiledImageView::readyLevel( int level ) const noexcept
+    {
+        // a coarser level scaled up is shown until the wanted one is built
+        for( int coarser = level; coarser < m_pyramid->levelCount(); ++coarser )
+        {
+            if( m_pyramid->isLevelReady( coarser ) )
+                return coarser;
+        }
+
+        for( int finer = level - 1; finer >= 0; --finer )
+        {
+            if( m_pyramid->isLevelReady( finer ) )
+                return finer;
+        }
+        return -1;
+    }
+
+    QPixmap TiledImageView::tilePixmap( int level, int column, int row ) noexcept
+    {
+        const quint64 key = ( quint64( level ) << 48 ) | ( quint64( row ) << 24 ) | quint64( column );
+        if( auto cached = m_pixmaps.object( key ) )
+            return *cached;
+
+        const auto tile = m_pyramid->tile( level, column, row );
+        if( tile.isNull() )
+            return QPixmap();
+
+        const auto pixmap = QPixmap::fromImage( tile );
+        if( auto cached = new ( std::nothrow ) QPixmap( pixmap ) )
+            m_pixmaps.insert( key, cached, qMax( 1, pixmap.width() * pixmap.height() * 4 / 1024 ) );
+        return pixmap;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef TILEDIMAGEVIEW_H
+#define TILEDIMAGEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QPixmap>
+#include <QPoint>
+#include <QString>
+
+namespace PatientsDBManager
+{
+    class ImagePyramid;
+
+    // Shows an ImagePyramid with zoom and pan. Each paint draws only the visible
+    // tiles of the level closest above the zoom, so its cost depends on the size
+    // of the viewport and not on the size of the photo. Tiles are converted to
+    // pixmaps on first use and kept in a cache of PIXMAP_CACHE_KIB.
+    class TiledImageView : public QAbstractScrollArea
+    {
+        Q_OBJECT
+    public:
+        static constexpr double MIN_ZOOM = 0.01;
+        static constexpr double MAX_ZOOM = 16;
+        static constexpr double ZOOM_STEP = 1.25;
+        static constexpr int PIXMAP_CACHE_KIB = 96 * 1024;
+
+        explicit TiledImageView( QWidget* parent = nullptr ) noexcept;
+
+        // The pyramid is not owned
+        void setPyramid( ImagePyramid* pyramid ) noexcept;
+        ImagePyramid* pyramid() const noexcept { return m_pyramid; }
+
+        // Shown while no level of the pyramid is ready
+        void setPlaceholderText( const QString& text ) noexcept;
+
+        double zoom() const noexcept { return m_zoom; }
+        // Keeps the point of the image under the anchor, in viewport coordinates, in place
+        void setZoom( double zoom, const QPoint& anchor ) noexcept;
+
+    signals:
+        void zoomChanged( double zoom );
+        // The pyramid was built from a reduced copy that has fewer pixels than the zoom shows
+        void detailNeeded();
+
+    public slots:
+        void zoomIn() noexcept;
+        void zoomOut() noexcept;
+        // The whole image is shown, not above 100%, until the user zooms
+        void fitToWindow() noexcept;
+
+    protected:
+        void paintEvent( QPaintEvent* event ) override;
+        void resizeEvent( QResizeEvent* event ) override;
+        void scrollContentsBy( int dx, int dy ) override;
+        void wheelEvent( QWheelEvent* event ) override;
+        void mousePressEvent( QMouseEvent* event ) override;
+        void mouseMoveEvent( QMouseEvent* event ) override;
+        void mouseReleaseEvent( QMouseEvent* event ) override;
+
+    private slots:
+        void pyramidReset() noexcept;
+
+    private:
+        ImagePyramid*            m_pyramid{ nullptr };
+        double                   m_zoom{ 1 };
+        bool                     m_fitToWindow{ true };
+        QPoint                   m_panPosition;
+        QString                  m_placeholderText;
+        QCache<quint64, QPixmap> m_pixmaps;
+
+        QSize scaledSize() const noexcept;
+        QPoint imageOrigin() const noexcept;
+        void updateScrollBars() noexcept;
+        void checkDetail() noexcept;
+
+        int levelFor( double zoom ) const noexcept;
+        int readyLevel( int level ) const noexcept;
+        QPixmap tilePixmap( int level, int column, int row ) noexcept;
+    };
+}
+
+#endif // TILEDIMAGEVIEW_H